@@ -52,6 +52,7 @@ namespace boost::asio
 	constexpr ::std::chrono::milliseconds http_handshake_timeout  = ::std::chrono::milliseconds(30 * 1000);
 
 	constexpr ::std::chrono::milliseconds  tcp_connect_timeout    = ::std::chrono::milliseconds(30 * 1000);
+	constexpr ::std::chrono::milliseconds  tcp_connect_attempt_delay = ::std::chrono::milliseconds(250); // rfc 8305
 	constexpr ::std::chrono::milliseconds  udp_connect_timeout    = ::std::chrono::milliseconds(30 * 1000);
 	constexpr ::std::chrono::milliseconds http_connect_timeout    = ::std::chrono::milliseconds(30 * 1000);
 
@@ -21,6 +21,7 @@
 #include <asio3/proxy/core.hpp>
 #include <asio3/proxy/error.hpp>
 
+#include <asio3/tcp/connect.hpp>
 #include <asio3/tcp/read.hpp>
 #include <asio3/tcp/write.hpp>
 
@@ -399,10 +400,29 @@ namespace boost::asio::socks5
 		{
 			using connect_socket_t = typename std::remove_cvref_t<AuthConfig>::connect_bound_socket_type;
 
-			asio::ip::tcp::resolver resolver(asio::detail::get_lowest_executor(sock));
-			asio::ip::tcp::resolver::results_type eps{};
-			auto er = co_await asio::resolve(
-				resolver, dst_addr, dst_port, eps, asio::ip::resolver_base::flags());
+			std::vector<asio::ip::tcp::endpoint> eps{};
+			asio::error_code er{};
+
+			if (auth_cfg.on_resolve)
+			{
+				auto [e1, addrs] = co_await auth_cfg.on_resolve(dst_addr);
+				er = e1;
+				for (const asio::ip::address& addr : addrs)
+					eps.emplace_back(addr, dst_port);
+			}
+			else
+			{
+				asio::ip::tcp::resolver resolver(asio::detail::get_lowest_executor(sock));
+				asio::ip::tcp::resolver::results_type results{};
+				er = co_await asio::resolve(
+					resolver, dst_addr, dst_port, results, asio::ip::resolver_base::flags());
+				for (const auto& entry : results)
+					eps.emplace_back(entry.endpoint());
+			}
+
+			if (!er && eps.empty())
+				er = asio::error::host_not_found;
+
 			if (er)
 			{
 				urep = std::uint8_t(socks5::connect_result::host_unreachable);
@@ -411,8 +431,8 @@ namespace boost::asio::socks5
 			else
 			{
 				connect_socket_t bnd_socket(asio::detail::get_lowest_executor(sock));
-				auto [ed, ep] = co_await asio::async_connect(
-					bnd_socket, eps, asio::default_tcp_connect_condition{}, asio::use_awaitable_executor(sock));
+				auto [ed, ep] = co_await asio::happy_eyeballs_connect(
+					bnd_socket, std::move(eps), auth_cfg.connect_attempt_delay, auth_cfg.connect_timeout);
 
 				if (!ed)
 				{
@@ -423,7 +443,8 @@ namespace boost::asio::socks5
 					urep = std::uint8_t(0x00);
 				else if (ed == asio::error::network_unreachable)
 					urep = std::uint8_t(socks5::connect_result::network_unreachable);
-				else if (ed == asio::error::host_unreachable || ed == asio::error::host_not_found)
+				else if (ed == asio::error::host_unreachable || ed == asio::error::host_not_found ||
+					ed == asio::error::timed_out)
 					urep = std::uint8_t(socks5::connect_result::host_unreachable);
 				else if (ed == asio::error::connection_refused)
 					urep = std::uint8_t(socks5::connect_result::connection_refused);
@@ -450,13 +471,29 @@ namespace boost::asio::socks5
 			// if the dest id domain, bind local protocol as the same with the domain
 			else if (atyp == socks5::address_type::domain)
 			{
-				asio::ip::udp::resolver resolver(asio::detail::get_lowest_executor(sock));
-				asio::ip::udp::resolver::results_type eps{};
-				auto er = co_await asio::resolve(
-					resolver, dst_addr, dst_port, eps, asio::ip::resolver_base::flags());
+				asio::error_code er{};
+				asio::ip::address first{};
+
+				if (auth_cfg.on_resolve)
+				{
+					auto [e1, addrs] = co_await auth_cfg.on_resolve(dst_addr);
+					er = e1 ? e1 : (addrs.empty() ? asio::error::host_not_found : asio::error_code{});
+					if (!er)
+						first = addrs.front();
+				}
+				else
+				{
+					asio::ip::udp::resolver resolver(asio::detail::get_lowest_executor(sock));
+					asio::ip::udp::resolver::results_type eps{};
+					er = co_await asio::resolve(
+						resolver, dst_addr, dst_port, eps, asio::ip::resolver_base::flags());
+					if (!er)
+						first = (*eps).endpoint().address();
+				}
+
 				if (!er)
 				{
-					if ((*eps).endpoint().address().is_v6())
+					if (first.is_v6())
 						bnd_protocol = asio::ip::udp::v6();
 					else
 						bnd_protocol = asio::ip::udp::v4();
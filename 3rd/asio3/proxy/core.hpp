@@ -116,6 +116,15 @@ namespace boost::asio::socks5
 		auth_method_vector supported_method{};
 
 		std::function<asio::awaitable<bool>(handshake_info&)> on_auth{};
+
+		// resolve the dest address, like a caching resolver, the asio resolver is used if it is empty.
+		std::function<asio::awaitable<std::tuple<asio::error_code, std::vector<asio::ip::address>>>(
+			std::string_view)> on_resolve{};
+
+		// the endpoints of the connect are raced like the happy eyeballs, the next one is tried
+		// after this delay, and the whole connect fails after the connect timeout.
+		std::chrono::steady_clock::duration connect_attempt_delay = asio::tcp_connect_attempt_delay;
+		std::chrono::steady_clock::duration connect_timeout = asio::tcp_connect_timeout;
 	};
 
 	namespace
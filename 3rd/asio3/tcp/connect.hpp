@@ -10,6 +10,10 @@
 
 #pragma once
 
+#include <memory>
+#include <optional>
+#include <vector>
+
 #include <asio3/core/asio.hpp>
 #include <asio3/core/netutil.hpp>
 #include <asio3/core/strutil.hpp>
@@ -18,6 +22,84 @@
 #include <asio3/core/with_lock.hpp>
 #include <asio3/tcp/core.hpp>
 
+#ifdef ASIO_STANDALONE
+namespace asio::detail
+#else
+namespace boost::asio::detail
+#endif
+{
+	template<typename Socket>
+	struct happy_eyeballs_state
+	{
+		explicit happy_eyeballs_state(const auto& ex) : notify(ex)
+		{
+		}
+
+		// the sockets are never erased until the connect is finished, so the indexes are stable.
+		std::vector<std::unique_ptr<Socket>> sockets{};
+
+		// it is cancelled when an attempt is finished, to wake up the racer.
+		asio::steady_timer notify;
+
+		bool notified = false;
+		bool finished = false;
+
+		std::size_t running = 0;
+
+		std::optional<std::size_t> winner{};
+
+		asio::error_code last_error = asio::error::host_not_found;
+	};
+
+	template<typename Socket>
+	inline asio::awaitable<void> happy_eyeballs_attempt(
+		std::shared_ptr<happy_eyeballs_state<Socket>> state, std::size_t index, asio::ip::tcp::endpoint ep)
+	{
+		auto [e1] = co_await state->sockets[index]->async_connect(ep, asio::use_nothrow_awaitable);
+
+		--state->running;
+
+		// the racer was finished already, this socket was closed or will be closed by it.
+		if (state->finished)
+			co_return;
+
+		if (!e1 && !state->winner)
+			state->winner = index;
+		else if (e1)
+			state->last_error = e1;
+
+		state->notified = true;
+		state->notify.cancel();
+	}
+
+	// rfc 8305 section 4: the family of the first endpoint is tried first, then the families
+	// are interleaved, the order of the endpoints of the same family is kept.
+	inline std::vector<asio::ip::tcp::endpoint> interleave_endpoints(std::vector<asio::ip::tcp::endpoint> eps)
+	{
+		if (eps.size() < 3)
+			return eps;
+
+		bool first_v6 = eps.front().address().is_v6();
+
+		std::vector<asio::ip::tcp::endpoint> primary{}, secondary{};
+		for (asio::ip::tcp::endpoint& ep : eps)
+		{
+			(ep.address().is_v6() == first_v6 ? primary : secondary).emplace_back(std::move(ep));
+		}
+
+		eps.clear();
+		for (std::size_t i = 0; i < primary.size() || i < secondary.size(); ++i)
+		{
+			if (i < primary.size())
+				eps.emplace_back(std::move(primary[i]));
+			if (i < secondary.size())
+				eps.emplace_back(std::move(secondary[i]));
+		}
+
+		return eps;
+	}
+}
+
 #ifdef ASIO_STANDALONE
 namespace asio
 #else
@@ -25,7 +107,122 @@ namespace boost::asio
 #endif
 {
 	/**
-	 * @brief Asynchronously establishes a socket connection by trying each endpoint in a sequence.
+	 * @brief Asynchronously establishes a socket connection by racing the endpoints, like the
+	 *    happy eyeballs of rfc 8305. The families of the endpoints are interleaved, the next
+	 *    attempt is started when the attempt delay elapsed or the previous attempt failed, so a
+	 *    blackholed address only delays the connect by the attempt delay. The first connected
+	 *    socket wins, the other sockets are closed. It must be called in the thread of the
+	 *    socket, the attempts are run in the same thread.
+	 * @param sock - The socket reference to be connected, it is replaced by the winner.
+	 * @param endpoints - The resolved endpoints.
+	 * @param attempt_delay - The delay before the next attempt is started, at least 10ms.
+	 * @param connect_timeout - The deadline of the whole connect, the error is timed_out.
+	 * @return (error, connected_endpoint)
+	 */
+	template<typename AsyncStream>
+	requires is_tcp_socket<AsyncStream>
+	inline asio::awaitable<std::tuple<asio::error_code, asio::ip::tcp::endpoint>> happy_eyeballs_connect(
+		AsyncStream& sock, std::vector<asio::ip::tcp::endpoint> endpoints,
+		std::chrono::steady_clock::duration attempt_delay = asio::tcp_connect_attempt_delay,
+		std::chrono::steady_clock::duration connect_timeout = asio::tcp_connect_timeout)
+	{
+		using sock_type = std::remove_cvref_t<decltype(sock)>;
+		using state_type = detail::happy_eyeballs_state<sock_type>;
+
+		std::vector<asio::ip::tcp::endpoint> eps = detail::interleave_endpoints(std::move(endpoints));
+
+		attempt_delay = (std::max)(attempt_delay, std::chrono::steady_clock::duration(std::chrono::milliseconds(10)));
+
+		auto deadline = std::chrono::steady_clock::now() + connect_timeout;
+
+		std::shared_ptr<state_type> state = std::make_shared<state_type>(sock.get_executor());
+
+		std::size_t next = 0;
+
+		while (!state->winner)
+		{
+			// start the next attempt, the endpoint which can't be opened is skipped.
+			for (; next < eps.size(); ++next)
+			{
+				std::unique_ptr<sock_type> tmp = std::make_unique<sock_type>(sock.get_executor());
+
+				asio::error_code ec{};
+				tmp->open(eps[next].protocol(), ec);
+				if (ec)
+				{
+					state->last_error = ec;
+					continue;
+				}
+
+				state->sockets.emplace_back(std::move(tmp));
+				state->running++;
+
+				asio::co_spawn(sock.get_executor(),
+					detail::happy_eyeballs_attempt(state, state->sockets.size() - 1, eps[next]), asio::detached);
+
+				++next;
+				break;
+			}
+
+			if (state->running == 0 && next >= eps.size())
+				break;
+
+			auto now = std::chrono::steady_clock::now();
+			if (now >= deadline)
+			{
+				state->last_error = asio::error::timed_out;
+				break;
+			}
+
+			if (!state->notified)
+			{
+				state->notify.expires_at(next < eps.size() ? (std::min)(now + attempt_delay, deadline) : deadline);
+
+				auto [e1] = co_await state->notify.async_wait(asio::use_nothrow_awaitable);
+
+				// the racer itself was cancelled, not woken by an attempt.
+				if (e1 && !state->notified)
+				{
+					state->last_error = e1;
+					break;
+				}
+			}
+
+			state->notified = false;
+		}
+
+		state->finished = true;
+
+		asio::error_code ec{};
+
+		for (std::size_t i = 0; i < state->sockets.size(); ++i)
+		{
+			if (i != state->winner)
+				state->sockets[i]->close(ec);
+		}
+
+		if (!state->winner)
+			co_return std::tuple{ state->last_error, asio::ip::tcp::endpoint{} };
+
+		std::unique_ptr<sock_type>& winner = state->sockets[*state->winner];
+
+		asio::ip::tcp::endpoint ep = winner->remote_endpoint(ec);
+
+		sock = std::move(*winner);
+
+		co_return std::tuple{ asio::error_code{}, ep };
+	}
+}
+
+#ifdef ASIO_STANDALONE
+namespace asio
+#else
+namespace boost::asio
+#endif
+{
+	/**
+	 * @brief Asynchronously establishes a socket connection, the endpoints are raced by the
+	 *    happy_eyeballs_connect if the socket isn't opened, otherwise they are tried in a sequence.
 	 * @param sock - The socket reference to be connected.
 	 * @param server_address - The target server address. 
 	 * @param server_port - The target server port. 
@@ -64,23 +261,12 @@ namespace boost::asio
 		}
 		else
 		{
-			asio::error_code ec{};
-
+			std::vector<asio::ip::tcp::endpoint> endpoints{};
 			for (const auto& ep : eps)
-			{
-				sock_type tmp(sock.get_executor());
+				endpoints.emplace_back(ep.endpoint());
 
-				tmp.open(ep.endpoint().protocol(), ec);
-				if (ec)
-					continue;
-
-				auto [e2] = co_await tmp.async_connect(ep, asio::use_awaitable_executor(tmp));
-				if (!e2)
-				{
-					sock = std::move(tmp);
-					co_return e2;
-				}
-			}
+			auto [e2, ep] = co_await asio::happy_eyeballs_connect(sock, std::move(endpoints));
+			co_return e2;
 		}
 
 		co_return asio::error::connection_refused;
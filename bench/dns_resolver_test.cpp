@@ -0,0 +1,177 @@
+/**
+ * dns_resolver_test - the checks of the dns resolver against the stub nameserver of the bench.
+ *
+ * The stub answers the A record of "echo.bench" with 127.0.0.1, and the NXDOMAIN of all the
+ * other names, it counts the queries, so the caching and the coalescing can be checked.
+ *
+ * usage: naslite_dns_resolver_test [--port 18903]
+ */
+
+#include <cstdio>
+#include <string>
+#include <thread>
+
+#include "../naslite/core/dns_resolver.hpp"
+
+#include "stub_backend.hpp"
+
+namespace bench = nas::bench;
+
+static int failures = 0;
+
+#define CHECK(expr) \
+	do { if (!(expr)) { ++failures; std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #expr); } } while (0)
+
+// the reply of the stub for the A query of the name, it is built like the stub does.
+std::string make_stub_reply(std::uint16_t id, std::string_view name)
+{
+	std::string rep = nas::dns_resolver::make_query(id, name, 1);
+	rep[2] = char(0x81); // QR, RD
+	rep[3] = char(0x80); // RA
+	rep[7] = 1;          // ANCOUNT
+	rep.append("\xc0\x0c\x00\x01\x00\x01\x00\x00\x01\x2c\x00\x04\x7f\x00\x00\x01", 16);
+	return rep;
+}
+
+void test_parse_reply()
+{
+	std::string rep = make_stub_reply(0x1234, "echo.bench");
+
+	auto r = nas::dns_resolver::parse_reply(rep, 0x1234, "echo.bench", 1);
+	CHECK(r && r->rcode == 0 && r->addresses.size() == 1 && r->ttl == 300);
+	CHECK(r && !r->addresses.empty() && r->addresses.front() == net::ip::address_v4::loopback());
+
+	// the question is compared case insensitively.
+	CHECK(nas::dns_resolver::parse_reply(rep, 0x1234, "ECHO.bench", 1));
+
+	// the reply of another query is rejected, even if the id is guessed.
+	CHECK(!nas::dns_resolver::parse_reply(rep, 0x1235, "echo.bench", 1));
+	CHECK(!nas::dns_resolver::parse_reply(rep, 0x1234, "other.bench", 1));
+	CHECK(!nas::dns_resolver::parse_reply(rep, 0x1234, "echo.bench", 28));
+
+	// the truncated message is malformed.
+	CHECK(!nas::dns_resolver::parse_reply(std::string_view(rep).substr(0, rep.size() - 2), 0x1234, "echo.bench", 1));
+}
+
+net::awaitable<void> test_resolver(std::uint16_t port, std::atomic<std::uint64_t>& queries)
+{
+	nas::dns_options opts;
+	opts.nameservers = { net::ip::udp::endpoint(net::ip::address_v4::loopback(), port) };
+	opts.hosts_file = "";
+	opts.negative_ttl = std::chrono::seconds(1);
+
+	nas::dns_resolver resolver(opts);
+
+	// the concurrent lookups of the same name are coalesced into one A and one AAAA query.
+	std::atomic<std::size_t> done{ 0 }, resolved{ 0 };
+
+	auto ex = co_await net::this_coro::executor;
+
+	for (int i = 0; i < 10; ++i)
+	{
+		net::co_spawn(ex, [&resolver, &done, &resolved]() -> net::awaitable<void>
+		{
+			auto [ec, addrs] = co_await resolver.async_resolve("echo.bench");
+			if (!ec && addrs.size() == 1 && addrs.front() == net::ip::address_v4::loopback())
+				++resolved;
+			++done;
+		}, net::detached);
+	}
+
+	net::steady_timer timer(ex);
+	while (done < 10)
+	{
+		timer.expires_after(std::chrono::milliseconds(10));
+		co_await timer.async_wait(net::use_nothrow_awaitable);
+	}
+
+	CHECK(resolved == 10);
+	CHECK(queries == 2);
+
+	// the answer is cached by its ttl.
+	{
+		auto [ec, addrs] = co_await resolver.async_resolve("ECHO.bench");
+		CHECK(!ec && addrs.size() == 1);
+		CHECK(queries == 2);
+	}
+
+	// the name which isn't existed is cached by the negative ttl, then queried again.
+	{
+		auto [e1, a1] = co_await resolver.async_resolve("missing.bench");
+		CHECK(e1 == net::error::host_not_found && a1.empty());
+		CHECK(queries == 4);
+
+		auto [e2, a2] = co_await resolver.async_resolve("missing.bench");
+		CHECK(e2 == net::error::host_not_found);
+		CHECK(queries == 4);
+
+		timer.expires_after(std::chrono::milliseconds(1100));
+		co_await timer.async_wait(net::use_nothrow_awaitable);
+
+		auto [e3, a3] = co_await resolver.async_resolve("missing.bench");
+		CHECK(e3 == net::error::host_not_found);
+		CHECK(queries == 6);
+	}
+}
+
+// the nameserver never answers, the system resolver is used after the timeout.
+net::awaitable<void> test_timeout_fallback()
+{
+	net::ip::udp::socket silent(co_await net::this_coro::executor,
+		net::ip::udp::endpoint(net::ip::address_v4::loopback(), 0));
+
+	nas::dns_options opts;
+	opts.nameservers = { silent.local_endpoint() };
+	opts.hosts_file = "";
+	opts.timeout = std::chrono::milliseconds(200);
+	opts.attempts = 1;
+
+	nas::dns_resolver resolver(opts);
+
+	auto begin = std::chrono::steady_clock::now();
+
+	auto [ec, addrs] = co_await resolver.async_resolve("localhost");
+
+	CHECK(!ec && !addrs.empty());
+	CHECK(!addrs.empty() && addrs.front().is_loopback());
+	CHECK(std::chrono::steady_clock::now() - begin >= opts.timeout);
+}
+
+int main(int argc, char* argv[])
+{
+	std::uint16_t port = 18903;
+
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		if (std::string_view(argv[i]) == "--port")
+			port = std::uint16_t(std::stoul(argv[i + 1]));
+	}
+
+	test_parse_reply();
+
+	net::io_context_thread stub{ 1 };
+	net::ip::udp::socket dns(stub.get_executor(), net::ip::udp::endpoint(net::ip::address_v4::loopback(), port));
+	std::atomic<std::uint64_t> queries{ 0 };
+	net::co_spawn(stub.get_executor(), bench::dns_stub_server(dns, "echo.bench", queries), net::detached);
+
+	net::io_context ctx;
+	net::co_spawn(ctx, test_resolver(port, queries), net::detached);
+	net::co_spawn(ctx, test_timeout_fallback(), net::detached);
+	ctx.run();
+
+	net::post(stub.get_executor(), [&dns]() mutable
+	{
+		net::error_code ec{};
+		dns.close(ec);
+	});
+	stub.join();
+
+	if (failures)
+	{
+		std::fprintf(stderr, "%d checks failed\n", failures);
+		return 1;
+	}
+
+	std::printf("all checks passed\n");
+	return 0;
+}
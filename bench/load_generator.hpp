@@ -0,0 +1,494 @@
+#pragma once
+
+#include <chrono>
+#include <memory>
+#include <string>
+#include <vector>
+#include <functional>
+
+#include "../naslite/core/net.hpp"
+#include "../naslite/core/json.hpp"
+#include "../naslite/core/metrics.hpp"
+
+#include <asio3/tcp/connect.hpp>
+#include <asio3/proxy/handshake.hpp>
+#include <asio3/proxy/parser.hpp>
+#include <asio3/proxy/udp_header.hpp>
+
+namespace nas::bench
+{
+	using clock_type = std::chrono::steady_clock;
+
+	// shared by all the clients of a scenario, the clients may run in several threads.
+	struct stats
+	{
+		metric_counter   requests;
+		metric_counter   errors;
+		metric_counter   bytes;
+		metric_histogram latency;
+	};
+
+	struct target_option
+	{
+		std::string   host = "127.0.0.1";
+		std::uint16_t port = 0;
+
+		// http: the "Host" header selects the site of the reverse proxy.
+		std::string   host_header = "127.0.0.1";
+		std::string   target = "/";
+
+		// tunnels: the size of each echoed message.
+		std::size_t   message_size = 64;
+
+		// udp: the datagrams which are sent before the echoes are read, each echo is a request.
+		std::size_t   burst = 1;
+
+		// socks5: the empty username means the anonymous method.
+		std::string   username;
+		std::string   password;
+		std::string   dest_address = "127.0.0.1"; // the domain is resolved by the proxy
+		std::uint16_t dest_port = 0;
+	};
+
+	// a failed connection is retried after a while, otherwise the errors are counted in a busy loop.
+	net::awaitable<void> on_client_error(stats& st)
+	{
+		st.errors.add();
+		co_await net::delay(std::chrono::milliseconds(100));
+	}
+
+	net::awaitable<net::error_code> connect_target(net::tcp_socket& sock, const target_option& opt)
+	{
+		net::error_code ec{};
+		sock.close(ec);
+
+		ec = co_await net::connect(sock, opt.host, opt.port);
+		if (!ec)
+			sock.set_option(net::ip::tcp::no_delay(true), ec);
+		co_return ec;
+	}
+
+	/**
+	 * Send the GET requests over a keep-alive connection one by one, the latency is the time
+	 * from the request was written to the whole response was read.
+	 */
+	net::awaitable<void> http_client(const target_option& opt, stats& st, clock_type::time_point deadline)
+	{
+		std::string req =
+			"GET " + opt.target + " HTTP/1.1\r\n"
+			"Host: " + opt.host_header + "\r\n"
+			"User-Agent: naslite_bench\r\n"
+			"\r\n";
+
+		net::tcp_socket sock(co_await net::this_coro::executor);
+		beast::flat_buffer buf;
+
+		while (clock_type::now() < deadline)
+		{
+			net::error_code ec{};
+
+			if (!sock.is_open())
+			{
+				buf.clear();
+
+				if (ec = co_await connect_target(sock, opt); ec)
+				{
+					co_await on_client_error(st);
+					continue;
+				}
+			}
+
+			auto begin = clock_type::now();
+
+			auto [e1, n1] = co_await net::async_write(sock, net::buffer(req), net::use_nothrow_awaitable);
+			if (e1)
+			{
+				sock.close(ec);
+				co_await on_client_error(st);
+				continue;
+			}
+
+			http::response_parser<http::string_body> parser;
+			parser.body_limit((std::numeric_limits<std::size_t>::max)());
+
+			auto [e2, n2] = co_await http::async_read(sock, buf, parser, net::use_nothrow_awaitable);
+			if (e2 || parser.get().result() != http::status::ok)
+			{
+				sock.close(ec);
+				co_await on_client_error(st);
+				continue;
+			}
+
+			st.latency.record(clock_type::now() - begin);
+			st.requests.add();
+			st.bytes.add(n2);
+
+			if (!parser.get().keep_alive())
+				sock.close(ec);
+		}
+
+		net::error_code ec{};
+		sock.close(ec);
+	}
+
+	// write a message and read the echo of it, until the deadline.
+	net::awaitable<void> echo_loop(
+		net::tcp_socket& sock, std::string& message, std::string& echo, stats& st, clock_type::time_point deadline)
+	{
+		while (clock_type::now() < deadline)
+		{
+			auto begin = clock_type::now();
+
+			auto [e1, n1] = co_await net::async_write(sock, net::buffer(message), net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			auto [e2, n2] = co_await net::async_read(sock, net::buffer(echo), net::use_nothrow_awaitable);
+			if (e2)
+				break;
+
+			st.latency.record(clock_type::now() - begin);
+			st.requests.add();
+			st.bytes.add(n1 + n2);
+		}
+	}
+
+	/**
+	 * Upgrade to websocket through the reverse proxy, then echo the messages in the tunnel,
+	 * the latency is the round trip time of each message.
+	 */
+	net::awaitable<void> websocket_client(const target_option& opt, stats& st, clock_type::time_point deadline)
+	{
+		std::string req =
+			"GET " + opt.target + " HTTP/1.1\r\n"
+			"Host: " + opt.host_header + "\r\n"
+			"Upgrade: websocket\r\n"
+			"Connection: Upgrade\r\n"
+			"Sec-WebSocket-Key: bmFzbGl0ZV9iZW5jaA==\r\n"
+			"Sec-WebSocket-Version: 13\r\n"
+			"\r\n";
+
+		std::string message(opt.message_size, 'w'), echo(opt.message_size, '\0');
+
+		net::tcp_socket sock(co_await net::this_coro::executor);
+
+		while (clock_type::now() < deadline)
+		{
+			if (auto ec = co_await connect_target(sock, opt); ec)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			auto [e1, n1] = co_await net::async_write(sock, net::buffer(req), net::use_nothrow_awaitable);
+			if (e1)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			beast::flat_buffer buf;
+			http::response_parser<http::empty_body> parser;
+
+			auto [e2, n2] = co_await http::async_read_header(sock, buf, parser, net::use_nothrow_awaitable);
+			if (e2 || parser.get().result() != http::status::switching_protocols || buf.size())
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			co_await echo_loop(sock, message, echo, st, deadline);
+
+			if (clock_type::now() < deadline)
+				co_await on_client_error(st);
+		}
+
+		net::error_code ec{};
+		sock.close(ec);
+	}
+
+	socks5::option make_socks5_option(const target_option& opt, socks5::command cmd)
+	{
+		socks5::option sock5_opt{};
+		sock5_opt.proxy_address = opt.host;
+		sock5_opt.proxy_port = opt.port;
+		sock5_opt.username = opt.username;
+		sock5_opt.password = opt.password;
+		sock5_opt.dest_address = opt.dest_address;
+		sock5_opt.dest_port = opt.dest_port;
+		sock5_opt.cmd = cmd;
+		sock5_opt.method.emplace_back(
+			opt.username.empty() ? socks5::auth_method::anonymous : socks5::auth_method::password);
+		return sock5_opt;
+	}
+
+	// CONNECT to the echo backend through the socks5 proxy, then echo the messages in the tunnel.
+	net::awaitable<void> socks5_connect_client(const target_option& opt, stats& st, clock_type::time_point deadline)
+	{
+		std::string message(opt.message_size, 's'), echo(opt.message_size, '\0');
+
+		net::tcp_socket sock(co_await net::this_coro::executor);
+
+		while (clock_type::now() < deadline)
+		{
+			if (auto ec = co_await connect_target(sock, opt); ec)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			socks5::option sock5_opt = make_socks5_option(opt, socks5::command::connect);
+
+			auto [e1] = co_await socks5::async_handshake(sock, sock5_opt, net::use_nothrow_awaitable);
+			if (e1)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			co_await echo_loop(sock, message, echo, st, deadline);
+
+			if (clock_type::now() < deadline)
+				co_await on_client_error(st);
+		}
+
+		net::error_code ec{};
+		sock.close(ec);
+	}
+
+	/**
+	 * A new CONNECT to the echo backend by its domain for each request, the proxy resolves the
+	 * domain every time, the latency is the time of the connect, the handshake and one echo.
+	 */
+	net::awaitable<void> socks5_resolve_client(const target_option& opt, stats& st, clock_type::time_point deadline)
+	{
+		std::string message(opt.message_size, 's'), echo(opt.message_size, '\0');
+
+		while (clock_type::now() < deadline)
+		{
+			net::tcp_socket sock(co_await net::this_coro::executor);
+
+			auto begin = clock_type::now();
+
+			if (auto ec = co_await connect_target(sock, opt); ec)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			socks5::option sock5_opt = make_socks5_option(opt, socks5::command::connect);
+
+			auto [e1] = co_await socks5::async_handshake(sock, sock5_opt, net::use_nothrow_awaitable);
+			if (e1)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			auto [e2, n2] = co_await net::async_write(sock, net::buffer(message), net::use_nothrow_awaitable);
+			auto [e3, n3] = co_await net::async_read(sock, net::buffer(echo), net::use_nothrow_awaitable);
+			if (e2 || e3)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			st.latency.record(clock_type::now() - begin);
+			st.requests.add();
+			st.bytes.add(n2 + n3);
+
+			net::error_code ec{};
+			sock.shutdown(net::socket_base::shutdown_both, ec);
+			sock.close(ec);
+		}
+	}
+
+	/**
+	 * UDP ASSOCIATE through the socks5 proxy, then send the datagrams to the udp echo backend
+	 * a burst each time, and read the echoes of the burst, a datagram which isn't echoed in one
+	 * second is counted as an error. With a burst larger than 1, the requests per second is the
+	 * datagrams per second which are relayed in both directions.
+	 */
+	net::awaitable<void> socks5_udp_client(const target_option& opt, stats& st, clock_type::time_point deadline)
+	{
+		auto executor = co_await net::this_coro::executor;
+
+		std::string payload(opt.message_size, 'u');
+		std::array<char, 64 * 1024> data;
+
+		net::ip::address dest_addr = net::ip::make_address("127.0.0.1");
+
+		net::tcp_socket sock(executor);
+
+		while (clock_type::now() < deadline)
+		{
+			if (auto ec = co_await connect_target(sock, opt); ec)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			net::error_code ec{};
+
+			net::ip::udp::socket udp(executor);
+			udp.open(net::ip::udp::v4(), ec);
+			if (!ec)
+				udp.bind(net::ip::udp::endpoint(net::ip::address_v4::loopback(), 0), ec);
+			if (ec)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			// the proxy only relays the datagrams which come from the declared address.
+			socks5::option sock5_opt = make_socks5_option(opt, socks5::command::udp_associate);
+			sock5_opt.dest_port = udp.local_endpoint(ec).port();
+
+			auto [e1] = co_await socks5::async_handshake(sock, sock5_opt, net::use_nothrow_awaitable);
+			if (e1)
+			{
+				co_await on_client_error(st);
+				continue;
+			}
+
+			net::ip::address bound_addr = net::ip::make_address(sock5_opt.bound_address, ec);
+			if (ec || bound_addr.is_unspecified())
+				bound_addr = net::ip::make_address(opt.host, ec);
+
+			net::ip::udp::endpoint relay(bound_addr, sock5_opt.bound_port);
+
+			auto head = socks5::make_udp_header(dest_addr, opt.dest_port, 0);
+
+			std::string packet;
+			packet.append(reinterpret_cast<const char*>(head.data()), head.size());
+			packet.append(payload);
+
+			while (clock_type::now() < deadline)
+			{
+				auto begin = clock_type::now();
+
+				std::size_t sent = 0;
+
+				for (; sent < (std::max<std::size_t>)(opt.burst, 1); ++sent)
+				{
+					auto [e2, n2] = co_await udp.async_send_to(net::buffer(packet), relay, net::use_nothrow_awaitable);
+					if (e2)
+						break;
+					st.bytes.add(n2);
+				}
+
+				if (sent == 0)
+					break;
+
+				bool failed = false;
+
+				for (std::size_t i = 0; i < sent; ++i)
+				{
+					net::ip::udp::endpoint sender{};
+					auto result = co_await(
+						udp.async_receive_from(net::buffer(data), sender, net::use_nothrow_awaitable) ||
+						net::timeout(std::chrono::seconds(1)));
+					if (net::is_timeout(result))
+					{
+						st.errors.add(sent - i);
+						break;
+					}
+
+					auto [e3, n3] = std::get<0>(result);
+					if (e3)
+					{
+						failed = true;
+						break;
+					}
+
+					auto [err, ep, domain, echo] = socks5::parse_udp_packet(net::buffer(data.data(), n3), false);
+					if (err != 0 || echo.size() != payload.size())
+					{
+						st.errors.add();
+						continue;
+					}
+
+					st.latency.record(clock_type::now() - begin);
+					st.requests.add();
+					st.bytes.add(n3);
+				}
+
+				if (failed)
+					break;
+			}
+
+			if (clock_type::now() < deadline)
+				co_await on_client_error(st);
+		}
+
+		net::error_code ec{};
+		sock.close(ec);
+	}
+
+	using client_function = std::function<net::awaitable<void>(
+		const target_option&, stats&, clock_type::time_point)>;
+
+	struct scenario
+	{
+		std::string     name;
+		client_function client;
+		target_option   opt;
+	};
+
+	// the client is canceled if it is still blocked by the proxy a while after the deadline.
+	net::awaitable<void> run_client(const scenario& sc, stats& st, clock_type::time_point deadline)
+	{
+		co_await(
+			sc.client(sc.opt, st, deadline) ||
+			net::timeout(deadline - clock_type::now() + std::chrono::seconds(5)));
+	}
+
+	/**
+	 * Run the clients of the scenario in the io threads until the duration is elapsed.
+	 * @return The result in json, the latencies are in microseconds.
+	 */
+	json run_scenario(const scenario& sc, std::size_t connections, std::size_t threads, std::chrono::seconds duration)
+	{
+		std::unique_ptr<stats> st = std::make_unique<stats>();
+
+		std::vector<std::unique_ptr<net::io_context_thread>> ctxs;
+		for (std::size_t i = 0; i < (std::max<std::size_t>)(threads, 1); ++i)
+			ctxs.emplace_back(std::make_unique<net::io_context_thread>(1));
+
+		auto begin = clock_type::now();
+		auto deadline = begin + duration;
+
+		for (std::size_t i = 0; i < connections; ++i)
+		{
+			net::co_spawn(ctxs[i % ctxs.size()]->get_executor(), run_client(sc, *st, deadline), net::detached);
+		}
+
+		for (auto& ctx : ctxs)
+			ctx->join();
+
+		double seconds = std::chrono::duration<double>(clock_type::now() - begin).count();
+
+		metric_histogram::snapshot snap = st->latency.get_snapshot();
+
+		std::uint64_t requests = st->requests.value();
+		std::uint64_t bytes = st->bytes.value();
+
+		json j = json::object();
+		j["name"] = sc.name;
+		j["requests"] = requests;
+		j["errors"] = st->errors.value();
+		j["bytes"] = bytes;
+		j["seconds"] = seconds;
+		j["requests_per_second"] = double(requests) / seconds;
+		j["megabytes_per_second"] = double(bytes) / seconds / (1024.0 * 1024.0);
+
+		json latency = json::object();
+		latency["avg"] = snap.count ? double(snap.sum) / double(snap.count) : 0.0;
+		latency["p50"] = snap.quantile(0.50);
+		latency["p99"] = snap.quantile(0.99);
+		latency["p999"] = snap.quantile(0.999);
+		j["latency_us"] = std::move(latency);
+
+		return j;
+	}
+}
@@ -0,0 +1,403 @@
+/**
+ * naslite_bench - the end to end load generator of naslite.
+ *
+ * It starts the stub backends, generates a naslite.json which points every listener type
+ * to the stubs, launches naslite with it, then drives each scenario with the coroutine
+ * clients and writes the throughput and the latency percentiles into a json file.
+ * naslite is launched once for each count of the --worker-threads list, e.g. "1,2,4", so the
+ * scaling of the sharded proxy and static server is reported run by run.
+ *
+ * usage: naslite_bench --naslite <path of naslite> [--duration 10] [--connections 32]
+ *        [--threads 2] [--base-port 18800] [--work-dir naslite_bench] [--only <scenario>]
+ *        [--output naslite_bench_result.json] [--log-level info] [--worker-threads 1]
+ */
+
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include "stub_backend.hpp"
+#include "load_generator.hpp"
+
+#include "../naslite/core/version.hpp"
+
+#include <asio3/core/defer.hpp>
+#include <boost/process/v2.hpp>
+
+namespace bench = nas::bench;
+namespace bp = boost::process::v2;
+namespace fs = std::filesystem;
+
+struct bench_option
+{
+	fs::path      naslite;
+	fs::path      work_dir = "naslite_bench";
+	fs::path      output = "naslite_bench_result.json";
+	std::string   only;
+	std::string   log_level = "info"; // the trace and debug logs of the hot paths cost throughput
+	std::size_t   duration = 10;
+	std::size_t   connections = 32;
+	std::size_t   threads = 2;
+	std::uint16_t base_port = 18800;
+
+	std::vector<std::size_t> worker_threads = { 1 }; // the worker threads of naslite, one run for each
+
+	std::uint16_t http_stub_port() const { return std::uint16_t(base_port + 1); }
+	std::uint16_t echo_stub_port() const { return std::uint16_t(base_port + 2); }
+	std::uint16_t dns_stub_port() const { return std::uint16_t(base_port + 3); }
+	std::uint16_t http_proxy_port() const { return std::uint16_t(base_port + 10); }
+	std::uint16_t static_port() const { return std::uint16_t(base_port + 11); }
+	std::uint16_t socks5_port() const { return std::uint16_t(base_port + 12); }
+};
+
+bool parse_option(int argc, char* argv[], bench_option& opt)
+{
+	for (int i = 1; i + 1 < argc; i += 2)
+	{
+		std::string_view k = argv[i], v = argv[i + 1];
+
+		if /**/ (k == "--naslite")     opt.naslite = v;
+		else if (k == "--work-dir")    opt.work_dir = v;
+		else if (k == "--output")      opt.output = v;
+		else if (k == "--only")        opt.only = v;
+		else if (k == "--log-level")   opt.log_level = v;
+		else if (k == "--worker-threads")
+		{
+			opt.worker_threads.clear();
+			for (std::string_view n : net::split(v, ","))
+				opt.worker_threads.emplace_back(std::stoul(std::string(n)));
+		}
+		else if (k == "--duration")    opt.duration = std::stoul(std::string(v));
+		else if (k == "--connections") opt.connections = std::stoul(std::string(v));
+		else if (k == "--threads")     opt.threads = std::stoul(std::string(v));
+		else if (k == "--base-port")   opt.base_port = std::uint16_t(std::stoul(std::string(v)));
+		else
+		{
+			std::cerr << "unknown option: " << k << std::endl;
+			return false;
+		}
+	}
+
+	if (opt.naslite.empty() || !fs::exists(opt.naslite) || opt.worker_threads.empty())
+	{
+		std::cerr << "usage: naslite_bench --naslite <path of naslite> [--duration 10] [--connections 32] "
+			"[--threads 2] [--base-port 18800] [--work-dir naslite_bench] [--only <scenario>] "
+			"[--output naslite_bench_result.json] [--log-level info] [--worker-threads 1,2,4]" << std::endl;
+		return false;
+	}
+
+	return true;
+}
+
+void write_file(const fs::path& path, std::size_t size, char c)
+{
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	std::string data(size, c);
+	file.write(data.data(), std::streamsize(data.size()));
+}
+
+json make_token(std::string username, std::string password)
+{
+	json j = json::object();
+	j["username"] = std::move(username);
+	j["password"] = std::move(password);
+	j["expires_at"] = "2099-01-01 00:00:00";
+	return j;
+}
+
+json make_proxy_site(std::string domain, std::uint16_t port, bool requires_auth)
+{
+	json j = json::object();
+	j["name"] = domain;
+	j["domain"] = domain;
+	j["host"] = "127.0.0.1";
+	j["port"] = std::to_string(port);
+	j["skip_body_for_head_request"] = true;
+	j["skip_body_for_head_response"] = true;
+	j["requires_auth"] = requires_auth;
+	j["auth_roles"] = json::array();
+	j["proxy_options"] = "";
+
+	// the stub answers 200 for every request, so each request of the role is authed again,
+	// then every message of the connection is parsed, which is the slow path of the proxy.
+	if (requires_auth)
+	{
+		json role = json::object();
+		role["method"] = "GET";
+		role["target"] = "/login";
+		role["result"] = "200";
+		j["auth_roles"].emplace_back(std::move(role));
+	}
+
+	return j;
+}
+
+/**
+ * All the keys which are read by the config parser directly must be existed, otherwise
+ * naslite can't be started.
+ */
+json make_naslite_config(const bench_option& opt, const fs::path& webroot, std::size_t worker_threads)
+{
+	json j = json::object();
+	j["log_level"] = opt.log_level;
+	j["log_queue_size"] = "8192";
+	j["log_overflow_policy"] = "drop";
+	j["dns_nameservers"] = json::array({ "127.0.0.1:" + std::to_string(opt.dns_stub_port()) });
+
+	json jstatic = json::object();
+	jstatic["enable"] = true;
+	jstatic["protocol"] = "http";
+	jstatic["name"] = "bench_static_http_server";
+	jstatic["cert_file"] = "";
+	jstatic["key_file"] = "";
+	jstatic["listen_address"] = "127.0.0.1";
+	jstatic["listen_port"] = std::to_string(opt.static_port());
+	jstatic["webroot"] = webroot.string();
+	jstatic["index"] = "index.html";
+	jstatic["max_request_header_size"] = "1048576";
+	jstatic["enable_cors"] = false;
+	jstatic["requires_auth"] = false;
+	jstatic["tokens"] = json::array();
+	jstatic["worker_threads"] = std::to_string(worker_threads);
+	j["static_http_server"] = json::array({ std::move(jstatic) });
+
+	j["frontend_http_server"] = json::array();
+
+	json jproxy = json::object();
+	jproxy["enable"] = true;
+	jproxy["protocol"] = "http";
+	jproxy["name"] = "bench_http_reverse_proxy";
+	jproxy["ip_blacklist_minutes"] = "1440";
+	jproxy["ip_blacklist_capacity"] = "65536";
+	jproxy["ip_blacklist_file"] = "";
+	jproxy["cert_file"] = "";
+	jproxy["key_file"] = "";
+	jproxy["listen_address"] = "127.0.0.1";
+	jproxy["listen_port"] = std::to_string(opt.http_proxy_port());
+	jproxy["worker_threads"] = std::to_string(worker_threads);
+	jproxy["cpu_affinity"] = false;
+	jproxy["proxy_sites"] = json::array({
+		make_proxy_site("noauth.bench", opt.http_stub_port(), false),
+		make_proxy_site("auth.bench", opt.http_stub_port(), true),
+		make_proxy_site("ws.bench", opt.http_stub_port(), false),
+	});
+	j["http_reverse_proxy"] = json::array({ std::move(jproxy) });
+
+	json jsocks5 = json::object();
+	jsocks5["enable"] = true;
+	jsocks5["protocol"] = "socks5";
+	jsocks5["name"] = "bench_socks5_reverse_proxy";
+	jsocks5["ip_blacklist_minutes"] = "1440";
+	jsocks5["ip_blacklist_capacity"] = "65536";
+	jsocks5["ip_blacklist_file"] = "";
+	jsocks5["listen_address"] = "127.0.0.1";
+	jsocks5["listen_port"] = std::to_string(opt.socks5_port());
+	jsocks5["supported_method"] = json::array({ 2 });
+	jsocks5["tokens"] = json::array({ make_token("bench", "bench") });
+	j["socks5_reverse_proxy"] = json::array({ std::move(jsocks5) });
+
+	j["service_process_mgr"] = json::array();
+
+	return j;
+}
+
+// naslite reads the naslite.json from the directory of its executable, so it is copied into the work dir,
+// and the naslite.json of each run is written by write_naslite_config.
+fs::path prepare_work_dir(const bench_option& opt)
+{
+	fs::path dir = fs::absolute(opt.work_dir);
+	fs::path webroot = dir / "www";
+
+	fs::create_directories(webroot);
+
+	std::ofstream(webroot / "index.html", std::ios::trunc) << "<html><body>naslite_bench</body></html>";
+	write_file(webroot / "small.bin", 4 * 1024, 's');
+	write_file(webroot / "large.bin", 4 * 1024 * 1024, 'l');
+
+	fs::path exe = dir / opt.naslite.filename();
+	fs::copy_file(opt.naslite, exe, fs::copy_options::overwrite_existing);
+
+	return exe;
+}
+
+void write_naslite_config(const bench_option& opt, const fs::path& exe, std::size_t worker_threads)
+{
+	fs::path dir = exe.parent_path();
+
+	std::ofstream(dir / "naslite.json", std::ios::trunc) <<
+		make_naslite_config(opt, dir / "www", worker_threads).dump(2);
+}
+
+bool wait_for_port(std::uint16_t port, std::chrono::seconds timeout)
+{
+	net::io_context ctx;
+	auto deadline = std::chrono::steady_clock::now() + timeout;
+
+	while (std::chrono::steady_clock::now() < deadline)
+	{
+		net::error_code ec{};
+		net::ip::tcp::socket sock(ctx);
+		sock.connect(net::ip::tcp::endpoint(net::ip::address_v4::loopback(), port), ec);
+		if (!ec)
+			return true;
+
+		std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+
+	return false;
+}
+
+// the name which the stub nameserver answers.
+constexpr std::string_view dns_stub_name = "echo.bench";
+
+std::vector<bench::scenario> make_scenarios(const bench_option& opt)
+{
+	bench::target_option http_opt{};
+	http_opt.port = opt.http_proxy_port();
+
+	bench::target_option static_opt{};
+	static_opt.port = opt.static_port();
+
+	bench::target_option socks5_opt{};
+	socks5_opt.port = opt.socks5_port();
+	socks5_opt.username = "bench";
+	socks5_opt.password = "bench";
+	socks5_opt.dest_port = opt.echo_stub_port();
+
+	std::vector<bench::scenario> v;
+
+	v.emplace_back("http_proxy_noauth", bench::http_client, http_opt);
+	v.back().opt.host_header = "noauth.bench";
+
+	v.emplace_back("http_proxy_auth_roles", bench::http_client, http_opt);
+	v.back().opt.host_header = "auth.bench";
+	v.back().opt.target = "/login";
+
+	v.emplace_back("websocket_tunnel", bench::websocket_client, http_opt);
+	v.back().opt.host_header = "ws.bench";
+	v.back().opt.target = "/ws";
+
+	v.emplace_back("static_small", bench::http_client, static_opt);
+	v.back().opt.target = "/small.bin";
+
+	v.emplace_back("static_large", bench::http_client, static_opt);
+	v.back().opt.target = "/large.bin";
+
+	v.emplace_back("socks5_connect", bench::socks5_connect_client, socks5_opt);
+
+	// the domain is resolved by the shared dns resolver of naslite with the stub nameserver.
+	v.emplace_back("socks5_connect_domain", bench::socks5_resolve_client, socks5_opt);
+	v.back().opt.dest_address = dns_stub_name;
+
+	v.emplace_back("socks5_udp", bench::socks5_udp_client, socks5_opt);
+
+	// the packets per second of the full-mtu datagrams, the proxy receives and sends them in batches.
+	v.emplace_back("socks5_udp_burst", bench::socks5_udp_client, socks5_opt);
+	v.back().opt.message_size = 1400;
+	v.back().opt.burst = 32;
+
+	return v;
+}
+
+// launch naslite with the worker threads, then run all the scenarios against it.
+bool run_naslite(const bench_option& opt, const fs::path& exe, std::size_t worker_threads,
+	bench::stub_backends& stubs, json& run)
+{
+	write_naslite_config(opt, exe, worker_threads);
+
+	net::io_context proc_ctx;
+	bp::process naslite(proc_ctx, exe, std::vector<std::string>{}, bp::process_start_dir{ exe.parent_path() });
+
+	std::defer auto_stop = [&naslite]() mutable
+	{
+		net::error_code ec{};
+		naslite.terminate(ec);
+		naslite.wait(ec);
+	};
+
+	for (std::uint16_t port : { opt.http_proxy_port(), opt.static_port(), opt.socks5_port() })
+	{
+		if (!wait_for_port(port, std::chrono::seconds(10)))
+		{
+			std::cerr << "naslite isn't listening on port " << port << ", see the naslite.log in "
+				<< exe.parent_path() << std::endl;
+			return false;
+		}
+	}
+
+	json scenarios = json::array();
+
+	std::uint64_t dns_queries = stubs.dns_query_count();
+
+	for (const bench::scenario& sc : make_scenarios(opt))
+	{
+		if (!opt.only.empty() && opt.only != sc.name)
+			continue;
+
+		std::cout << "running " << sc.name << " with " << worker_threads << " worker threads ..." << std::flush;
+
+		json j = bench::run_scenario(sc, opt.connections, opt.threads, std::chrono::seconds(opt.duration));
+
+		std::cout << " " << j["requests_per_second"].get<double>() << " req/s, p99 "
+			<< j["latency_us"]["p99"].get<std::uint64_t>() << "us, errors "
+			<< j["errors"].get<std::uint64_t>() << std::endl;
+
+		scenarios.emplace_back(std::move(j));
+	}
+
+	// the lookups which were missed by the dns cache, each of them is an A and an AAAA query.
+	dns_queries = stubs.dns_query_count() - dns_queries;
+
+	std::cout << "dns queries to the stub nameserver: " << dns_queries << std::endl;
+
+	run["worker_threads"] = worker_threads;
+	run["dns_queries"] = dns_queries;
+	run["scenarios"] = std::move(scenarios);
+
+	return true;
+}
+
+int main(int argc, char* argv[])
+{
+	bench_option opt{};
+	if (!parse_option(argc, argv, opt))
+		return 1;
+
+	fs::path exe = prepare_work_dir(opt);
+
+	bench::stub_backends stubs(opt.http_stub_port(), opt.echo_stub_port(), opt.dns_stub_port(),
+		std::string(dns_stub_name), 1024);
+
+	json result = json::object();
+	result["version"] = NASLITE_VERSION;
+	result["started_at"] = std::chrono::duration_cast<std::chrono::seconds>(
+		std::chrono::system_clock::now().time_since_epoch()).count();
+
+	json config = json::object();
+	config["duration"] = opt.duration;
+	config["connections"] = opt.connections;
+	config["threads"] = opt.threads;
+	config["log_level"] = opt.log_level;
+	result["config"] = std::move(config);
+
+	json runs = json::array();
+
+	for (std::size_t worker_threads : opt.worker_threads)
+	{
+		json run = json::object();
+		if (!run_naslite(opt, exe, worker_threads, stubs, run))
+			return 1;
+
+		runs.emplace_back(std::move(run));
+	}
+
+	result["runs"] = std::move(runs);
+
+	std::ofstream(opt.output, std::ios::trunc) << result.dump(2);
+
+	std::cout << "result is written to " << fs::absolute(opt.output) << std::endl;
+
+	return 0;
+}
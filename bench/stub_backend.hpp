@@ -0,0 +1,255 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <string>
+
+#include "../naslite/core/net.hpp"
+
+#include <asio3/core/strutil.hpp>
+#include <asio3/core/io_context_thread.hpp>
+#include <asio3/tcp/core.hpp>
+#include <asio3/udp/core.hpp>
+
+namespace nas::bench
+{
+	/**
+	 * The full bytes of the response which the http stub answers for every request, it is
+	 * built once so the stub costs nearly nothing and the proxy is the bottleneck.
+	 */
+	inline std::string make_stub_response(std::size_t body_size)
+	{
+		std::string rep =
+			"HTTP/1.1 200 OK\r\n"
+			"Server: naslite_bench\r\n"
+			"Content-Type: application/octet-stream\r\n"
+			"Content-Length: " + std::to_string(body_size) + "\r\n"
+			"\r\n";
+		rep.append(body_size, 'x');
+		return rep;
+	}
+
+	inline void close_socket(auto& sock)
+	{
+		net::error_code ec{};
+		sock.shutdown(net::socket_base::shutdown_both, ec);
+		sock.close(ec);
+	}
+
+	net::awaitable<void> tcp_echo_session(net::tcp_socket sock)
+	{
+		std::array<char, 16 * 1024> data;
+
+		for (;;)
+		{
+			auto [e1, n1] = co_await sock.async_read_some(net::buffer(data), net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			auto [e2, n2] = co_await net::async_write(sock, net::buffer(data, n1), net::use_nothrow_awaitable);
+			if (e2)
+				break;
+		}
+
+		close_socket(sock);
+	}
+
+	// the websocket upgrade is answered with 101, then the connection is a raw echo tunnel,
+	// the frames are opaque for the proxy, so they don't need to be real websocket frames.
+	net::awaitable<void> http_stub_session(net::tcp_socket sock, std::shared_ptr<const std::string> response)
+	{
+		beast::flat_buffer buf;
+
+		for (;;)
+		{
+			http::request<http::string_body> req;
+			auto [e1, n1] = co_await http::async_read(sock, buf, req, net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			if (websocket::is_upgrade(req))
+			{
+				std::string rep =
+					"HTTP/1.1 101 Switching Protocols\r\n"
+					"Upgrade: websocket\r\n"
+					"Connection: Upgrade\r\n"
+					"Sec-WebSocket-Accept: naslite_bench\r\n"
+					"\r\n";
+				auto [e2, n2] = co_await net::async_write(sock, net::buffer(rep), net::use_nothrow_awaitable);
+				if (e2)
+					break;
+
+				if (buf.size())
+				{
+					auto [e3, n3] = co_await net::async_write(sock, buf.data(), net::use_nothrow_awaitable);
+					if (e3)
+						break;
+				}
+
+				co_return co_await tcp_echo_session(std::move(sock));
+			}
+
+			auto [e2, n2] = co_await net::async_write(sock, net::buffer(*response), net::use_nothrow_awaitable);
+			if (e2 || !req.keep_alive())
+				break;
+		}
+
+		close_socket(sock);
+	}
+
+	net::awaitable<void> http_stub_server(net::ip::tcp::acceptor& acceptor, std::shared_ptr<const std::string> response)
+	{
+		for (;;)
+		{
+			auto [e1, sock] = co_await acceptor.async_accept(net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			sock.set_option(net::ip::tcp::no_delay(true));
+
+			net::co_spawn(acceptor.get_executor(), http_stub_session(std::move(sock), response), net::detached);
+		}
+	}
+
+	net::awaitable<void> tcp_echo_server(net::ip::tcp::acceptor& acceptor)
+	{
+		for (;;)
+		{
+			auto [e1, sock] = co_await acceptor.async_accept(net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			sock.set_option(net::ip::tcp::no_delay(true));
+
+			net::co_spawn(acceptor.get_executor(), tcp_echo_session(std::move(sock)), net::detached);
+		}
+	}
+
+	net::awaitable<void> udp_echo_server(net::ip::udp::socket& sock)
+	{
+		std::array<char, 64 * 1024> data;
+		net::ip::udp::endpoint sender{};
+
+		for (;;)
+		{
+			auto [e1, n1] = co_await sock.async_receive_from(net::buffer(data), sender, net::use_nothrow_awaitable);
+			if (e1 == net::error::operation_aborted)
+				break;
+			if (e1)
+				continue;
+
+			co_await sock.async_send_to(net::buffer(data, n1), sender, net::use_nothrow_awaitable);
+		}
+	}
+
+	/**
+	 * The nameserver which naslite is pointed to by the "dns_nameservers" of the config. The A of
+	 * the name is answered with the loopback address, its AAAA has no answer, the other names are
+	 * not existed. The queries are counted, so the result shows how many lookups of the proxies
+	 * were answered by the shared dns cache instead.
+	 */
+	net::awaitable<void> dns_stub_server(net::ip::udp::socket& sock, std::string name, std::atomic<std::uint64_t>& queries)
+	{
+		std::array<char, 512> data;
+		net::ip::udp::endpoint sender{};
+
+		for (;;)
+		{
+			auto [e1, n1] = co_await sock.async_receive_from(net::buffer(data), sender, net::use_nothrow_awaitable);
+			if (e1 == net::error::operation_aborted)
+				break;
+			if (e1 || n1 < 12)
+				continue;
+
+			queries.fetch_add(1, std::memory_order_relaxed);
+
+			std::string qname;
+			std::size_t pos = 12;
+
+			while (pos < n1 && data[pos] != 0 && pos + 1 + std::uint8_t(data[pos]) <= n1)
+			{
+				if (!qname.empty())
+					qname += '.';
+				qname.append(data.data() + pos + 1, std::uint8_t(data[pos]));
+				pos += 1 + std::uint8_t(data[pos]);
+			}
+
+			// the root label and the qtype, qclass.
+			if (pos + 5 > n1)
+				continue;
+
+			std::uint16_t qtype = std::uint16_t((std::uint8_t(data[pos + 1]) << 8) | std::uint8_t(data[pos + 2]));
+
+			bool existed = net::iequals(qname, name);
+			bool answered = existed && qtype == 1;
+
+			// the header and the question are echoed.
+			std::string rep(data.data(), pos + 5);
+			rep[2] = char(0x80 | (data[2] & 0x01));   // QR, RD
+			rep[3] = char(existed ? 0x80 : 0x83);      // RA, NXDOMAIN
+			rep[4] = 0; rep[5] = 1;                    // QDCOUNT
+			rep[6] = 0; rep[7] = char(answered ? 1 : 0); // ANCOUNT
+			std::fill(rep.begin() + 8, rep.begin() + 12, '\0');
+
+			if (answered)
+			{
+				// the name is a pointer to the question, the ttl is 300 seconds, 127.0.0.1.
+				rep.append("\xc0\x0c\x00\x01\x00\x01\x00\x00\x01\x2c\x00\x04\x7f\x00\x00\x01", 16);
+			}
+
+			co_await sock.async_send_to(net::buffer(rep), sender, net::use_nothrow_awaitable);
+		}
+	}
+
+	/**
+	 * The local backends which the benchmarked proxies are pointed to, they run in their own
+	 * thread, so they don't share the cpu time of the load generator.
+	 */
+	class stub_backends
+	{
+	public:
+		stub_backends(std::uint16_t http_port, std::uint16_t echo_port, std::uint16_t dns_port,
+			std::string dns_name, std::size_t body_size)
+			: http_acceptor(ctx.get_executor(), net::ip::tcp::endpoint(net::ip::address_v4::loopback(), http_port))
+			, echo_acceptor(ctx.get_executor(), net::ip::tcp::endpoint(net::ip::address_v4::loopback(), echo_port))
+			, udp_echo(ctx.get_executor(), net::ip::udp::endpoint(net::ip::address_v4::loopback(), echo_port))
+			, dns(ctx.get_executor(), net::ip::udp::endpoint(net::ip::address_v4::loopback(), dns_port))
+			, response(std::make_shared<const std::string>(make_stub_response(body_size)))
+		{
+			net::co_spawn(ctx.get_executor(), http_stub_server(http_acceptor, response), net::detached);
+			net::co_spawn(ctx.get_executor(), tcp_echo_server(echo_acceptor), net::detached);
+			net::co_spawn(ctx.get_executor(), udp_echo_server(udp_echo), net::detached);
+			net::co_spawn(ctx.get_executor(), dns_stub_server(dns, std::move(dns_name), dns_queries), net::detached);
+		}
+
+		inline std::uint64_t dns_query_count() const noexcept
+		{
+			return dns_queries.load(std::memory_order_relaxed);
+		}
+
+		~stub_backends()
+		{
+			net::post(ctx.get_executor(), [this]() mutable
+			{
+				net::error_code ec{};
+				http_acceptor.close(ec);
+				echo_acceptor.close(ec);
+				udp_echo.close(ec);
+				dns.close(ec);
+
+				// the echo sessions of the tunnels may be still alive, don't wait for them.
+				ctx.context.stop();
+			});
+			ctx.join();
+		}
+
+	protected:
+		net::io_context_thread ctx{ 1 };
+		net::ip::tcp::acceptor http_acceptor;
+		net::ip::tcp::acceptor echo_acceptor;
+		net::ip::udp::socket   udp_echo;
+		net::ip::udp::socket   dns;
+		std::shared_ptr<const std::string> response;
+		std::atomic<std::uint64_t> dns_queries{ 0 };
+	};
+}
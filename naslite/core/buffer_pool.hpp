@@ -0,0 +1,86 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+namespace nas
+{
+	/**
+	 * A large io buffer which is taken from the free list of the current thread, and is given
+	 * back when destroyed, so the transfers don't allocate and free the buffers every time,
+	 * and the free list never needs a lock.
+	 */
+	class pooled_buffer : public noncopyable
+	{
+	public:
+		static constexpr std::size_t buffer_size = 64 * 1024;
+
+		// the buffers more than this are freed, the idle thread only keeps a little memory.
+		static constexpr std::size_t max_pooled_count = 16;
+
+		pooled_buffer() : block(acquire())
+		{
+		}
+
+		~pooled_buffer()
+		{
+			release(std::move(block));
+		}
+
+		inline char* data() noexcept
+		{
+			return block.get();
+		}
+
+		inline std::size_t size() const noexcept
+		{
+			return buffer_size;
+		}
+
+		inline net::mutable_buffer buffer(std::size_t n = buffer_size) noexcept
+		{
+			return net::buffer(block.get(), (std::min)(n, buffer_size));
+		}
+
+	protected:
+		using block_type = std::unique_ptr<char[]>;
+
+		static std::vector<block_type>& free_list() noexcept
+		{
+			thread_local std::vector<block_type> blocks;
+			return blocks;
+		}
+
+		static block_type acquire()
+		{
+			std::vector<block_type>& blocks = free_list();
+			if (blocks.empty())
+				return std::make_unique_for_overwrite<char[]>(buffer_size);
+
+			block_type b = std::move(blocks.back());
+			blocks.pop_back();
+			return b;
+		}
+
+		static void release(block_type b) noexcept
+		{
+			std::vector<block_type>& blocks = free_list();
+			if (b && blocks.size() < max_pooled_count)
+			{
+				try
+				{
+					blocks.emplace_back(std::move(b));
+				}
+				catch (...)
+				{
+				}
+			}
+		}
+
+	protected:
+		block_type block;
+	};
+}
@@ -0,0 +1,189 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+namespace nas
+{
+	/**
+	 * Reads the small files of the webroot into the response cache when the server is started,
+	 * so the first visitor doesn't wait for the cold disk. The files are read in the own thread
+	 * pool, the server is listening at the same time.
+	 */
+	class cache_warmer : public noncopyable
+	{
+	public:
+		struct options
+		{
+			std::uint64_t max_size = 16 * 1024 * 1024; // the total bytes of the files which are read
+			std::uint64_t max_file_size = 1024 * 1024; // the larger files are skipped
+			std::size_t   threads = 2;
+		};
+
+		struct result
+		{
+			std::size_t   files = 0;
+			std::uint64_t bytes = 0;
+			std::chrono::steady_clock::duration elapsed{};
+		};
+
+		explicit cache_warmer(options opt)
+			: opt(opt), pool((std::max)(opt.threads, std::size_t(1)))
+		{
+		}
+
+		~cache_warmer()
+		{
+			stop();
+		}
+
+		/**
+		 * @brief Walk the webroot and read the files in the thread pool, it returns immediately.
+		 * @param filter - bool(std::string_view target), the target is the url path like "/assets/index.js".
+		 * @param on_file - void(std::string_view target, const std::filesystem::path& filepath, std::string content),
+		 *   it is called in the threads of the pool, so it must be thread safe.
+		 * @param on_finished - void(const result&), it is called in the thread of the pool.
+		 */
+		void start(std::filesystem::path webroot, auto filter, auto on_file, auto on_finished)
+		{
+			net::post(pool, [this, webroot = std::move(webroot), filter = std::move(filter),
+				on_file = std::move(on_file), on_finished = std::move(on_finished)]() mutable
+			{
+				auto begin = std::chrono::steady_clock::now();
+
+				std::shared_ptr<std::vector<file_info>> files = collect_files(webroot, filter);
+
+				std::shared_ptr<std::atomic<std::size_t>> remain =
+					std::make_shared<std::atomic<std::size_t>>(files->size() + 1);
+
+				auto finish = [this, begin, remain, on_finished]() mutable
+				{
+					if (remain->fetch_sub(1, std::memory_order_acq_rel) != 1)
+						return;
+
+					on_finished(result{
+						.files = files_read.load(std::memory_order_relaxed),
+						.bytes = bytes_read.load(std::memory_order_relaxed),
+						.elapsed = std::chrono::steady_clock::now() - begin,
+					});
+				};
+
+				for (std::size_t i = 0; i < files->size(); ++i)
+				{
+					net::post(pool, [this, files, i, on_file, finish]() mutable
+					{
+						file_info& f = (*files)[i];
+
+						if (!stopped.load(std::memory_order_relaxed))
+						{
+							std::string content;
+							if (read_file(f.filepath, content))
+							{
+								files_read.fetch_add(1, std::memory_order_relaxed);
+								bytes_read.fetch_add(content.size(), std::memory_order_relaxed);
+
+								on_file(std::string_view(f.target), f.filepath, std::move(content));
+							}
+						}
+
+						finish();
+					});
+				}
+
+				finish();
+			});
+		}
+
+		// the files which are being read are finished, the others are skipped.
+		void stop()
+		{
+			stopped.store(true, std::memory_order_relaxed);
+			pool.join();
+		}
+
+	protected:
+		struct file_info
+		{
+			std::string target;
+			std::filesystem::path filepath;
+		};
+
+		// the budget is counted by the file size, the files after it was used up are skipped.
+		std::shared_ptr<std::vector<file_info>> collect_files(const std::filesystem::path& webroot, auto& filter)
+		{
+			std::shared_ptr<std::vector<file_info>> files = std::make_shared<std::vector<file_info>>();
+
+			std::uint64_t total = 0;
+
+			std::error_code ec{};
+			for (auto it = std::filesystem::recursive_directory_iterator(webroot, ec);
+				!ec && it != std::filesystem::recursive_directory_iterator(); it.increment(ec))
+			{
+				if (stopped.load(std::memory_order_relaxed))
+					break;
+
+				if (!it->is_regular_file(ec) || ec)
+					continue;
+
+				std::uint64_t size = it->file_size(ec);
+				if (ec || size > opt.max_file_size || total + size > opt.max_size)
+					continue;
+
+				std::string target = "/" + it->path().lexically_relative(webroot).generic_string();
+
+				if (!is_plain_target(target) || !filter(std::string_view(target)))
+					continue;
+
+				total += size;
+
+				files->emplace_back(std::move(target), it->path());
+			}
+
+			return files;
+		}
+
+		// the targets which need the url encoding are skipped, they are not same as the cache key.
+		static bool is_plain_target(std::string_view target) noexcept
+		{
+			for (char c : target)
+			{
+				if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+					c == '/' || c == '-' || c == '_' || c == '.' || c == '~'))
+					return false;
+			}
+			return true;
+		}
+
+		static bool read_file(const std::filesystem::path& filepath, std::string& content)
+		{
+			std::ifstream file(filepath, std::ios::binary);
+			if (!file)
+				return false;
+
+			content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+			return !file.bad();
+		}
+
+		options opt;
+
+		net::thread_pool pool;
+
+		std::atomic<bool> stopped{ false };
+
+		std::atomic<std::size_t> files_read{ 0 };
+
+		std::atomic<std::uint64_t> bytes_read{ 0 };
+	};
+}
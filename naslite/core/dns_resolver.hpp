@@ -0,0 +1,800 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <random>
+#include <shared_mutex>
+#include <sstream>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+#include <vector>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/core/timer.hpp>
+#include <asio3/udp/core.hpp>
+#include <asio3/tcp/core.hpp>
+#include <asio3/tcp/connect.hpp>
+
+namespace nas
+{
+	struct dns_options
+	{
+		// the nameservers of the stub client, they are read from the resolv_conf if it is empty,
+		// the system resolver is used if there is none, like on windows.
+		std::vector<net::ip::udp::endpoint> nameservers;
+
+		std::filesystem::path resolv_conf = "/etc/resolv.conf";
+
+	#if ASIO3_OS_WINDOWS
+		std::filesystem::path hosts_file = "C:\\Windows\\System32\\drivers\\etc\\hosts";
+	#else
+		std::filesystem::path hosts_file = "/etc/hosts";
+	#endif
+
+		// the timeout of each query, and how many times each nameserver is tried.
+		std::chrono::steady_clock::duration timeout = std::chrono::seconds(2);
+		std::size_t attempts = 2;
+
+		// the ttl of the answer is used, but not longer than this.
+		std::chrono::seconds max_ttl = std::chrono::seconds(300);
+
+		// the names which are not existed are cached too, but not longer than this.
+		std::chrono::seconds negative_ttl = std::chrono::seconds(10);
+
+		// the answers of the system resolver have no ttl.
+		std::chrono::seconds system_ttl = std::chrono::seconds(30);
+
+		std::size_t max_entries = 4096;
+	};
+
+	/**
+	 * An asynchronous dns resolver which is shared by all the modules. The answers are cached by
+	 * their ttl, the names which are not existed are cached too. The concurrent requests of the
+	 * same name are coalesced into one query. The names in the hosts file are answered first.
+	 * The queries are sent by a udp stub client to the nameservers in the resolv.conf, no thread
+	 * is blocked by the getaddrinfo. The cache is read in the caller thread, the misses are
+	 * resolved in the thread of the resolver, so the pending queries need no lock.
+	 */
+	class dns_resolver : public noncopyable
+	{
+	public:
+		using result_type = std::tuple<net::error_code, std::vector<net::ip::address>>;
+
+		explicit dns_resolver(dns_options options = {}) : opts(std::move(options))
+		{
+			if (opts.nameservers.empty())
+				load_resolv_conf();
+
+			reload_hosts();
+		}
+
+		~dns_resolver()
+		{
+			pool.stop();
+			pool.join();
+		}
+
+		/**
+		 * @brief Resolve the host to the addresses, the ipv4 addresses are in front of the ipv6.
+		 *    The literal address is returned at once.
+		 * @return (error, addresses), the addresses are not empty if the error is success.
+		 */
+		net::awaitable<result_type> async_resolve(std::string_view host)
+		{
+			net::error_code ec{};
+
+			std::string_view literal = host;
+			if (literal.size() > 2 && literal.front() == '[' && literal.back() == ']')
+				literal = literal.substr(1, literal.size() - 2);
+
+			if (net::ip::address addr = net::ip::make_address(literal, ec); !ec)
+				co_return result_type{ net::error_code{}, { addr } };
+
+			std::string name = normalize(host);
+			if (name.empty())
+				co_return result_type{ net::error::host_not_found, {} };
+
+			check_hosts();
+
+			if (std::optional<result_type> r = find(name); r)
+				co_return std::move(*r);
+
+			auto [ep, result] = co_await net::co_spawn(pool.get_executor(),
+				join(std::move(name)), net::use_nothrow_awaitable);
+			if (ep)
+				co_return result_type{ net::error::operation_aborted, {} };
+
+			co_return result;
+		}
+
+		// remove all the cached answers.
+		void clear()
+		{
+			std::unique_lock g(mutex);
+			cache.clear();
+		}
+
+		inline const dns_options& options() const noexcept
+		{
+			return opts;
+		}
+
+	public:
+		/**
+		 * @brief Make the query message of rfc 1035 with the recursion desired.
+		 * @return The message, or empty if the name is invalid.
+		 */
+		static std::string make_query(std::uint16_t id, std::string_view name, std::uint16_t qtype)
+		{
+			std::string msg;
+			msg.reserve(12 + name.size() + 2 + 4);
+
+			auto put16 = [&msg](std::uint16_t v)
+			{
+				msg += char(v >> 8);
+				msg += char(v & 0xff);
+			};
+
+			put16(id);
+			put16(0x0100); // RD
+			put16(1);      // QDCOUNT
+			put16(0);
+			put16(0);
+			put16(0);
+
+			while (!name.empty())
+			{
+				std::string_view label = name.substr(0, name.find('.'));
+				if (label.empty() || label.size() > 63)
+					return {};
+
+				msg += char(label.size());
+				msg += label;
+
+				name.remove_prefix((std::min)(label.size() + 1, name.size()));
+			}
+
+			if (msg.size() > 12 + 255)
+				return {};
+
+			msg += char(0);
+
+			put16(qtype);
+			put16(1); // IN
+
+			return msg;
+		}
+
+		struct reply
+		{
+			std::uint8_t rcode = 0;
+			bool truncated = false;
+			std::vector<net::ip::address> addresses;
+			std::uint32_t ttl = UINT32_MAX;          // the min ttl of the answers
+			std::uint32_t negative_ttl = UINT32_MAX; // from the soa of the authority
+		};
+
+		/**
+		 * @brief Parse the reply message, the records of the qtype are collected, the cname
+		 *    records only limit the ttl, the recursive nameserver has followed them.
+		 * @param name - The normalized name of the query, the question of the reply must echo
+		 *    it and the qtype, otherwise it is the reply of another query.
+		 * @return The reply, or nullopt if it is malformed or isn't the reply of the query.
+		 */
+		static std::optional<reply> parse_reply(std::string_view msg, std::uint16_t id,
+			std::string_view name, std::uint16_t qtype)
+		{
+			const std::uint8_t* p = reinterpret_cast<const std::uint8_t*>(msg.data());
+			std::size_t size = msg.size();
+			std::size_t pos = 0;
+
+			auto get16 = [p](std::size_t i) { return std::uint16_t((p[i] << 8) | p[i + 1]); };
+			auto get32 = [p](std::size_t i) { return (std::uint32_t(p[i]) << 24) | (std::uint32_t(p[i + 1]) << 16) | (std::uint32_t(p[i + 2]) << 8) | p[i + 3]; };
+
+			// the compressed name ends at the pointer.
+			auto skip_name = [p, size, &pos]() -> bool
+			{
+				while (pos < size)
+				{
+					std::uint8_t len = p[pos];
+					if ((len & 0xc0) == 0xc0)
+					{
+						pos += 2;
+						return pos <= size;
+					}
+					if (len > 63)
+						return false;
+					pos += 1 + len;
+					if (len == 0)
+						return pos <= size;
+				}
+				return false;
+			};
+
+			if (size < 12 || get16(0) != id)
+				return std::nullopt;
+
+			std::uint16_t flags = get16(2);
+			if (!(flags & 0x8000))
+				return std::nullopt;
+
+			reply r{};
+			r.truncated = (flags & 0x0200) != 0;
+			r.rcode = std::uint8_t(flags & 0x000f);
+
+			std::uint16_t qdcount = get16(4), ancount = get16(6), nscount = get16(8);
+
+			if (qdcount != 1)
+				return std::nullopt;
+
+			pos = 12;
+
+			// the name of the question isn't compressed, it is compared case insensitively,
+			// because some nameservers echo the name with the case of their own.
+			std::string qname;
+
+			for (;;)
+			{
+				if (pos >= size)
+					return std::nullopt;
+
+				std::uint8_t len = p[pos++];
+				if (len == 0)
+					break;
+				if (len > 63 || pos + len > size)
+					return std::nullopt;
+
+				if (!qname.empty())
+					qname += '.';
+				qname.append(reinterpret_cast<const char*>(p + pos), len);
+
+				pos += len;
+			}
+
+			if (pos + 4 > size || get16(pos) != qtype || get16(pos + 2) != 1 || !net::iequals(qname, name))
+				return std::nullopt;
+
+			pos += 4;
+
+			for (std::uint32_t i = 0; i < std::uint32_t(ancount) + nscount; ++i)
+			{
+				if (!skip_name() || pos + 10 > size)
+					return std::nullopt;
+
+				std::uint16_t type = get16(pos), klass = get16(pos + 2), rdlen = get16(pos + 8);
+				std::uint32_t ttl = get32(pos + 4);
+
+				pos += 10;
+
+				if (pos + rdlen > size)
+					return std::nullopt;
+
+				if (i < ancount)
+				{
+					if (klass == 1 && type == qtype && type == 1 && rdlen == 4)
+					{
+						r.addresses.emplace_back(net::ip::address_v4(get32(pos)));
+						r.ttl = (std::min)(r.ttl, ttl);
+					}
+					else if (klass == 1 && type == qtype && type == 28 && rdlen == 16)
+					{
+						net::ip::address_v6::bytes_type bytes{};
+						std::copy_n(p + pos, 16, bytes.begin());
+						r.addresses.emplace_back(net::ip::address_v6(bytes));
+						r.ttl = (std::min)(r.ttl, ttl);
+					}
+					else if (type == 5)
+					{
+						r.ttl = (std::min)(r.ttl, ttl);
+					}
+				}
+				// the negative answer is cached by the min of the soa ttl and the soa minimum, rfc 2308.
+				else if (type == 6 && rdlen >= 20)
+				{
+					r.negative_ttl = (std::min)({ r.negative_ttl, ttl, get32(pos + rdlen - 4) });
+				}
+
+				pos += rdlen;
+			}
+
+			return r;
+		}
+
+	protected:
+		static constexpr std::uint16_t type_a = 1;
+		static constexpr std::uint16_t type_aaaa = 28;
+
+		static constexpr std::uint8_t rcode_nxdomain = 3;
+
+		struct entry
+		{
+			net::error_code ec;
+			std::vector<net::ip::address> addresses;
+			std::chrono::steady_clock::time_point expires;
+		};
+
+		struct pending
+		{
+			explicit pending(const net::any_io_executor& ex)
+				: notify(ex, net::steady_timer::time_point::max())
+			{
+			}
+
+			// it is canceled when the query is finished, all the waiters are woken up.
+			net::steady_timer notify;
+			bool finished = false;
+			result_type result;
+		};
+
+		// the host is case insensitive, and the root dot is removed.
+		static std::string normalize(std::string_view host)
+		{
+			if (host.ends_with('.'))
+				host.remove_suffix(1);
+
+			if (host.empty() || host.size() > 253)
+				return {};
+
+			std::string name(host);
+			std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return char(std::tolower(c)); });
+			return name;
+		}
+
+		std::optional<result_type> find(const std::string& name)
+		{
+			std::shared_lock g(mutex);
+
+			if (auto it = hosts.find(name); it != hosts.end())
+				return result_type{ net::error_code{}, it->second };
+
+			if (auto it = cache.find(name); it != cache.end() && std::chrono::steady_clock::now() < it->second.expires)
+				return result_type{ it->second.ec, it->second.addresses };
+
+			return std::nullopt;
+		}
+
+		void store(const std::string& name, const result_type& result, std::chrono::steady_clock::duration ttl)
+		{
+			auto now = std::chrono::steady_clock::now();
+
+			std::unique_lock g(mutex);
+
+			if (cache.size() >= opts.max_entries)
+			{
+				std::erase_if(cache, [now](const auto& pair) { return pair.second.expires <= now; });
+
+				// all are alive, some of them are evicted, there is no order to find the oldest.
+				for (auto it = cache.begin(); it != cache.end() && cache.size() >= opts.max_entries - opts.max_entries / 8;)
+					it = cache.erase(it);
+			}
+
+			cache[name] = entry{ std::get<0>(result), std::get<1>(result), now + ttl };
+		}
+
+		// it is called in the thread of the resolver.
+		net::awaitable<result_type> join(std::string name)
+		{
+			// the answer may be stored while this request was dispatched.
+			if (std::optional<result_type> r = find(name); r)
+				co_return std::move(*r);
+
+			std::shared_ptr<pending> pd;
+
+			if (auto it = pendings.find(name); it != pendings.end())
+			{
+				pd = it->second;
+			}
+			else
+			{
+				pd = std::make_shared<pending>(pool.get_executor());
+				pendings.emplace(name, pd);
+
+				// the query isn't canceled with any of the waiters.
+				net::co_spawn(pool.get_executor(), query(std::move(name), pd), net::detached);
+			}
+
+			while (!pd->finished)
+			{
+				co_await pd->notify.async_wait(net::use_nothrow_awaitable);
+
+				// this waiter was canceled.
+				if (!pd->finished)
+					co_return result_type{ net::error::operation_aborted, {} };
+			}
+
+			co_return pd->result;
+		}
+
+		net::awaitable<void> query(std::string name, std::shared_ptr<pending> pd)
+		{
+			std::chrono::steady_clock::duration ttl{};
+
+			std::optional<result_type> result = co_await query_nameservers(name, ttl);
+
+			if (!result)
+				result = co_await query_system(name, ttl);
+
+			if (ttl > std::chrono::steady_clock::duration::zero())
+				store(name, *result, ttl);
+
+			pd->result = std::move(*result);
+			pd->finished = true;
+			pd->notify.cancel();
+
+			pendings.erase(name);
+		}
+
+		/**
+		 * @brief Query the A and the AAAA records at the same time, the nameservers are tried in
+		 *    order until one of them answered.
+		 * @return The result, or nullopt if the system resolver should be used, e.g. none of
+		 *    the nameservers answered before the timeout.
+		 */
+		net::awaitable<std::optional<result_type>> query_nameservers(const std::string& name, std::chrono::steady_clock::duration& ttl)
+		{
+			if (opts.nameservers.empty())
+				co_return std::nullopt;
+
+			// the ids are drawn independently, a spoofed reply must guess each of them.
+			std::uint16_t id_a = std::uint16_t(random()), id_aaaa = std::uint16_t(random());
+			while (id_aaaa == id_a)
+				id_aaaa = std::uint16_t(random());
+
+			std::string query_a = make_query(id_a, name, type_a);
+			std::string query_aaaa = make_query(id_aaaa, name, type_aaaa);
+			if (query_a.empty() || query_aaaa.empty())
+			{
+				ttl = opts.negative_ttl;
+				co_return result_type{ net::error::host_not_found, {} };
+			}
+
+			std::array<char, 1500> buf;
+
+			net::error_code last_error = net::error::timed_out;
+
+			bool answered = false;
+
+			for (std::size_t attempt = 0; attempt < (std::max)(opts.attempts, std::size_t(1)); ++attempt)
+			{
+				for (const net::ip::udp::endpoint& server : opts.nameservers)
+				{
+					net::ip::udp::socket sock(co_await net::this_coro::executor);
+
+					net::error_code ec{};
+					sock.open(server.protocol(), ec);
+					if (!ec)
+						sock.connect(server, ec);
+					if (ec)
+					{
+						last_error = ec;
+						continue;
+					}
+
+					auto [e2, n2] = co_await sock.async_send(net::buffer(query_a), net::use_nothrow_awaitable);
+					auto [e3, n3] = co_await sock.async_send(net::buffer(query_aaaa), net::use_nothrow_awaitable);
+					if (e2 || e3)
+					{
+						last_error = e2 ? e2 : e3;
+						continue;
+					}
+
+					std::optional<reply> reply_a, reply_aaaa;
+
+					auto deadline = std::chrono::steady_clock::now() + opts.timeout;
+
+					while (!(reply_a && reply_aaaa))
+					{
+						auto now = std::chrono::steady_clock::now();
+						if (now >= deadline)
+							break;
+
+						auto r = co_await(
+							sock.async_receive(net::buffer(buf), net::use_nothrow_awaitable) ||
+							net::timeout(deadline - now));
+						if (net::is_timeout(r))
+							break;
+
+						auto [e1, n1] = std::get<0>(r);
+						if (e1)
+						{
+							// like the icmp port unreachable, this nameserver can't be used.
+							last_error = e1;
+							break;
+						}
+
+						std::string_view msg(buf.data(), n1);
+
+						if (!reply_a)
+							reply_a = parse_reply(msg, id_a, name, type_a);
+						if (!reply_aaaa)
+							reply_aaaa = parse_reply(msg, id_aaaa, name, type_aaaa);
+					}
+
+					if ((reply_a && reply_a->truncated) || (reply_aaaa && reply_aaaa->truncated))
+						co_return std::nullopt;
+
+					std::vector<net::ip::address> addresses;
+					std::uint32_t answer_ttl = UINT32_MAX;
+
+					for (std::optional<reply>* r : { &reply_a, &reply_aaaa })
+					{
+						if (*r && (*r)->rcode == 0 && !(*r)->addresses.empty())
+						{
+							addresses.insert(addresses.end(), (*r)->addresses.begin(), (*r)->addresses.end());
+							answer_ttl = (std::min)(answer_ttl, (*r)->ttl);
+						}
+					}
+
+					// one of the types may be lost, the other is used.
+					if (!addresses.empty())
+					{
+						ttl = (std::min)(std::chrono::steady_clock::duration(std::chrono::seconds(answer_ttl)),
+							std::chrono::steady_clock::duration(opts.max_ttl));
+						co_return result_type{ net::error_code{}, std::move(addresses) };
+					}
+
+					// the name isn't existed, or it has no address, the answer is definite.
+					auto is_negative = [](const std::optional<reply>& r)
+					{
+						return r && (r->rcode == rcode_nxdomain || (r->rcode == 0 && r->addresses.empty()));
+					};
+
+					if (is_negative(reply_a) && is_negative(reply_aaaa))
+					{
+						std::uint32_t negative_ttl = (std::min)(reply_a->negative_ttl, reply_aaaa->negative_ttl);
+						ttl = (std::min)(std::chrono::steady_clock::duration(std::chrono::seconds(negative_ttl)),
+							std::chrono::steady_clock::duration(opts.negative_ttl));
+						co_return result_type{ net::error::host_not_found, {} };
+					}
+
+					// the server failure or the refused, the next nameserver is tried.
+					if (reply_a || reply_aaaa)
+					{
+						answered = true;
+						last_error = net::error::host_not_found_try_again;
+					}
+				}
+			}
+
+			// all the nameservers are unreachable or silent, the system resolver may still work.
+			if (!answered)
+				co_return std::nullopt;
+
+			// the failure isn't cached, the next request queries again.
+			ttl = {};
+			co_return result_type{ last_error, {} };
+		}
+
+		net::awaitable<result_type> query_system(const std::string& name, std::chrono::steady_clock::duration& ttl)
+		{
+			net::ip::tcp::resolver resolver(co_await net::this_coro::executor);
+
+			auto [e1, eps] = co_await resolver.async_resolve(name, "", net::use_nothrow_awaitable);
+			if (e1)
+			{
+				ttl = (e1 == net::error::host_not_found ? std::chrono::steady_clock::duration(opts.negative_ttl) :
+					std::chrono::steady_clock::duration::zero());
+				co_return result_type{ e1, {} };
+			}
+
+			std::vector<net::ip::address> addresses;
+
+			for (auto& e : eps)
+			{
+				if (std::find(addresses.begin(), addresses.end(), e.endpoint().address()) == addresses.end())
+					addresses.emplace_back(e.endpoint().address());
+			}
+
+			std::stable_partition(addresses.begin(), addresses.end(), [](const net::ip::address& a) { return a.is_v4(); });
+
+			ttl = (std::min)(opts.system_ttl, opts.max_ttl);
+
+			co_return result_type{ net::error_code{}, std::move(addresses) };
+		}
+
+		// only the nameserver and the timeout, attempts options are used.
+		void load_resolv_conf()
+		{
+			std::ifstream file(opts.resolv_conf);
+			std::string line;
+
+			while (std::getline(file, line))
+			{
+				std::istringstream words(line.substr(0, line.find_first_of("#;")));
+				std::string key, value;
+
+				if (!(words >> key))
+					continue;
+
+				if (key == "nameserver" && (words >> value))
+				{
+					net::error_code ec{};
+					net::ip::address addr = net::ip::make_address(value, ec);
+					// the max count of the nameservers is 3 like the glibc.
+					if (!ec && opts.nameservers.size() < 3)
+						opts.nameservers.emplace_back(addr, std::uint16_t(53));
+				}
+				else if (key == "options")
+				{
+					while (words >> value)
+					{
+						if (value.starts_with("timeout:"))
+							opts.timeout = std::chrono::seconds((std::max)(std::atoi(value.c_str() + 8), 1));
+						else if (value.starts_with("attempts:"))
+							opts.attempts = std::size_t((std::max)(std::atoi(value.c_str() + 9), 1));
+					}
+				}
+			}
+		}
+
+		// the hosts file is checked in the thread of the resolver at most once every 5 seconds.
+		void check_hosts()
+		{
+			std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+			std::int64_t next = hosts_check_time.load(std::memory_order_relaxed);
+
+			if (now < next)
+				return;
+
+			std::int64_t after = (std::chrono::steady_clock::now() + std::chrono::seconds(5)).time_since_epoch().count();
+			if (hosts_check_time.compare_exchange_strong(next, after, std::memory_order_relaxed))
+				net::post(pool, [this]() { reload_hosts(); });
+		}
+
+		void reload_hosts()
+		{
+			std::error_code ec{};
+			std::filesystem::file_time_type mtime = std::filesystem::last_write_time(opts.hosts_file, ec);
+			if (ec || mtime == hosts_mtime)
+				return;
+
+			std::unordered_map<std::string, std::vector<net::ip::address>> table;
+
+			std::ifstream file(opts.hosts_file);
+			std::string line;
+
+			while (std::getline(file, line))
+			{
+				std::istringstream words(line.substr(0, line.find('#')));
+				std::string value;
+
+				if (!(words >> value))
+					continue;
+
+				net::error_code e1{};
+				net::ip::address addr = net::ip::make_address(value, e1);
+				if (e1)
+					continue;
+
+				while (words >> value)
+				{
+					std::vector<net::ip::address>& addrs = table[normalize(value)];
+					if (std::find(addrs.begin(), addrs.end(), addr) == addrs.end())
+						addrs.emplace_back(addr);
+				}
+			}
+
+			for (auto& [name, addrs] : table)
+			{
+				std::stable_partition(addrs.begin(), addrs.end(), [](const net::ip::address& a) { return a.is_v4(); });
+			}
+
+			hosts_mtime = mtime;
+
+			std::unique_lock g(mutex);
+			hosts = std::move(table);
+		}
+
+		dns_options opts;
+
+		// the hosts and the cache are read by all the threads.
+		std::shared_mutex mutex;
+
+		std::unordered_map<std::string, std::vector<net::ip::address>> hosts;
+
+		std::unordered_map<std::string, entry> cache;
+
+		std::atomic<std::int64_t> hosts_check_time{ 0 };
+
+		// only used in the thread of the resolver.
+		std::filesystem::file_time_type hosts_mtime{};
+
+		std::unordered_map<std::string, std::shared_ptr<pending>> pendings;
+
+		std::mt19937 random{ std::random_device{}() };
+
+		// it must be destroyed first, the coroutines in it use the members above.
+		net::thread_pool pool{ 1 };
+	};
+
+	/**
+	 * @brief Parse the nameserver of the config, like "8.8.8.8", "127.0.0.1:5353" or "[::1]:53".
+	 * @return The endpoint, the port is 53 if it isn't given, or nullopt if it is invalid.
+	 */
+	inline std::optional<net::ip::udp::endpoint> parse_dns_nameserver(std::string_view value)
+	{
+		net::error_code ec{};
+		std::string_view host = value, port = "53";
+
+		if (host.starts_with('['))
+		{
+			std::size_t end = host.find(']');
+			if (end == std::string_view::npos)
+				return std::nullopt;
+			if (end + 1 < host.size())
+			{
+				if (host[end + 1] != ':')
+					return std::nullopt;
+				port = host.substr(end + 2);
+			}
+			host = host.substr(1, end - 1);
+		}
+		else if (std::size_t colon = host.find(':'); colon != std::string_view::npos && host.rfind(':') == colon)
+		{
+			port = host.substr(colon + 1);
+			host = host.substr(0, colon);
+		}
+
+		net::ip::address addr = net::ip::make_address(host, ec);
+		if (ec || port.empty() || port.size() > 5 || !std::all_of(port.begin(), port.end(), ::isdigit))
+			return std::nullopt;
+
+		unsigned long n = std::stoul(std::string(port));
+		if (n == 0 || n > 65535)
+			return std::nullopt;
+
+		return net::ip::udp::endpoint(addr, std::uint16_t(n));
+	}
+
+	// the options of the shared resolver, they must be set before the resolver is used at the
+	// first time, e.g. the nameservers of the config, the later changes are not used.
+	inline dns_options& default_dns_options()
+	{
+		static dns_options options;
+		return options;
+	}
+
+	// the resolver shared by all the modules.
+	inline dns_resolver& default_dns_resolver()
+	{
+		static dns_resolver resolver(default_dns_options());
+		return resolver;
+	}
+
+	/**
+	 * @brief Connect the socket to the host which is resolved by the shared resolver, the
+	 *    addresses are raced by the happy_eyeballs_connect, so a blackholed ipv6 address only
+	 *    delays the connect by the attempt delay.
+	 * @return The error of the last failed address, or timed_out if the connect timeout elapsed.
+	 */
+	inline net::awaitable<net::error_code> async_connect_host(
+		net::tcp_socket& sock, std::string_view host, std::uint16_t port,
+		std::chrono::steady_clock::duration attempt_delay = net::tcp_connect_attempt_delay,
+		std::chrono::steady_clock::duration connect_timeout = net::tcp_connect_timeout)
+	{
+		auto [e1, addrs] = co_await default_dns_resolver().async_resolve(host);
+		if (e1)
+			co_return e1;
+
+		std::vector<net::ip::tcp::endpoint> endpoints{};
+		for (const net::ip::address& addr : addrs)
+			endpoints.emplace_back(addr, port);
+
+		auto [e2, ep] = co_await net::happy_eyeballs_connect(sock, std::move(endpoints), attempt_delay, connect_timeout);
+		co_return e2;
+	}
+}
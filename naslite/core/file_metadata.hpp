@@ -0,0 +1,466 @@
+#pragma once
+
+#include <chrono>
+#include <filesystem>
+#include <list>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+#include "net.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/core/strutil.hpp>
+#include <asio3/http/core.hpp>
+#include <asio3/http/mime_types.hpp>
+
+#if ASIO3_OS_LINUX
+#include <fcntl.h>
+#include <sys/stat.h>
+#endif
+
+namespace nas
+{
+	// the IMF-fixdate of rfc 9110, like: Sun, 06 Nov 1994 08:49:37 GMT
+	inline std::string format_http_date(std::chrono::system_clock::time_point t)
+	{
+		static constexpr std::string_view weekdays[] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+		static constexpr std::string_view months[] = {
+			"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+		auto days = std::chrono::floor<std::chrono::days>(t);
+		std::chrono::year_month_day ymd{ days };
+		std::chrono::weekday wd{ days };
+		std::chrono::hh_mm_ss hms{ std::chrono::floor<std::chrono::seconds>(t - days) };
+
+		auto two_digits = [](std::string& s, long long v) mutable
+		{
+			s += char('0' + (v / 10) % 10);
+			s += char('0' + v % 10);
+		};
+
+		std::string s;
+		s.reserve(29);
+		s += weekdays[wd.c_encoding()];
+		s += ", ";
+		two_digits(s, unsigned(ymd.day()));
+		s += ' ';
+		s += months[unsigned(ymd.month()) - 1];
+		s += ' ';
+		s += std::to_string(int(ymd.year()));
+		s += ' ';
+		two_digits(s, hms.hours().count());
+		s += ':';
+		two_digits(s, hms.minutes().count());
+		s += ':';
+		two_digits(s, hms.seconds().count());
+		s += " GMT";
+		return s;
+	}
+
+	// the identity of the file, it is changed when the file is replaced, resized or modified.
+	struct file_status
+	{
+		std::uint64_t inode = 0;
+		std::uint64_t size = 0;
+		std::chrono::system_clock::time_point mtime{};
+
+		bool operator==(const file_status&) const = default;
+	};
+
+	/**
+	 * The validators of a regular file, the etag is strong, it is changed when the file is
+	 * replaced, resized or modified.
+	 * The precompressed siblings like "index.js.gz" and "index.js.br" are checked at the same
+	 * time, so the content coding is selected without any filesystem syscall.
+	 * The resolved path, the mime type and the opened file are kept too, so a cached file is
+	 * sent without resolving the path or opening the file again.
+	 */
+	struct file_metadata
+	{
+		std::uint64_t size = 0;
+		std::string   etag;
+		std::string   last_modified;
+		bool          compressible = false; // the text like types, it is gzipped on the fly
+		bool          has_gzip_file = false;
+		bool          has_br_file = false;
+
+		file_status   status;
+		std::filesystem::path filepath; // canonical
+		std::string   mimetype;
+
+		// it is only read at an offset, so it can be shared by the sessions, it is closed when
+		// the last session which is sending it released it. only opened on linux.
+		std::shared_ptr<beast::file> file;
+
+		inline bool has_encodings() const noexcept
+		{
+			return compressible || has_gzip_file || has_br_file;
+		}
+	};
+
+	// the images, videos and archives are compressed already.
+	inline bool is_compressible_mimetype(std::string_view mimetype) noexcept
+	{
+		return mimetype.starts_with("text/") ||
+			mimetype == "application/javascript" || mimetype == "application/json" ||
+			mimetype == "application/xml" || mimetype == "application/wasm" ||
+			mimetype == "image/svg+xml" || mimetype == "image/x-icon";
+	}
+
+	// the representations of each coding are different, so the etags must be different too.
+	inline std::string make_variant_etag(std::string_view etag, std::string_view coding)
+	{
+		if (coding.empty() || etag.size() < 2)
+			return std::string(etag);
+
+		std::string s(etag.substr(0, etag.size() - 1));
+		s += '-';
+		s += coding;
+		s += '"';
+		return s;
+	}
+
+	inline void append_hex(std::string& s, std::uint64_t v)
+	{
+		char buf[16];
+		std::size_t n = 0;
+		do
+		{
+			buf[n++] = "0123456789abcdef"[v & 0xf];
+			v >>= 4;
+		} while (v);
+		while (n)
+			s += buf[--n];
+	}
+
+	// the path of the request target, the query and the fragment don't select another file.
+	inline std::string_view target_path(std::string_view target) noexcept
+	{
+		return target.substr(0, target.find_first_of("?#"));
+	}
+
+	/**
+	 * @brief Resolve the file path of the request target, the webroot must be canonical already,
+	 *    it is canonicalized once when the server is inited, so only the joined path is resolved.
+	 * @return The canonical path, or empty if it isn't existed or it is outside the webroot.
+	 */
+	inline std::filesystem::path resolve_filepath(const std::filesystem::path& webroot, std::string_view target)
+	{
+		std::error_code ec{};
+		std::filesystem::path filepath = webroot;
+		filepath += std::filesystem::path(target_path(target));
+
+		filepath = std::filesystem::canonical(filepath, ec);
+
+		if (ec || !net::is_subpath_of(webroot, filepath))
+			return {};
+
+		return filepath;
+	}
+
+	/**
+	 * @brief Get the status of the regular file.
+	 * @param fd - The opened file, it is used instead of the path if it is valid.
+	 */
+	inline std::optional<file_status> get_file_status(const std::filesystem::path& filepath, int fd = -1)
+	{
+		file_status status{};
+
+	#if ASIO3_OS_LINUX
+		struct stat st{};
+		int r = fd >= 0 ? ::fstat(fd, std::addressof(st)) : ::stat(filepath.c_str(), std::addressof(st));
+		if (r != 0 || !S_ISREG(st.st_mode))
+			return std::nullopt;
+
+		status.inode = std::uint64_t(st.st_ino);
+		status.size = std::uint64_t(st.st_size);
+		status.mtime = std::chrono::system_clock::time_point(std::chrono::duration_cast<std::chrono::system_clock::duration>(
+			std::chrono::seconds(st.st_mtim.tv_sec) + std::chrono::nanoseconds(st.st_mtim.tv_nsec)));
+	#else
+		std::ignore = fd;
+
+		std::error_code ec{};
+		if (!std::filesystem::is_regular_file(filepath, ec) || ec)
+			return std::nullopt;
+
+		status.size = std::filesystem::file_size(filepath, ec);
+		if (ec)
+			return std::nullopt;
+
+		auto t = std::filesystem::last_write_time(filepath, ec);
+		if (ec)
+			return std::nullopt;
+
+		status.mtime = std::chrono::file_clock::to_sys(t);
+	#endif
+
+		return status;
+	}
+
+	/**
+	 * @brief Read the metadata of the file.
+	 * @param keep_open - Keep the file opened in the metadata, it is only opened on linux, the
+	 *    status is read from the opened file, so it is the same file which would be sent.
+	 * @return The metadata, or nullopt if the file isn't existed or it isn't a regular file.
+	 */
+	inline std::optional<file_metadata> load_file_metadata(const std::filesystem::path& filepath, bool keep_open = false)
+	{
+		file_metadata meta{};
+
+	#if ASIO3_OS_LINUX
+		if (keep_open)
+		{
+			int fd = ::open(filepath.c_str(), O_RDONLY | O_CLOEXEC);
+			if (fd < 0)
+				return std::nullopt;
+
+			meta.file = std::make_shared<beast::file>();
+			meta.file->native_handle(fd);
+		}
+	#else
+		std::ignore = keep_open;
+	#endif
+
+		std::optional<file_status> status = get_file_status(filepath, meta.file ? meta.file->native_handle() : -1);
+		if (!status)
+			return std::nullopt;
+
+		meta.status = *status;
+		meta.size = status->size;
+		meta.last_modified = format_http_date(status->mtime);
+		meta.filepath = filepath;
+		meta.mimetype = http::extension_to_mimetype(filepath.extension().string());
+		meta.compressible = is_compressible_mimetype(meta.mimetype);
+
+		std::error_code ec{};
+		std::filesystem::path sibling = filepath;
+		sibling += ".gz";
+		meta.has_gzip_file = std::filesystem::is_regular_file(sibling, ec);
+		sibling.replace_extension(".br");
+		meta.has_br_file = std::filesystem::is_regular_file(sibling, ec);
+
+		meta.etag += '"';
+		if (status->inode)
+		{
+			append_hex(meta.etag, status->inode);
+			meta.etag += '-';
+		}
+		append_hex(meta.etag, status->size);
+		meta.etag += '-';
+		append_hex(meta.etag, std::uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(
+			status->mtime.time_since_epoch()).count()));
+		meta.etag += '"';
+
+		return meta;
+	}
+
+	/**
+	 * The metadata and the opened files by the path of the request target, each worker thread has its own
+	 * cache, so it never locks. An entry is trusted in the valid duration, then the file is
+	 * checked again by its resolved path, the path isn't resolved again and the file is kept
+	 * opened if it isn't changed, so a conditional request or a sent file costs no filesystem
+	 * syscall in most time.
+	 * The metadata is shared, it is still valid after the entry was erased by the other session
+	 * of the same thread while it is being sent.
+	 * Every entry holds an opened file on linux, so the count is bounded by the max count, the
+	 * least recently used entry is evicted when it is full.
+	 */
+	class file_metadata_cache
+	{
+	public:
+		struct options
+		{
+			std::chrono::steady_clock::duration valid = std::chrono::seconds(5);
+			std::size_t max_count = 1024;
+		};
+
+		file_metadata_cache() : file_metadata_cache(options{})
+		{
+		}
+
+		explicit file_metadata_cache(options opt) : opt(opt)
+		{
+		}
+
+		// the keys of the map point into the lru list, the moved list keeps its nodes.
+		file_metadata_cache(const file_metadata_cache&) = delete;
+		file_metadata_cache& operator=(const file_metadata_cache&) = delete;
+		file_metadata_cache(file_metadata_cache&&) = default;
+		file_metadata_cache& operator=(file_metadata_cache&&) = default;
+
+		using metadata_ptr = std::shared_ptr<const file_metadata>;
+
+		metadata_ptr find(std::string_view path, std::chrono::steady_clock::time_point now) const noexcept
+		{
+			if (auto it = map.find(path); it != map.end() && now < it->second->expires)
+				return it->second->meta;
+
+			return nullptr;
+		}
+
+		/**
+		 * @brief Find the metadata, or load it if it isn't cached or it was expired.
+		 * @param path - The path of the request target without the query, see target_path().
+		 * @param resolve - std::filesystem::path(), resolve the file path of the target, it is
+		 *    only called if the target isn't cached or the file was changed, the empty path
+		 *    means it isn't existed.
+		 */
+		metadata_ptr load(std::string_view path, std::chrono::steady_clock::time_point now, auto resolve)
+		{
+			if (auto it = map.find(path); it != map.end())
+			{
+				auto pos = it->second;
+
+				// move to the front of the lru list, no allocation.
+				lru.splice(lru.begin(), lru, pos);
+
+				if (now < pos->expires)
+					return pos->meta;
+
+				// the file of the same path was not changed, the opened file is still the same one.
+				if (auto status = get_file_status(pos->meta->filepath); status && *status == pos->meta->status)
+				{
+					pos->expires = now + opt.valid;
+					return pos->meta;
+				}
+
+				// the file was changed or replaced, the path is resolved again, because a directory
+				// of the old path may be a symlink to the outside of the webroot now.
+				erase(it);
+			}
+
+			std::filesystem::path filepath = resolve();
+			if (filepath.empty())
+				return nullptr;
+
+			std::optional<file_metadata> m = load_file_metadata(filepath, true);
+			if (!m)
+				return nullptr;
+
+			return add(path, std::move(*m), now);
+		}
+
+		metadata_ptr add(std::string_view path, file_metadata meta, std::chrono::steady_clock::time_point now)
+		{
+			if (auto it = map.find(path); it != map.end())
+				erase(it);
+
+			// only the least recently used one is evicted, the others are still valid.
+			if (!lru.empty() && map.size() >= opt.max_count)
+				erase(map.find(std::string_view(lru.back().path)));
+
+			lru.emplace_front(std::string(path), std::make_shared<const file_metadata>(std::move(meta)),
+				now + opt.valid);
+			map.emplace(std::string_view(lru.front().path), lru.begin());
+
+			return lru.front().meta;
+		}
+
+		void erase_if(auto pred)
+		{
+			for (auto it = map.begin(); it != map.end();)
+			{
+				if (pred(it->first))
+					it = erase(it);
+				else
+					++it;
+			}
+		}
+
+		void clear() noexcept
+		{
+			map.clear();
+			lru.clear();
+		}
+
+	protected:
+		struct entry
+		{
+			std::string path;
+			metadata_ptr meta;
+			std::chrono::steady_clock::time_point expires;
+		};
+
+		// the keys of the map point into the paths of the lru list entries.
+		using map_type = std::unordered_map<std::string_view, std::list<entry>::iterator>;
+
+		map_type::iterator erase(map_type::iterator it)
+		{
+			auto pos = it->second;
+			it = map.erase(it);
+			lru.erase(pos);
+			return it;
+		}
+
+		options opt;
+
+		std::list<entry> lru;
+
+		map_type map;
+	};
+
+	// the "If-None-Match" is compared weakly, the "If-Modified-Since" must be same as the sent one.
+	// the coding is the content coding of the response which would be sent.
+	inline bool is_not_modified(http::web_request& req, const file_metadata& meta, std::string_view coding = {})
+	{
+		if (auto it = req.find(http::field::if_none_match); it != req.end())
+		{
+			std::string_view value = it->value();
+
+			net::trim_both(value);
+
+			if (value == "*")
+				return true;
+
+			std::string etag = make_variant_etag(meta.etag, coding);
+
+			for (std::string_view tag : net::split(value, ","))
+			{
+				net::trim_both(tag);
+
+				if (tag.starts_with("W/"))
+					tag.remove_prefix(2);
+
+				if (tag == etag)
+					return true;
+			}
+
+			return false;
+		}
+
+		if (auto it = req.find(http::field::if_modified_since); it != req.end())
+		{
+			return it->value() == meta.last_modified;
+		}
+
+		return false;
+	}
+
+	// the "If-Range" must be the strong etag or the last modified time which was sent before.
+	inline bool is_if_range_matched(http::web_request& req, const file_metadata& meta)
+	{
+		auto it = req.find(http::field::if_range);
+		if (it == req.end())
+			return true;
+
+		std::string_view value = it->value();
+
+		net::trim_both(value);
+
+		return value == meta.etag || value == meta.last_modified;
+	}
+
+	inline void set_file_validators(auto& res, const file_metadata& meta, std::string_view cache_control,
+		std::string_view coding = {})
+	{
+		res.set(http::field::etag, make_variant_etag(meta.etag, coding));
+		res.set(http::field::last_modified, meta.last_modified);
+		if (!cache_control.empty())
+			res.set(http::field::cache_control, cache_control);
+		if (meta.has_encodings())
+			res.set(http::field::vary, "Accept-Encoding");
+	}
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <string_view>
+#include <tuple>
+
+#include "net.hpp"
+#include "metrics.hpp"
+#include "file_metadata.hpp"
+#include "file_sender.hpp"
+#include "http_compress.hpp"
+#include "response_cache.hpp"
+
+#include <asio3/http/core.hpp>
+
+namespace nas
+{
+	// how a request is served from the webroot, each server classifies the targets by its routes.
+	struct file_target
+	{
+		bool file = false;       // it is a file of the webroot, its metadata is loaded
+		bool streamable = false; // the large file and the range request are streamed from the file
+		bool cacheable = false;  // the response and the encoded responses are cached
+		std::string_view cache_control;
+	};
+
+	// the caches and the metrics which are used by the requests of a server thread.
+	struct file_responder
+	{
+		file_metadata_cache& metadata; // only used in the thread of the request
+		response_cache&      cache;
+		http_server_metrics& metrics;
+		std::uint64_t        max_file_size; // the larger files are streamed, they are never cached
+	};
+
+	/**
+	 * @brief Serve a request of the files of the webroot, the same steps of all the servers:
+	 *    the 304 is answered from the metadata cache, the large files and the range requests
+	 *    are streamed from the opened file, then the cached response of the content coding is
+	 *    sent, or the encoded response is made and cached, the others are routed, and the 200
+	 *    response of the cacheable target is cached.
+	 * @param target - The class of the request.
+	 * @param resolve - std::filesystem::path(), the file path of the target, it is only called
+	 *    if the metadata isn't cached, the empty path means it isn't existed.
+	 * @param make_response - response(const std::filesystem::path& filepath, std::string content),
+	 *    the identity response of the file, same as the router's, it is called in the compression pool.
+	 * @param route - net::awaitable<bool>(http::web_response& rep), route the request by the router.
+	 * @return False if the connection should be closed.
+	 */
+	net::awaitable<bool> async_serve_file_request(
+		auto& stream, http::web_request& req, file_responder ctx, file_target target,
+		auto resolve, auto make_response, auto route)
+	{
+		auto begin = std::chrono::steady_clock::now();
+
+		// the caches are keyed by the path, so the query string doesn't make new entries.
+		std::string_view path = target_path(req.target());
+
+		file_metadata_cache::metadata_ptr meta;
+		std::string_view coding;
+
+		if (target.file)
+		{
+			meta = ctx.metadata.load(path, begin, resolve);
+
+			if (meta)
+			{
+				std::tuple<net::error_code, std::size_t, unsigned> sent{};
+
+				coding = select_content_coding(req, *meta);
+
+				if /**/ (is_not_modified(req, *meta, coding))
+				{
+					sent = co_await async_send_not_modified(stream, req, *meta, target.cache_control, coding);
+				}
+				else if (target.streamable && (req.count(http::field::range) || meta->size > ctx.max_file_size))
+				{
+					sent = co_await async_send_file_response(stream, req, meta->filepath, *meta, target.cache_control);
+				}
+
+				if (auto [e1, n1, status1] = sent; status1 != 0)
+				{
+					count_request(ctx.metrics, status1, n1, std::chrono::steady_clock::now() - begin);
+
+					co_return !e1 && req.keep_alive();
+				}
+			}
+		}
+
+		// the encoded responses are cached with the variant key.
+		std::string variant_key;
+		std::string_view key = path;
+
+		if (!coding.empty())
+		{
+			variant_key = make_variant_key(path, coding);
+			key = variant_key;
+		}
+
+		// the cached response is kept alive by this pointer until it was sent, even if
+		// it was evicted or the cache was cleared by the other session in the meantime.
+		response_cache::response_ptr cached;
+
+		if (target.cacheable)
+		{
+			cached = ctx.cache.find(key);
+
+			(cached ? ctx.metrics.cache_hits : ctx.metrics.cache_misses).add();
+		}
+
+		// the encoded response is made in the compression pool only once, then it is cached.
+		if (!cached && !coding.empty() && target.cacheable)
+		{
+			auto res = co_await async_make_encoded_response(meta->filepath, *meta, coding, make_response);
+			if (res)
+			{
+				cached = make_serialized_response(std::move(res.value()));
+
+				ctx.metrics.cache_evictions.add(ctx.cache.add(key, cached));
+			}
+		}
+
+		if (cached)
+		{
+			auto [e2, n2, status2] = co_await async_write_serialized_response(stream, req, *cached);
+
+			count_request(ctx.metrics, status2, n2, std::chrono::steady_clock::now() - begin);
+
+			co_return !e2 && req.keep_alive();
+		}
+
+		http::web_response rep;
+		bool result = co_await route(rep);
+
+		unsigned status = rep.get_response_header().result_int();
+
+		if (result && status == 200 && target.cacheable)
+		{
+			if (auto res = rep.to_string_body_response(); res.has_value())
+			{
+				ctx.metrics.cache_evictions.add(
+					ctx.cache.add(path, make_serialized_response(std::move(res.value()))));
+			}
+		}
+
+		// Send the response
+		auto [e3, n3] = co_await beast::async_write(stream, std::move(rep));
+
+		count_request(ctx.metrics, status, n3, std::chrono::steady_clock::now() - begin);
+
+		// the false result means the connection should be closed, usually because the
+		// response indicated the "Connection: close" semantic.
+		co_return !e3 && result && req.keep_alive();
+	}
+}
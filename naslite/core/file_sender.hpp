@@ -0,0 +1,409 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <filesystem>
+#include <random>
+#include <tuple>
+#include <type_traits>
+#include <vector>
+
+#include "net.hpp"
+#include "buffer_pool.hpp"
+#include "file_metadata.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/core/strutil.hpp>
+#include <asio3/tcp/core.hpp>
+#include <asio3/http/core.hpp>
+#include <asio3/http/make.hpp>
+#include <asio3/http/mime_types.hpp>
+
+#if ASIO3_OS_LINUX
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
+
+namespace nas
+{
+	struct byte_range
+	{
+		std::uint64_t offset = 0;
+		std::uint64_t length = 0;
+	};
+
+	// more ranges than this are ignored, the whole file is sent instead, it is allowed by rfc 9110.
+	inline constexpr std::size_t max_byte_ranges = 16;
+
+	/**
+	 * @brief Parse the "Range" header, only the "bytes" unit is supported.
+	 * @return The satisfiable ranges, it is empty if the header should be ignored, or nullopt
+	 *    if none of the ranges is satisfiable.
+	 */
+	inline std::optional<std::vector<byte_range>> parse_byte_ranges(std::string_view value, std::uint64_t size)
+	{
+		std::vector<byte_range> ranges;
+
+		net::trim_both(value);
+
+		if (!value.starts_with("bytes="))
+			return ranges;
+
+		value.remove_prefix(6);
+
+		bool has_valid = false;
+
+		for (std::string_view item : net::split(value, ","))
+		{
+			net::trim_both(item);
+
+			std::size_t dash = item.find('-');
+			if (dash == std::string_view::npos)
+				return std::vector<byte_range>{};
+
+			std::string_view first = item.substr(0, dash), last = item.substr(dash + 1);
+
+			std::uint64_t begin = 0, end = 0;
+
+			auto to_uint = [](std::string_view s, std::uint64_t& v) noexcept
+			{
+				auto [ptr, ec] = std::from_chars(s.data(), s.data() + s.size(), v);
+				return ec == std::errc{} && ptr == s.data() + s.size() && !s.empty();
+			};
+
+			if (first.empty())
+			{
+				// the suffix range: the last n bytes.
+				std::uint64_t n = 0;
+				if (!to_uint(last, n))
+					return std::vector<byte_range>{};
+				if (n == 0 || size == 0)
+					continue;
+				begin = size - (std::min)(n, size);
+				end = size - 1;
+			}
+			else
+			{
+				if (!to_uint(first, begin))
+					return std::vector<byte_range>{};
+				if (last.empty())
+					end = size - 1;
+				else if (!to_uint(last, end) || end < begin)
+					return std::vector<byte_range>{};
+				if (begin >= size)
+					continue;
+				end = (std::min)(end, size - 1);
+			}
+
+			has_valid = true;
+
+			ranges.emplace_back(byte_range{ .offset = begin, .length = end - begin + 1 });
+
+			if (ranges.size() > max_byte_ranges)
+				return std::vector<byte_range>{};
+		}
+
+		if (!has_valid)
+			return std::nullopt;
+
+		return ranges;
+	}
+
+#if ASIO3_OS_LINUX
+	/**
+	 * The file is copied into the socket in the kernel by sendfile(), so it never be read
+	 * into the user space, the socket must be a plain tcp socket.
+	 */
+	inline net::awaitable<std::tuple<net::error_code, std::uint64_t>> async_sendfile(
+		net::tcp_socket& sock, int fd, std::uint64_t offset, std::uint64_t size)
+	{
+		std::uint64_t total = 0;
+
+		net::error_code ec{};
+
+		// sendfile() may block on the socket if the socket is not non-blocking.
+		sock.native_non_blocking(true, ec);
+		if (ec)
+			co_return std::tuple{ ec, total };
+
+		off_t pos = off_t(offset);
+
+		while (total < size)
+		{
+			ssize_t n = ::sendfile(sock.native_handle(), fd, std::addressof(pos),
+				std::size_t((std::min<std::uint64_t>)(size - total, 0x7ffff000)));
+			if (n == 0)
+				co_return std::tuple{ net::error_code(net::error::eof), total };
+
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					auto [e1] = co_await sock.async_wait(net::socket_base::wait_write, net::use_nothrow_awaitable);
+					if (e1)
+						co_return std::tuple{ e1, total };
+					continue;
+				}
+
+				co_return std::tuple{ net::error_code(errno, net::error::get_system_category()), total };
+			}
+
+			total += std::uint64_t(n);
+		}
+
+		co_return std::tuple{ ec, total };
+	}
+#endif
+
+	/**
+	 * The file is read into a pooled buffer piece by piece, and each piece is written into the
+	 * stream, it is used for the ssl stream, the data must be encrypted in the user space.
+	 * The file is read at the offset by pread() on linux, the file position isn't used, so the
+	 * opened file can be shared by several sessions.
+	 */
+	net::awaitable<std::tuple<net::error_code, std::uint64_t>> async_write_file_by_buffer(
+		auto& stream, beast::file& file, std::uint64_t offset, std::uint64_t size)
+	{
+		std::uint64_t total = 0;
+
+		net::error_code ec{};
+
+	#if !ASIO3_OS_LINUX
+		file.seek(offset, ec);
+		if (ec)
+			co_return std::tuple{ ec, total };
+	#endif
+
+		pooled_buffer buffer;
+
+		while (total < size)
+		{
+			std::size_t want = std::size_t((std::min<std::uint64_t>)(size - total, buffer.size()));
+
+		#if ASIO3_OS_LINUX
+			ssize_t r = ::pread(file.native_handle(), buffer.data(), want, off_t(offset + total));
+			if (r < 0)
+			{
+				if (errno == EINTR)
+					continue;
+				co_return std::tuple{ net::error_code(errno, net::error::get_system_category()), total };
+			}
+			std::size_t n = std::size_t(r);
+		#else
+			std::size_t n = file.read(buffer.data(), want, ec);
+			if (ec)
+				co_return std::tuple{ ec, total };
+		#endif
+
+			// the file was truncated after the content length was sent.
+			if (n == 0)
+				co_return std::tuple{ net::error_code(net::error::eof), total };
+
+			auto [e1, n1] = co_await net::async_write(stream, buffer.buffer(n), net::use_nothrow_awaitable);
+			if (e1)
+				co_return std::tuple{ e1, total };
+
+			total += n1;
+		}
+
+		co_return std::tuple{ ec, total };
+	}
+
+	/**
+	 * @brief Write the range of the file into the stream, the memory is same whatever the size
+	 *    of the file is. sendfile() is used for the plain tcp socket on linux.
+	 * @return (error, written_bytes)
+	 */
+	net::awaitable<std::tuple<net::error_code, std::uint64_t>> async_write_file_body(
+		auto& stream, beast::file& file, std::uint64_t offset, std::uint64_t size)
+	{
+	#if ASIO3_OS_LINUX
+		if constexpr (std::is_same_v<std::remove_cvref_t<decltype(stream)>, net::tcp_socket>)
+		{
+			co_return co_await async_sendfile(stream, file.native_handle(), offset, size);
+		}
+		else
+	#endif
+		{
+			co_return co_await async_write_file_by_buffer(stream, file, offset, size);
+		}
+	}
+
+	inline std::string make_content_range(const byte_range& r, std::uint64_t size)
+	{
+		return "bytes " + std::to_string(r.offset) + "-" + std::to_string(r.offset + r.length - 1) +
+			"/" + std::to_string(size);
+	}
+
+	inline std::string make_multipart_boundary()
+	{
+		thread_local std::mt19937_64 gen{ std::random_device{}() };
+
+		std::string boundary = "naslite_";
+		for (std::uint64_t v = gen(), i = 0; i < 16; ++i, v >>= 4)
+			boundary += "0123456789abcdef"[v & 0xf];
+		return boundary;
+	}
+
+	/**
+	 * @brief Send the 304 response which only has the validators.
+	 * @return (error, sent_bytes, status)
+	 */
+	net::awaitable<std::tuple<net::error_code, std::size_t, unsigned>> async_send_not_modified(
+		auto& stream, http::web_request& req, const file_metadata& meta, std::string_view cache_control,
+		std::string_view coding = {})
+	{
+		http::response<http::empty_body> res{ http::status::not_modified, req.version() };
+		res.set(http::field::server, BEAST_VERSION_STRING);
+		set_file_validators(res, meta, cache_control, coding);
+		res.keep_alive(req.keep_alive());
+
+		auto [e1, n1] = co_await http::async_write(stream, res, net::use_nothrow_awaitable);
+		co_return std::tuple{ e1, n1, res.result_int() };
+	}
+
+	/**
+	 * @brief Send the file as the response of the request, the header is written first, then
+	 *    the body is streamed from the opened file. The "Range" header is supported, only the
+	 *    requested ranges are read from the file, several ranges are sent as the
+	 *    multipart/byteranges.
+	 * @param meta - The validators of the file, the opened file of it is used if it has, so
+	 *    the file isn't opened again.
+	 * @return (error, sent_bytes, status)
+	 */
+	net::awaitable<std::tuple<net::error_code, std::size_t, unsigned>> async_send_file_response(
+		auto& stream, http::web_request& req, const std::filesystem::path& filepath,
+		const file_metadata& meta, std::string_view cache_control)
+	{
+		net::error_code ec{};
+
+		// the opened file of the metadata is kept alive until the file was sent.
+		std::shared_ptr<beast::file> opened = meta.file;
+		if (!opened)
+		{
+			opened = std::make_shared<beast::file>();
+			opened->open(filepath.string().c_str(), beast::file_mode::scan, ec);
+		}
+
+		beast::file& file = *opened;
+
+		if (ec)
+		{
+			http::response<http::string_body> res = http::make_error_page_response(http::status::not_found);
+			res.keep_alive(req.keep_alive());
+			auto [e1, n1] = co_await http::async_write(stream, res, net::use_nothrow_awaitable);
+			co_return std::tuple{ e1, n1, res.result_int() };
+		}
+
+		std::uint64_t size = file.size(ec);
+		if (ec)
+			co_return std::tuple{ ec, std::size_t(0), 500u };
+
+		std::string mimetype = meta.mimetype.empty() ?
+			std::string(http::extension_to_mimetype(filepath.extension().string())) : meta.mimetype;
+
+		std::optional<std::vector<byte_range>> ranges = std::vector<byte_range>{};
+
+		if (auto it = req.find(http::field::range); it != req.end() && is_if_range_matched(req, meta))
+		{
+			ranges = parse_byte_ranges(it->value(), size);
+		}
+
+		if (!ranges.has_value())
+		{
+			http::response<http::string_body> res{ http::status::range_not_satisfiable, req.version() };
+			res.set(http::field::server, BEAST_VERSION_STRING);
+			res.set(http::field::content_range, "bytes */" + std::to_string(size));
+			res.keep_alive(req.keep_alive());
+			res.prepare_payload();
+			auto [e1, n1] = co_await http::async_write(stream, res, net::use_nothrow_awaitable);
+			co_return std::tuple{ e1, n1, res.result_int() };
+		}
+
+		http::response<http::empty_body> res{ http::status::ok, req.version() };
+		res.set(http::field::server, BEAST_VERSION_STRING);
+		res.set(http::field::accept_ranges, "bytes");
+		set_file_validators(res, meta, cache_control);
+		res.keep_alive(req.keep_alive());
+
+		// the heads of the parts and the tail of the multipart body.
+		std::vector<std::string> heads;
+		std::string tail;
+
+		if /**/ (ranges->empty())
+		{
+			res.set(http::field::content_type, mimetype);
+			res.content_length(size);
+		}
+		else if (ranges->size() == 1)
+		{
+			byte_range& r = ranges->front();
+			res.result(http::status::partial_content);
+			res.set(http::field::content_type, mimetype);
+			res.set(http::field::content_range, make_content_range(r, size));
+			res.content_length(r.length);
+		}
+		else
+		{
+			std::string boundary = make_multipart_boundary();
+			std::uint64_t total = 0;
+			for (byte_range& r : *ranges)
+			{
+				heads.emplace_back("\r\n--" + boundary + "\r\nContent-Type: " + mimetype +
+					"\r\nContent-Range: " + make_content_range(r, size) + "\r\n\r\n");
+				total += heads.back().size() + r.length;
+			}
+			tail = "\r\n--" + boundary + "--\r\n";
+			total += tail.size();
+
+			res.result(http::status::partial_content);
+			res.set(http::field::content_type, "multipart/byteranges; boundary=" + boundary);
+			res.content_length(total);
+		}
+
+		http::response_serializer<http::empty_body> sr{ res };
+
+		auto [e2, n2] = co_await http::async_write_header(stream, sr, net::use_nothrow_awaitable);
+		if (e2 || req.method() == http::verb::head)
+			co_return std::tuple{ e2, n2, res.result_int() };
+
+		std::size_t sent = n2;
+
+		if (ranges->empty())
+		{
+			auto [e3, n3] = co_await async_write_file_body(stream, file, 0, size);
+			co_return std::tuple{ e3, std::size_t(sent + n3), res.result_int() };
+		}
+
+		for (std::size_t i = 0; i < ranges->size(); ++i)
+		{
+			byte_range& r = (*ranges)[i];
+
+			if (!heads.empty())
+			{
+				auto [e4, n4] = co_await net::async_write(stream, net::buffer(heads[i]), net::use_nothrow_awaitable);
+				sent += n4;
+				if (e4)
+					co_return std::tuple{ e4, sent, res.result_int() };
+			}
+
+			auto [e5, n5] = co_await async_write_file_body(stream, file, r.offset, r.length);
+			sent += std::size_t(n5);
+			if (e5)
+				co_return std::tuple{ e5, sent, res.result_int() };
+		}
+
+		if (!tail.empty())
+		{
+			auto [e6, n6] = co_await net::async_write(stream, net::buffer(tail), net::use_nothrow_awaitable);
+			sent += n6;
+			if (e6)
+				co_return std::tuple{ e6, sent, res.result_int() };
+		}
+
+		co_return std::tuple{ ec, sent, res.result_int() };
+	}
+}
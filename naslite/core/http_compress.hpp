@@ -0,0 +1,212 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+
+#include "net.hpp"
+#include "file_metadata.hpp"
+
+#include <asio3/core/strutil.hpp>
+#include <asio3/http/core.hpp>
+
+#include <boost/beast/zlib/deflate_stream.hpp>
+
+namespace nas
+{
+	inline std::uint32_t crc32(std::uint32_t crc, const void* data, std::size_t size) noexcept
+	{
+		static constexpr std::array<std::uint32_t, 256> table = []() constexpr
+		{
+			std::array<std::uint32_t, 256> t{};
+			for (std::uint32_t i = 0; i < 256; ++i)
+			{
+				std::uint32_t c = i;
+				for (int k = 0; k < 8; ++k)
+					c = (c & 1) ? (0xedb88320u ^ (c >> 1)) : (c >> 1);
+				t[i] = c;
+			}
+			return t;
+		}();
+
+		const std::uint8_t* p = static_cast<const std::uint8_t*>(data);
+
+		crc = ~crc;
+		for (std::size_t i = 0; i < size; ++i)
+			crc = table[(crc ^ p[i]) & 0xff] ^ (crc >> 8);
+		return ~crc;
+	}
+
+	/**
+	 * @brief Compress the data into the gzip format of rfc 1952, the beast zlib only outputs the
+	 *    raw deflate data, so the gzip header and trailer are written here.
+	 */
+	inline std::string gzip_compress(std::string_view data, int level = 6)
+	{
+		beast::zlib::deflate_stream ds;
+		ds.reset(level, 15, 8, beast::zlib::Strategy::normal);
+
+		std::string out;
+		out.resize(10 + ds.upper_bound(data.size()) + 8);
+
+		// magic, deflate, no flags, no mtime, no extra flags, unknown os
+		static constexpr unsigned char header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 0xff };
+		std::memcpy(out.data(), header, sizeof(header));
+
+		beast::zlib::z_params zs{};
+		zs.next_in = data.data();
+		zs.avail_in = data.size();
+		zs.next_out = out.data() + sizeof(header);
+		zs.avail_out = out.size() - sizeof(header) - 8;
+
+		beast::error_code ec{};
+		ds.write(zs, beast::zlib::Flush::finish, ec);
+		if (ec != beast::zlib::error::end_of_stream)
+			return {};
+
+		std::size_t n = sizeof(header) + zs.total_out;
+
+		std::uint32_t crc = crc32(0, data.data(), data.size());
+		std::uint32_t isize = std::uint32_t(data.size());
+
+		for (int i = 0; i < 4; ++i)
+			out[n++] = char((crc >> (8 * i)) & 0xff);
+		for (int i = 0; i < 4; ++i)
+			out[n++] = char((isize >> (8 * i)) & 0xff);
+
+		out.resize(n);
+		return out;
+	}
+
+	// the coding is accepted if it is listed or "*" is listed, and the q isn't zero.
+	inline bool is_encoding_accepted(http::web_request& req, std::string_view coding)
+	{
+		auto it = req.find(http::field::accept_encoding);
+		if (it == req.end())
+			return false;
+
+		bool result = false;
+
+		for (std::string_view item : net::split(it->value(), ","))
+		{
+			std::string_view name = item.substr(0, item.find(';'));
+			std::string_view params = name.size() < item.size() ? item.substr(name.size() + 1) : std::string_view{};
+
+			net::trim_both(name);
+			net::trim_both(params);
+
+			if (!net::iequals(name, coding) && name != "*")
+				continue;
+
+			bool zero = params.starts_with("q=0") &&
+				params.find_first_not_of("0.", 2) == std::string_view::npos;
+
+			// the exact name overrides the "*".
+			if (net::iequals(name, coding))
+				return !zero;
+
+			result = !zero;
+		}
+
+		return result;
+	}
+
+	/**
+	 * @brief Select the content coding of the response, the precompressed brotli file is
+	 *    preferred, the brotli isn't compressed on the fly.
+	 * @return "br", "gzip", or empty for the identity.
+	 */
+	inline std::string_view select_content_coding(http::web_request& req, const file_metadata& meta)
+	{
+		if (!meta.has_encodings())
+			return {};
+
+		if (meta.has_br_file && is_encoding_accepted(req, "br"))
+			return "br";
+
+		if ((meta.has_gzip_file || meta.compressible) && is_encoding_accepted(req, "gzip"))
+			return "gzip";
+
+		return {};
+	}
+
+	// the cache key of the encoded response, the "#" is never sent in the target.
+	inline std::string make_variant_key(std::string_view target, std::string_view coding)
+	{
+		std::string key(target);
+		key += '#';
+		key += coding;
+		return key;
+	}
+
+	// the compression is slow, so it is done in this pool, not in the io threads.
+	inline net::thread_pool& compression_pool()
+	{
+		static net::thread_pool pool(2);
+		return pool;
+	}
+
+	/**
+	 * @brief Make the encoded response of the file in the compression pool, the precompressed
+	 *    file is used if it is existed, otherwise the file is gzipped.
+	 * @param make_response - response(const std::filesystem::path& filepath, std::string content),
+	 *    it makes the identity response of the file, it is called in the compression pool.
+	 * @return The response, or nullopt if the file can't be read, the coroutine is resumed in
+	 *    the caller executor.
+	 */
+	net::awaitable<std::optional<http::response<http::string_body>>> async_make_encoded_response(
+		std::filesystem::path filepath, const file_metadata& meta, std::string_view coding, auto make_response)
+	{
+		auto ex = co_await net::this_coro::executor;
+
+		co_await net::dispatch(net::bind_executor(compression_pool().get_executor(), net::use_nothrow_awaitable));
+
+		auto read_file = [](const std::filesystem::path& path, std::string& content) -> bool
+		{
+			std::ifstream file(path, std::ios::binary);
+			if (!file)
+				return false;
+			content.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+			return !file.bad();
+		};
+
+		std::optional<http::response<http::string_body>> result;
+
+		std::filesystem::path sibling = filepath;
+		sibling += (coding == "br" ? ".br" : ".gz");
+
+		std::string body;
+
+		bool encoded = (coding == "br" ? meta.has_br_file : meta.has_gzip_file) && read_file(sibling, body);
+
+		if (!encoded && coding == "gzip")
+		{
+			std::string content;
+			if (read_file(filepath, content))
+			{
+				body = gzip_compress(content);
+				encoded = !body.empty();
+			}
+		}
+
+		// the headers are same as the identity response except the body, the etag and the coding.
+		if (encoded)
+		{
+			result = make_response(filepath, std::string{});
+			result->body() = std::move(body);
+			result->set(http::field::content_encoding, coding);
+			result->set(http::field::etag, make_variant_etag(meta.etag, coding));
+			result->set(http::field::vary, "Accept-Encoding");
+		}
+
+		co_await net::dispatch(net::bind_executor(ex, net::use_nothrow_awaitable));
+
+		co_return result;
+	}
+}
@@ -38,6 +38,15 @@ namespace nas
 		bool          enable_cors = false;
 		bool          requires_auth = false;
 		std::unordered_map<std::string, token_info> tokens;
+		std::uint32_t worker_threads = 1; // 0 means the cpu core count
+		std::uint64_t max_cache_file_size = 1048576; // the larger files are sent from the file directly
+		std::uint64_t max_cache_size = 67108864; // the total bytes of the cached responses
+		std::uint32_t cache_ttl = 0; // seconds, 0 means the cached responses never expire
+		bool          enable_cache_warmup = false; // read the small files into the cache when started
+		std::uint64_t cache_warmup_size = 16777216; // the total bytes of the files which are read
+		std::string   cache_control = "no-cache"; // the clients must revalidate the files by etag
+		std::uint32_t open_file_cache_size = 1024; // the opened files of all the worker threads
+		std::uint32_t open_file_cache_ttl = 5; // seconds, then the cached file is checked again
 	};
 
 	struct frontend_http_server_info
@@ -58,6 +67,13 @@ namespace nas
 		std::string   cors_allow_origin;
 		bool          requires_auth = false;
 		std::unordered_map<std::string, token_info> tokens;
+		std::uint64_t max_cache_file_size = 1048576; // the larger files are sent from the file directly
+		std::uint64_t max_cache_size = 67108864; // the total bytes of the cached responses
+		std::uint32_t cache_ttl = 0; // seconds, 0 means the cached responses never expire
+		bool          enable_cache_warmup = false; // read the small files into the cache when started
+		std::uint64_t cache_warmup_size = 16777216; // the total bytes of the files which are read
+		std::string   cache_control = "no-cache";
+		std::string   assets_cache_control = "public, max-age=31536000, immutable"; // the names of assets are hashed
 	};
 
 	struct proxy_auth_role
@@ -67,6 +83,27 @@ namespace nas
 		unsigned    result;
 	};
 
+	struct upstream_server_info
+	{
+		std::string   host;
+		std::uint16_t port = 0;
+		std::uint32_t weight = 1;
+		std::uint32_t max_fails = 1;
+		std::uint32_t fail_timeout = 10; // seconds
+	};
+
+	struct health_check_info
+	{
+		bool          enable = false;
+		std::string   type = "tcp";  // tcp http icmp
+		std::uint32_t interval = 5;  // seconds
+		std::uint32_t timeout = 3;   // seconds
+		std::uint32_t rise = 2;      // continuous successes to mark a backend up
+		std::uint32_t fall = 3;      // continuous failures to mark a backend down
+		std::string   uri = "/";     // the target of the http probe
+		std::uint32_t status = 200;  // the expected status of the http probe
+	};
+
 	struct proxy_site_info
 	{
 		std::string   name;
@@ -79,6 +116,14 @@ namespace nas
 		std::vector<proxy_auth_role> auth_roles;
 		std::map<std::string, std::string> proxy_set_header;
 		std::map<std::string, std::string> proxy_options;
+		std::uint32_t keepalive = 0;            // max idle backend connections per thread, 0 disables the pool
+		std::uint32_t keepalive_timeout = 60;   // seconds
+		std::uint32_t keepalive_requests = 1000;
+		std::uint32_t connect_timeout = 60;         // seconds, the deadline of the whole connect to a backend
+		std::uint32_t connect_attempt_delay = 250;  // milliseconds, the next address of the backend is raced after it
+		std::string   balance = "round_robin"; // round_robin least_conn weighted ip_hash
+		std::vector<upstream_server_info> upstream_servers; // the backends besides the host and port
+		health_check_info health_check;
 	};
 
 	struct http_reverse_proxy_info
@@ -87,10 +132,14 @@ namespace nas
 		std::string   protocol;
 		std::string   name;
 		std::uint32_t ip_blacklist_minutes = 1440;
+		std::uint32_t ip_blacklist_capacity = 65536; // max count of the tracked client ip
+		std::string   ip_blacklist_file;             // empty means the blacklist isn't persisted
 		std::string   listen_address = "0.0.0.0";
 		std::uint16_t listen_port = 0;
 		std::string   cert_file;
 		std::string   key_file;
+		std::uint32_t worker_threads = 1; // 0 means the cpu core count
+		bool          cpu_affinity = false;
 		std::unordered_map<std::string, proxy_site_info> proxy_sites;
 	};
 
@@ -100,10 +149,17 @@ namespace nas
 		std::string   protocol;
 		std::string   name;
 		std::uint32_t ip_blacklist_minutes = 1440;
+		std::uint32_t ip_blacklist_capacity = 65536; // max count of the tracked client ip
+		std::string   ip_blacklist_file;             // empty means the blacklist isn't persisted
 		std::string   listen_address = "0.0.0.0";
 		std::uint16_t listen_port = 0;
 		std::vector<std::uint8_t> supported_method;
 		std::unordered_map<std::string, token_info> tokens;
+		bool          shared_udp_enable = false;     // the udp associations share a pool of udp sockets
+		std::uint32_t shared_udp_sockets = 4;        // the shared sockets of each ip protocol which the clients send to
+		std::uint32_t shared_udp_idle_timeout = 60;  // seconds, the idle mapping of a remote is expired
+		std::uint32_t connect_timeout = 30;          // seconds, the deadline of the whole connect to the dest
+		std::uint32_t connect_attempt_delay = 250;   // milliseconds, the next address of the dest is raced after it
 	};
 
 	struct process_info
@@ -141,6 +197,9 @@ namespace nas
 		virtual std::expected<bool, std::exception_ptr> save() = 0;
 
 		virtual std::string get_log_level() = 0;
+		virtual std::uint32_t get_log_queue_size() = 0;
+		virtual std::string get_log_overflow_policy() = 0;
+		virtual std::vector<std::string> get_dns_nameservers() = 0;
 
 		virtual std::vector<static_http_server_info> get_http_server_cfg() = 0;
 		virtual std::vector<http_reverse_proxy_info> get_http_reverse_proxy_cfg() = 0;
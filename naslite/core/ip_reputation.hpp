@@ -0,0 +1,588 @@
+#pragma once
+
+#include <array>
+#include <mutex>
+#include <shared_mutex>
+#include <chrono>
+#include <vector>
+#include <string>
+#include <cstring>
+#include <fstream>
+#include <optional>
+#include <algorithm>
+#include <filesystem>
+#include <string_view>
+#include <unordered_map>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace nas
+{
+	/**
+	 * The auth state of the client ip addresses, one table is shared by all the threads of a proxy.
+	 * The entries are fixed size and stored in one array, so the memory is bounded by the capacity,
+	 * the least recently updated entry is evicted when the array is full. The blacklisted entries
+	 * are in their own lru list, they are evicted only if all the others are blacklisted, so a
+	 * scan of new addresses can't flush the blacklist.
+	 * The entries are expired by a hierarchical timing wheel which is advanced by the expire()
+	 * function, so only one timer is needed for all the ip addresses.
+	 * If a file is given, the array is mapped from it, so the blacklist is kept after restart.
+	 */
+	class ip_reputation : public noncopyable
+	{
+	public:
+		struct state
+		{
+			std::int64_t deadline = 0; // seconds since the epoch of system_clock
+			std::int32_t auth_failed_times = 0;
+
+			// the ip is blocked after it failed the auth more than 3 times.
+			inline bool is_blacklisted() const noexcept
+			{
+				return auth_failed_times > 3;
+			}
+		};
+
+		static constexpr std::uint32_t npos = std::uint32_t(-1);
+
+		/**
+		 * @param capacity - The max count of the ip addresses.
+		 * @param filepath - The file which the entries are mapped from, empty means in memory only.
+		 */
+		explicit ip_reputation(std::uint32_t capacity, const std::string& filepath = {})
+		{
+			capacity = (std::max)(capacity, std::uint32_t(16));
+
+			if (!filepath.empty() && !open_file(capacity, filepath))
+			{
+				mapped = boost::interprocess::mapped_region{};
+			}
+
+			if (mapped.get_address() == nullptr)
+			{
+				memory.resize(sizeof(header) + std::size_t(capacity) * sizeof(entry));
+				init_header(memory.data(), capacity);
+				hdr = reinterpret_cast<header*>(memory.data());
+			}
+
+			entries = reinterpret_cast<entry*>(reinterpret_cast<char*>(hdr) + sizeof(header));
+
+			load();
+		}
+
+		~ip_reputation()
+		{
+			if (mapped.get_address())
+				mapped.flush();
+		}
+
+		static inline std::int64_t now_seconds() noexcept
+		{
+			return std::chrono::duration_cast<std::chrono::seconds>(
+				std::chrono::system_clock::now().time_since_epoch()).count();
+		}
+
+		// the deadline which is the duration after now.
+		static inline std::int64_t after(std::chrono::seconds duration) noexcept
+		{
+			return now_seconds() + duration.count();
+		}
+
+		/**
+		 * @brief Get the state of the ip, return nullopt if the ip isn't in the table or expired.
+		 *    It is called for every accepted client by all the threads, so it only takes the
+		 *    shared lock and doesn't touch the lru list, the entry is touched by update().
+		 */
+		std::optional<state> find(const net::ip::address& addr) const
+		{
+			key_type k = to_key(addr);
+
+			std::shared_lock g(mtx);
+
+			auto it = index.find(k);
+			if (it == index.end())
+				return std::nullopt;
+
+			const entry& e = entries[it->second];
+			if (e.st.deadline <= now_seconds())
+				return std::nullopt;
+
+			return e.st;
+		}
+
+		/**
+		 * @brief Modify the state of the ip by the function, the entry is added if not exists,
+		 *    the deadline of the new entry is zero, it must be set by the function.
+		 * @param f - void(state&)
+		 */
+		template<typename Function>
+		state update(const net::ip::address& addr, Function&& f)
+		{
+			key_type k = to_key(addr);
+
+			std::lock_guard g(mtx);
+
+			std::uint32_t i;
+			bool added = false;
+			if (auto it = index.find(k); it != index.end())
+			{
+				i = it->second;
+
+				// it is pushed to the front of the list of its new state below.
+				lru_unlink(i);
+
+				// the expired entry which hasn't been removed by the wheel yet.
+				if (entries[i].st.deadline <= now_seconds())
+					entries[i].st = state{};
+			}
+			else
+			{
+				i = allocate();
+
+				entry& e = entries[i];
+				e.addr = k;
+				e.st = state{};
+				e.used = 1;
+
+				index.emplace(k, i);
+				added = true;
+			}
+
+			entry& e = entries[i];
+
+			f(e.st);
+
+			lru_push_front(i);
+
+			e.last_access = now_seconds();
+
+			// the entry is still in the old slot if the deadline is extended, it will be moved
+			// to the right slot when the old slot is expired.
+			if (added)
+				wheel_link(i);
+
+			return e.st;
+		}
+
+		void erase(const net::ip::address& addr)
+		{
+			key_type k = to_key(addr);
+
+			std::lock_guard g(mtx);
+
+			if (auto it = index.find(k); it != index.end())
+			{
+				remove(it->second);
+			}
+		}
+
+		/**
+		 * @brief Advance the timing wheel to now and remove the expired entries.
+		 *    Should be called every second.
+		 */
+		void expire()
+		{
+			std::int64_t now = now_seconds();
+
+			std::lock_guard g(mtx);
+
+			// the clock was changed or it wasn't called for a long time, walking second by
+			// second is too slow, rebuild the wheel instead.
+			if (now < hdr->wheel_time || now - hdr->wheel_time > std::int64_t(wheel_size * wheel_size))
+			{
+				hdr->wheel_time = now;
+				rebuild_wheel();
+				return;
+			}
+
+			while (hdr->wheel_time < now)
+			{
+				std::int64_t t = ++hdr->wheel_time;
+
+				// move the entries of the higher level slot down when the lower levels wrap.
+				for (std::size_t level = wheel_levels - 1; level > 0; --level)
+				{
+					if ((t & ((std::int64_t(1) << (wheel_bits * level)) - 1)) == 0)
+					{
+						cascade(level, std::size_t(t >> (wheel_bits * level)) & wheel_mask);
+					}
+				}
+
+				std::uint32_t& head = wheel[0][std::size_t(t) & wheel_mask];
+
+				std::uint32_t i = head;
+				head = npos;
+
+				while (i != npos)
+				{
+					std::uint32_t next = entries[i].wheel_next;
+
+					if (entries[i].st.deadline <= t)
+						remove_unlinked(i);
+					else
+						wheel_link(i);
+
+					i = next;
+				}
+			}
+		}
+
+		inline std::size_t size()
+		{
+			std::lock_guard g(mtx);
+			return index.size();
+		}
+
+		inline std::uint32_t capacity() const noexcept
+		{
+			return hdr->capacity;
+		}
+
+		inline bool is_persistent() const noexcept
+		{
+			return mapped.get_address() != nullptr;
+		}
+
+	protected:
+		using key_type = std::array<std::uint8_t, 16>;
+
+		struct key_hash
+		{
+			inline std::size_t operator()(const key_type& k) const noexcept
+			{
+				return std::hash<std::string_view>{}(std::string_view(
+					reinterpret_cast<const char*>(k.data()), k.size()));
+			}
+		};
+
+		struct header
+		{
+			char          magic[8];
+			std::uint32_t version;
+			std::uint32_t capacity;
+			std::uint32_t entry_size;
+			std::uint32_t reserved;
+			std::int64_t  wheel_time;
+		};
+
+		// the links are only valid in the process, they are rebuilt when the file is loaded.
+		struct entry
+		{
+			key_type      addr;
+			state         st;
+			std::int64_t  last_access;
+			std::uint32_t used;
+			std::uint32_t lru_prev, lru_next;
+			std::uint32_t wheel_prev, wheel_next;
+			std::uint32_t wheel_level;
+		};
+
+		static constexpr std::size_t lru_transient = 0;
+		static constexpr std::size_t lru_blacklisted = 1;
+
+		static constexpr char          file_magic[8] = { 'N','A','S','I','P','R','E','P' };
+		static constexpr std::uint32_t file_version = 1;
+
+		// 4 levels of 64 slots with 1 second tick, covers about 194 days.
+		static constexpr std::size_t wheel_bits = 6;
+		static constexpr std::size_t wheel_size = std::size_t(1) << wheel_bits;
+		static constexpr std::size_t wheel_mask = wheel_size - 1;
+		static constexpr std::size_t wheel_levels = 4;
+
+		static key_type to_key(const net::ip::address& addr) noexcept
+		{
+			return addr.is_v4() ?
+				net::ip::make_address_v6(net::ip::v4_mapped, addr.to_v4()).to_bytes() :
+				addr.to_v6().to_bytes();
+		}
+
+		static void init_header(void* p, std::uint32_t capacity) noexcept
+		{
+			std::memset(p, 0, sizeof(header) + std::size_t(capacity) * sizeof(entry));
+
+			header* h = static_cast<header*>(p);
+			std::memcpy(h->magic, file_magic, sizeof(file_magic));
+			h->version = file_version;
+			h->capacity = capacity;
+			h->entry_size = std::uint32_t(sizeof(entry));
+			h->wheel_time = now_seconds();
+		}
+
+		bool open_file(std::uint32_t capacity, const std::string& filepath)
+		{
+			namespace bip = boost::interprocess;
+
+			std::size_t file_size = sizeof(header) + std::size_t(capacity) * sizeof(entry);
+
+			try
+			{
+				std::error_code ec{};
+
+				bool valid = false;
+
+				if (std::filesystem::file_size(filepath, ec) == file_size && !ec)
+				{
+					header h{};
+					std::ifstream file(filepath, std::ios::binary);
+					if (file.read(reinterpret_cast<char*>(std::addressof(h)), sizeof(h)))
+					{
+						valid = std::memcmp(h.magic, file_magic, sizeof(file_magic)) == 0 &&
+							h.version == file_version && h.capacity == capacity &&
+							h.entry_size == sizeof(entry);
+					}
+				}
+
+				if (!valid)
+				{
+					std::ofstream file(filepath, std::ios::binary | std::ios::trunc);
+					if (!file)
+						return false;
+					file.close();
+
+					std::filesystem::resize_file(filepath, file_size, ec);
+					if (ec)
+						return false;
+				}
+
+				bip::file_mapping mapping(filepath.c_str(), bip::read_write);
+				mapped = bip::mapped_region(mapping, bip::read_write, 0, file_size);
+
+				hdr = static_cast<header*>(mapped.get_address());
+
+				if (!valid)
+					init_header(hdr, capacity);
+
+				return true;
+			}
+			catch (const std::exception&)
+			{
+				return false;
+			}
+		}
+
+		// rebuild the index, the lru list and the wheel from the entries array.
+		void load()
+		{
+			std::int64_t now = now_seconds();
+
+			hdr->wheel_time = now;
+
+			for (auto& slots : wheel)
+				slots.fill(npos);
+
+			lru_head.fill(npos);
+			lru_tail.fill(npos);
+			free_head = npos;
+
+			std::vector<std::uint32_t> used;
+
+			for (std::uint32_t i = hdr->capacity; i-- > 0;)
+			{
+				entry& e = entries[i];
+
+				if (e.used && e.st.deadline > now && !index.contains(e.addr))
+				{
+					index.emplace(e.addr, i);
+					used.emplace_back(i);
+				}
+				else
+				{
+					e.used = 0;
+					e.lru_next = free_head;
+					free_head = i;
+				}
+			}
+
+			std::sort(used.begin(), used.end(), [this](std::uint32_t a, std::uint32_t b)
+			{
+				return entries[a].last_access < entries[b].last_access;
+			});
+
+			for (std::uint32_t i : used)
+			{
+				lru_push_front(i);
+				wheel_link(i);
+			}
+		}
+
+		void rebuild_wheel()
+		{
+			for (auto& slots : wheel)
+				slots.fill(npos);
+
+			std::vector<std::uint32_t> expired;
+
+			for (auto& [k, i] : index)
+			{
+				if (entries[i].st.deadline <= hdr->wheel_time)
+					expired.emplace_back(i);
+				else
+					wheel_link(i);
+			}
+
+			for (std::uint32_t i : expired)
+				remove_unlinked(i);
+		}
+
+		void cascade(std::size_t level, std::size_t slot)
+		{
+			std::uint32_t i = wheel[level][slot];
+			wheel[level][slot] = npos;
+
+			while (i != npos)
+			{
+				std::uint32_t next = entries[i].wheel_next;
+				wheel_link(i);
+				i = next;
+			}
+		}
+
+		// the level is the lowest one which the higher digits of the deadline and the wheel time
+		// are equal, so the slot is always in front of the current position of that level.
+		void wheel_link(std::uint32_t i)
+		{
+			entry& e = entries[i];
+
+			std::int64_t deadline = (std::max)(e.st.deadline, hdr->wheel_time + 1);
+
+			std::size_t level = 0;
+			while (level < wheel_levels - 1 &&
+				(deadline >> (wheel_bits * (level + 1))) != (hdr->wheel_time >> (wheel_bits * (level + 1))))
+			{
+				++level;
+			}
+
+			std::size_t slot;
+			if ((deadline >> (wheel_bits * wheel_levels)) != (hdr->wheel_time >> (wheel_bits * wheel_levels)))
+			{
+				// out of the range of the wheel, park it in the slot which is cascaded last.
+				slot = std::size_t((hdr->wheel_time >> (wheel_bits * level)) + wheel_mask) & wheel_mask;
+			}
+			else
+			{
+				slot = std::size_t(deadline >> (wheel_bits * level)) & wheel_mask;
+			}
+
+			std::uint32_t& head = wheel[level][slot];
+
+			e.wheel_level = std::uint32_t(level);
+			e.wheel_prev = npos;
+			e.wheel_next = head;
+			if (head != npos)
+				entries[head].wheel_prev = i;
+			head = i;
+		}
+
+		void wheel_unlink(std::uint32_t i)
+		{
+			entry& e = entries[i];
+
+			if (e.wheel_prev != npos)
+			{
+				entries[e.wheel_prev].wheel_next = e.wheel_next;
+			}
+			else
+			{
+				for (auto& slots : wheel[e.wheel_level])
+				{
+					if (slots == i)
+					{
+						slots = e.wheel_next;
+						break;
+					}
+				}
+			}
+
+			if (e.wheel_next != npos)
+				entries[e.wheel_next].wheel_prev = e.wheel_prev;
+
+			e.wheel_prev = e.wheel_next = npos;
+		}
+
+		// the list is chosen by the state, so the state can't be changed while it is linked.
+		static inline std::size_t lru_list_of(const state& st) noexcept
+		{
+			return st.is_blacklisted() ? lru_blacklisted : lru_transient;
+		}
+
+		void lru_push_front(std::uint32_t i)
+		{
+			entry& e = entries[i];
+			std::size_t l = lru_list_of(e.st);
+			e.lru_prev = npos;
+			e.lru_next = lru_head[l];
+			if (lru_head[l] != npos)
+				entries[lru_head[l]].lru_prev = i;
+			lru_head[l] = i;
+			if (lru_tail[l] == npos)
+				lru_tail[l] = i;
+		}
+
+		void lru_unlink(std::uint32_t i)
+		{
+			entry& e = entries[i];
+			std::size_t l = lru_list_of(e.st);
+			if (e.lru_prev != npos)
+				entries[e.lru_prev].lru_next = e.lru_next;
+			else
+				lru_head[l] = e.lru_next;
+			if (e.lru_next != npos)
+				entries[e.lru_next].lru_prev = e.lru_prev;
+			else
+				lru_tail[l] = e.lru_prev;
+			e.lru_prev = e.lru_next = npos;
+		}
+
+		std::uint32_t allocate()
+		{
+			if (free_head == npos)
+			{
+				// evict the least recently used one, the blacklisted ones are kept if possible.
+				remove(lru_tail[lru_transient] != npos ? lru_tail[lru_transient] : lru_tail[lru_blacklisted]);
+			}
+
+			std::uint32_t i = free_head;
+			free_head = entries[i].lru_next;
+			return i;
+		}
+
+		void remove(std::uint32_t i)
+		{
+			wheel_unlink(i);
+			remove_unlinked(i);
+		}
+
+		// the entry has been unlinked from the wheel already.
+		void remove_unlinked(std::uint32_t i)
+		{
+			entry& e = entries[i];
+			index.erase(e.addr);
+			lru_unlink(i);
+			e.used = 0;
+			e.lru_next = free_head;
+			free_head = i;
+		}
+
+	protected:
+		// the find() of the accepting threads only takes the shared lock.
+		mutable std::shared_mutex mtx;
+
+		boost::interprocess::mapped_region mapped;
+		std::vector<char> memory;
+
+		header* hdr = nullptr;
+		entry* entries = nullptr;
+
+		std::unordered_map<key_type, std::uint32_t, key_hash> index;
+
+		std::array<std::uint32_t, 2> lru_head{ npos, npos };
+		std::array<std::uint32_t, 2> lru_tail{ npos, npos };
+		std::uint32_t free_head = npos;
+
+		std::array<std::array<std::uint32_t, wheel_size>, wheel_levels> wheel;
+	};
+}
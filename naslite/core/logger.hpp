@@ -3,3 +3,28 @@
 #define SPDLOG_LEVEL_NAMES { "trace", "debug", "info", "warn", "error", "fatal", "off" }
 
 #include <asio3/core/spdlog.hpp>
+
+// the trace and debug logs below this level are removed at compile time.
+#ifndef NAS_ACTIVE_LOG_LEVEL
+#define NAS_ACTIVE_LOG_LEVEL SPDLOG_LEVEL_TRACE
+#endif
+
+// the arguments are only evaluated when the level is enabled, so it is cheap to call it
+// in the hot paths even if the arguments need to be formatted.
+#define NAS_LOG(lvl, ...) \
+	do { if (app.logger->should_log(lvl)) app.logger->log(lvl, __VA_ARGS__); } while (0)
+
+#if NAS_ACTIVE_LOG_LEVEL <= SPDLOG_LEVEL_TRACE
+#define NAS_LOG_TRACE(...) NAS_LOG(spdlog::level::trace, __VA_ARGS__)
+#else
+#define NAS_LOG_TRACE(...) (void)0
+#endif
+
+#if NAS_ACTIVE_LOG_LEVEL <= SPDLOG_LEVEL_DEBUG
+#define NAS_LOG_DEBUG(...) NAS_LOG(spdlog::level::debug, __VA_ARGS__)
+#else
+#define NAS_LOG_DEBUG(...) (void)0
+#endif
+
+#define NAS_LOG_TRACE_ENABLED() \
+	(NAS_ACTIVE_LOG_LEVEL <= SPDLOG_LEVEL_TRACE && app.logger->should_log(spdlog::level::trace))
@@ -0,0 +1,480 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <array>
+#include <bit>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <variant>
+#include <vector>
+#include <chrono>
+#include <charconv>
+
+#include "json.hpp"
+#include "noncopyable.hpp"
+
+namespace nas
+{
+	// the counters are split into cells, each thread always adds into the same cell, so the
+	// io threads never write to the same cache line, the cells are summed when exported.
+	inline constexpr std::size_t metrics_shards = 16;
+
+	inline std::size_t metrics_shard() noexcept
+	{
+		static std::atomic<std::size_t> next{ 0 };
+		thread_local std::size_t index = next.fetch_add(1, std::memory_order_relaxed) % metrics_shards;
+		return index;
+	}
+
+	class metric_counter : public noncopyable
+	{
+	public:
+		inline void add(std::uint64_t n = 1) noexcept
+		{
+			cells[metrics_shard()].value.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		std::uint64_t value() const noexcept
+		{
+			std::uint64_t total = 0;
+			for (const cell& c : cells)
+				total += c.value.load(std::memory_order_relaxed);
+			return total;
+		}
+
+	protected:
+		struct alignas(64) cell
+		{
+			std::atomic<std::uint64_t> value{ 0 };
+		};
+
+		std::array<cell, metrics_shards> cells{};
+	};
+
+	class metric_gauge : public noncopyable
+	{
+	public:
+		inline void set(std::int64_t v) noexcept
+		{
+			val.store(v, std::memory_order_relaxed);
+		}
+
+		inline void add(std::int64_t n = 1) noexcept
+		{
+			val.fetch_add(n, std::memory_order_relaxed);
+		}
+
+		inline void sub(std::int64_t n = 1) noexcept
+		{
+			val.fetch_sub(n, std::memory_order_relaxed);
+		}
+
+		std::int64_t value() const noexcept
+		{
+			return val.load(std::memory_order_relaxed);
+		}
+
+	protected:
+		alignas(64) std::atomic<std::int64_t> val{ 0 };
+	};
+
+	/**
+	 * A latency histogram in microseconds, the buckets are log-linear like the HdrHistogram:
+	 * each power of two is divided into 4 sub buckets, so the relative error is at most 25%
+	 * and a record is only a bit scan and two atomic increments.
+	 */
+	class metric_histogram : public noncopyable
+	{
+	public:
+		static constexpr std::uint32_t sub_bits = 2;
+		static constexpr std::uint32_t sub_count = 1u << sub_bits;
+		static constexpr std::uint32_t max_bit = 39; // about 12 days
+		static constexpr std::size_t   bucket_count = (max_bit - sub_bits + 2) * sub_count;
+
+		struct snapshot
+		{
+			std::array<std::uint64_t, bucket_count> buckets{};
+			std::uint64_t count = 0;
+			std::uint64_t sum = 0;
+
+			// the upper bound of the bucket which the quantile falls in.
+			std::uint64_t quantile(double q) const noexcept
+			{
+				if (count == 0)
+					return 0;
+
+				std::uint64_t rank = std::uint64_t(q * double(count) + 0.5);
+				rank = (std::max<std::uint64_t>)(rank, 1);
+
+				std::uint64_t seen = 0;
+				for (std::size_t i = 0; i < bucket_count; ++i)
+				{
+					seen += buckets[i];
+					if (seen >= rank)
+						return upper_bound(i);
+				}
+				return upper_bound(bucket_count - 1);
+			}
+		};
+
+		static constexpr std::size_t bucket_index(std::uint64_t v) noexcept
+		{
+			if (v < sub_count)
+				return std::size_t(v);
+
+			std::uint32_t msb = std::uint32_t(std::bit_width(v)) - 1;
+			if (msb > max_bit)
+				return bucket_count - 1;
+
+			std::uint64_t sub = (v >> (msb - sub_bits)) & (sub_count - 1);
+			return std::size_t(msb - sub_bits + 1) * sub_count + std::size_t(sub);
+		}
+
+		// the largest value which is counted into the bucket.
+		static constexpr std::uint64_t upper_bound(std::size_t index) noexcept
+		{
+			if (index < sub_count)
+				return index;
+
+			std::uint32_t msb = std::uint32_t(index / sub_count) + sub_bits - 1;
+			std::uint64_t sub = index % sub_count;
+			return ((sub_count + sub + 1) << (msb - sub_bits)) - 1;
+		}
+
+		inline void record(std::uint64_t us) noexcept
+		{
+			shard& s = shards[metrics_shard()];
+			s.buckets[bucket_index(us)].fetch_add(1, std::memory_order_relaxed);
+			s.sum.fetch_add(us, std::memory_order_relaxed);
+		}
+
+		template<class Rep, class Period>
+		inline void record(std::chrono::duration<Rep, Period> d) noexcept
+		{
+			auto us = std::chrono::duration_cast<std::chrono::microseconds>(d).count();
+			record(std::uint64_t(us < 0 ? 0 : us));
+		}
+
+		snapshot get_snapshot() const noexcept
+		{
+			snapshot snap;
+			for (const shard& s : shards)
+			{
+				for (std::size_t i = 0; i < bucket_count; ++i)
+					snap.buckets[i] += s.buckets[i].load(std::memory_order_relaxed);
+				snap.sum += s.sum.load(std::memory_order_relaxed);
+			}
+			for (std::uint64_t n : snap.buckets)
+				snap.count += n;
+			return snap;
+		}
+
+	protected:
+		struct alignas(64) shard
+		{
+			std::array<std::atomic<std::uint64_t>, bucket_count> buckets{};
+			std::atomic<std::uint64_t> sum{ 0 };
+		};
+
+		std::array<shard, metrics_shards> shards{};
+	};
+
+	using metric_labels = std::vector<std::pair<std::string, std::string>>;
+
+	/**
+	 * The metrics are registered once when the modulars are inited, the returned references
+	 * are valid until the program exited, so the hot paths never look up the registry.
+	 * The same name and labels always return the same metric, so the counters are continued
+	 * when the modulars are restarted.
+	 */
+	class metrics_registry : public noncopyable
+	{
+	public:
+		metric_counter& counter(std::string_view name, std::string_view help, const metric_labels& labels = {})
+		{
+			return get_or_add<metric_counter>(name, help, labels, "counter");
+		}
+
+		metric_gauge& gauge(std::string_view name, std::string_view help, const metric_labels& labels = {})
+		{
+			return get_or_add<metric_gauge>(name, help, labels, "gauge");
+		}
+
+		metric_histogram& histogram(std::string_view name, std::string_view help, const metric_labels& labels = {})
+		{
+			return get_or_add<metric_histogram>(name, help, labels, "histogram");
+		}
+
+		// the prometheus text exposition format 0.0.4, the histograms are exported in seconds.
+		std::string to_prometheus() const
+		{
+			std::string out;
+
+			std::lock_guard guard{ mtx };
+
+			for (auto& [name, f] : families)
+			{
+				out += "# HELP ";
+				out += name;
+				out += ' ';
+				out += f.help;
+				out += "\n# TYPE ";
+				out += name;
+				out += ' ';
+				out += f.type;
+				out += '\n';
+
+				for (auto& [key, s] : f.series)
+				{
+					if /**/ (auto* c = std::get_if<std::unique_ptr<metric_counter>>(std::addressof(s.metric)))
+					{
+						append_sample(out, name, "", key, "", std::to_string((*c)->value()));
+					}
+					else if (auto* g = std::get_if<std::unique_ptr<metric_gauge>>(std::addressof(s.metric)))
+					{
+						append_sample(out, name, "", key, "", std::to_string((*g)->value()));
+					}
+					else if (auto* h = std::get_if<std::unique_ptr<metric_histogram>>(std::addressof(s.metric)))
+					{
+						metric_histogram::snapshot snap = (*h)->get_snapshot();
+
+						// only the bound of each power of two is exported, the sub buckets are too many,
+						// and the bounds must be same in every scrape, so the empty buckets are exported too.
+						std::uint64_t cumulative = 0;
+						for (std::size_t i = 0; i < metric_histogram::bucket_count; ++i)
+						{
+							cumulative += snap.buckets[i];
+							if (i % metric_histogram::sub_count == metric_histogram::sub_count - 1)
+							{
+								append_sample(out, name, "_bucket", key,
+									seconds(metric_histogram::upper_bound(i)), std::to_string(cumulative));
+							}
+						}
+						append_sample(out, name, "_bucket", key, "+Inf", std::to_string(snap.count));
+						append_sample(out, name, "_sum", key, "", seconds(snap.sum));
+						append_sample(out, name, "_count", key, "", std::to_string(snap.count));
+					}
+				}
+			}
+
+			return out;
+		}
+
+		// the histograms are summarized into milliseconds for the dashboard.
+		json to_json() const
+		{
+			json j = json::object();
+
+			std::lock_guard guard{ mtx };
+
+			for (auto& [name, f] : families)
+			{
+				json rows = json::array();
+
+				for (auto& [key, s] : f.series)
+				{
+					json item = json::object();
+
+					json labels = json::object();
+					for (auto& [k, v] : s.labels)
+						labels[k] = v;
+					item["labels"] = std::move(labels);
+
+					if /**/ (auto* c = std::get_if<std::unique_ptr<metric_counter>>(std::addressof(s.metric)))
+					{
+						item["value"] = (*c)->value();
+					}
+					else if (auto* g = std::get_if<std::unique_ptr<metric_gauge>>(std::addressof(s.metric)))
+					{
+						item["value"] = (*g)->value();
+					}
+					else if (auto* h = std::get_if<std::unique_ptr<metric_histogram>>(std::addressof(s.metric)))
+					{
+						metric_histogram::snapshot snap = (*h)->get_snapshot();
+
+						item["count"] = snap.count;
+						item["avg_ms"] = snap.count ? double(snap.sum) / double(snap.count) / 1000.0 : 0.0;
+						item["p50_ms"] = double(snap.quantile(0.50)) / 1000.0;
+						item["p90_ms"] = double(snap.quantile(0.90)) / 1000.0;
+						item["p99_ms"] = double(snap.quantile(0.99)) / 1000.0;
+					}
+
+					rows.emplace_back(std::move(item));
+				}
+
+				json jf = json::object();
+				jf["type"] = f.type;
+				jf["help"] = f.help;
+				jf["series"] = std::move(rows);
+
+				j[name] = std::move(jf);
+			}
+
+			return j;
+		}
+
+	protected:
+		struct series_info
+		{
+			metric_labels labels;
+			std::variant<
+				std::unique_ptr<metric_counter>,
+				std::unique_ptr<metric_gauge>,
+				std::unique_ptr<metric_histogram>> metric;
+		};
+
+		struct family_info
+		{
+			std::string help;
+			std::string type;
+			std::map<std::string, series_info, std::less<>> series;
+		};
+
+		template<class Metric>
+		Metric& get_or_add(std::string_view name, std::string_view help, const metric_labels& labels,
+			std::string_view type)
+		{
+			std::string key = format_labels(labels);
+
+			std::lock_guard guard{ mtx };
+
+			auto it = families.find(name);
+			if (it == families.end())
+			{
+				it = families.emplace(std::string(name), family_info{ .help = std::string(help), .type = std::string(type) }).first;
+			}
+
+			family_info& f = it->second;
+
+			auto its = f.series.find(key);
+			if (its == f.series.end())
+			{
+				its = f.series.emplace(std::move(key), series_info{ .labels = labels, .metric = std::make_unique<Metric>() }).first;
+			}
+
+			// the registrations are fixed in the code, a mismatched type is a bug, so throw.
+			return *std::get<std::unique_ptr<Metric>>(its->second.metric);
+		}
+
+		static std::string format_labels(const metric_labels& labels)
+		{
+			std::string key;
+			for (auto& [k, v] : labels)
+			{
+				if (!key.empty())
+					key += ',';
+				key += k;
+				key += "=\"";
+				for (char c : v)
+				{
+					if /**/ (c == '\\') key += "\\\\";
+					else if (c == '"')  key += "\\\"";
+					else if (c == '\n') key += "\\n";
+					else                key += c;
+				}
+				key += '"';
+			}
+			return key;
+		}
+
+		static std::string seconds(std::uint64_t us)
+		{
+			std::array<char, 32> buf;
+			auto [ptr, ec] = std::to_chars(buf.data(), buf.data() + buf.size(), double(us) / 1000000.0);
+			return std::string(buf.data(), ec == std::errc{} ? ptr : buf.data());
+		}
+
+		static void append_sample(std::string& out, std::string_view name, std::string_view suffix,
+			std::string_view labels, std::string_view le, std::string_view value)
+		{
+			out += name;
+			out += suffix;
+			if (!labels.empty() || !le.empty())
+			{
+				out += '{';
+				out += labels;
+				if (!le.empty())
+				{
+					if (!labels.empty())
+						out += ',';
+					out += "le=\"";
+					out += le;
+					out += '"';
+				}
+				out += '}';
+			}
+			out += ' ';
+			out += value;
+			out += '\n';
+		}
+
+	protected:
+		mutable std::mutex mtx;
+
+		std::map<std::string, family_info, std::less<>> families;
+	};
+
+	// the references point into app.metrics, they are valid after the modular is uninited.
+	struct http_server_metrics
+	{
+		metric_counter&   requests;
+		std::array<metric_counter*, 5> responses; // 1xx 2xx 3xx 4xx 5xx
+		metric_counter&   sent_bytes;
+		metric_histogram& response_time;
+		metric_counter&   cache_hits;
+		metric_counter&   cache_misses;
+		metric_counter&   cache_evictions;
+	};
+
+	/**
+	 * @brief Register the metrics of a http server which serves the files of a webroot.
+	 * @param prefix - The prefix of the metric names, like "naslite_static_http".
+	 */
+	inline http_server_metrics make_http_server_metrics(
+		metrics_registry& r, std::string_view prefix, const metric_labels& labels)
+	{
+		auto name = [prefix](std::string_view suffix)
+		{
+			std::string s(prefix);
+			s += suffix;
+			return s;
+		};
+
+		auto responses = [&r, &labels, &name](std::string code) mutable
+		{
+			metric_labels l = labels;
+			l.emplace_back("code", std::move(code));
+			return std::addressof(r.counter(name("_responses_total"),
+				"The responses sent to the client by status class.", l));
+		};
+
+		return http_server_metrics{
+			.requests = r.counter(name("_requests_total"),
+				"The requests received from the client.", labels),
+			.responses = { responses("1xx"), responses("2xx"), responses("3xx"), responses("4xx"), responses("5xx") },
+			.sent_bytes = r.counter(name("_sent_bytes_total"),
+				"The bytes sent to the client.", labels),
+			.response_time = r.histogram(name("_response_seconds"),
+				"The time from the request was received to the response was sent.", labels),
+			.cache_hits = r.counter(name("_cache_hits_total"),
+				"The requests which were answered by the cached responses.", labels),
+			.cache_misses = r.counter(name("_cache_misses_total"),
+				"The cacheable requests which were not found in the cache.", labels),
+			.cache_evictions = r.counter(name("_cache_evictions_total"),
+				"The cached responses which were evicted for the byte budget.", labels),
+		};
+	}
+
+	inline void count_request(http_server_metrics& m, unsigned status, std::size_t sent_bytes,
+		std::chrono::steady_clock::duration elapsed) noexcept
+	{
+		m.requests.add();
+		m.responses[(std::clamp)(status / 100u, 1u, 5u) - 1]->add();
+		m.sent_bytes.add(sent_bytes);
+		m.response_time.record(elapsed);
+	}
+}
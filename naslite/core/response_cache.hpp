@@ -0,0 +1,357 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <tuple>
+#include <unordered_map>
+
+#include "net.hpp"
+#include "file_metadata.hpp"
+
+namespace nas
+{
+	/**
+	 * The response which was serialized into the bytes of http/1.1 when it was cached, a hit
+	 * is only one gathered write of the cached bytes, the header isn't serialized again and
+	 * the body isn't copied. The "Date" and the "Connection" are different in each response,
+	 * they are not cached but written between the head and the body.
+	 */
+	struct serialized_response
+	{
+		unsigned    status = 200;
+		std::string head; // the status line and the fields, without the empty line
+		std::string body;
+	};
+
+	inline std::shared_ptr<serialized_response> make_serialized_response(http::response<http::string_body> res)
+	{
+		std::shared_ptr<serialized_response> p = std::make_shared<serialized_response>();
+
+		p->status = res.result_int();
+		p->body = std::move(res.body());
+
+		std::string_view reason = res.reason();
+
+		p->head.reserve(256);
+		p->head += "HTTP/1.1 ";
+		p->head += std::to_string(p->status);
+		p->head += ' ';
+		p->head += reason;
+		p->head += "\r\n";
+
+		for (auto& field : res)
+		{
+			switch (field.name())
+			{
+			case http::field::date:
+			case http::field::connection:
+			case http::field::keep_alive:
+			case http::field::content_length:
+			case http::field::transfer_encoding:
+				continue;
+			default:
+				break;
+			}
+
+			p->head += field.name_string();
+			p->head += ": ";
+			p->head += field.value();
+			p->head += "\r\n";
+		}
+
+		p->head += "Content-Length: ";
+		p->head += std::to_string(p->body.size());
+		p->head += "\r\n";
+
+		return p;
+	}
+
+	// the date is formatted once per second in each thread.
+	inline std::string_view current_http_date()
+	{
+		thread_local std::chrono::system_clock::time_point last{};
+		thread_local std::string date;
+
+		auto now = std::chrono::floor<std::chrono::seconds>(std::chrono::system_clock::now());
+		if (now != last || date.empty())
+		{
+			last = now;
+			date = format_http_date(now);
+		}
+
+		return date;
+	}
+
+	/**
+	 * @brief Write the cached response, the head, the fields of this request and the body are
+	 *    sent by one gathered write.
+	 * @param rep - It must be kept alive until the write is finished.
+	 * @return (error, sent_bytes, status)
+	 */
+	net::awaitable<std::tuple<net::error_code, std::size_t, unsigned>> async_write_serialized_response(
+		auto& stream, http::web_request& req, const serialized_response& rep)
+	{
+		static constexpr std::string_view http10 = "HTTP/1.0";
+
+		// the cached head always starts with "HTTP/1.1", it is replaced for the http/1.0 clients.
+		std::string_view head = rep.head;
+		std::string_view version = head.substr(0, http10.size());
+		if (req.version() == 10)
+			version = http10;
+		head.remove_prefix(version.size());
+
+		// it is in the frame of this coroutine, so it is valid until the write is finished.
+		std::string fields;
+		fields.reserve(80);
+		fields += "Date: ";
+		fields += current_http_date();
+		fields += req.keep_alive() ? "\r\nConnection: keep-alive\r\n\r\n" : "\r\nConnection: close\r\n\r\n";
+
+		std::array<net::const_buffer, 4> buffers{
+			net::buffer(version), net::buffer(head), net::buffer(fields), net::buffer(rep.body) };
+
+		auto [e1, n1] = co_await net::async_write(stream, buffers, net::use_nothrow_awaitable);
+		co_return std::tuple{ e1, n1, rep.status };
+	}
+
+	/**
+	 * The cached responses of a http server, it is bounded by the total bytes of the responses,
+	 * not by the count.
+	 * The entries are split into shards by the hash of the target, each shard has its own lock,
+	 * lru list and byte budget, so the worker threads rarely wait for each other, and a find or
+	 * an add is O(1), the least recently used entries of the shard are evicted one by one.
+	 */
+	class response_cache
+	{
+	public:
+		// the response is immutable after it was added, it may be written by several sessions
+		// at the same time, and it is kept alive by the sessions after it was evicted.
+		using response_ptr = std::shared_ptr<const serialized_response>;
+
+		struct options
+		{
+			std::uint64_t max_size = 64 * 1024 * 1024; // the total bytes of all the entries
+			std::uint64_t max_object_size = 1024 * 1024; // the responses with larger body are not cached
+			std::chrono::steady_clock::duration ttl{}; // zero means the entries never expire
+		};
+
+		struct statistics
+		{
+			std::uint64_t hits = 0;
+			std::uint64_t misses = 0;
+			std::uint64_t evictions = 0;
+			std::uint64_t expirations = 0;
+			std::uint64_t count = 0;
+			std::uint64_t size = 0;
+		};
+
+		static constexpr std::size_t shard_count = 16;
+
+		response_cache() : response_cache(options{})
+		{
+		}
+
+		explicit response_cache(options opt) : opt(opt)
+		{
+		}
+
+		response_ptr find(std::string_view target)
+		{
+			shard& s = shard_of(target);
+
+			std::lock_guard guard(s.mtx);
+
+			auto it = s.map.find(target);
+			if (it == s.map.end())
+			{
+				s.stats.misses++;
+				return nullptr;
+			}
+
+			auto pos = it->second;
+
+			if (pos->expires != std::chrono::steady_clock::time_point{} &&
+				pos->expires <= std::chrono::steady_clock::now())
+			{
+				s.stats.misses++;
+				s.stats.expirations++;
+				s.erase(it);
+				return nullptr;
+			}
+
+			s.stats.hits++;
+
+			// move to the front of the lru list, no allocation.
+			s.lru.splice(s.lru.begin(), s.lru, pos);
+
+			return pos->rep;
+		}
+
+		/**
+		 * @brief Add the response, the old one of the same target is replaced.
+		 * @return The count of the entries which were evicted for it.
+		 */
+		std::size_t add(std::string_view target, response_ptr rep)
+		{
+			std::uint64_t bytes = response_size(target, *rep);
+
+			// a single shard can't hold more than its part of the budget.
+			if (rep->body.size() > opt.max_object_size || bytes > opt.max_size / shard_count)
+				return 0;
+
+			shard& s = shard_of(target);
+
+			std::lock_guard guard(s.mtx);
+
+			if (auto it = s.map.find(target); it != s.map.end())
+				s.erase(it);
+
+			std::chrono::steady_clock::time_point expires{};
+			if (opt.ttl.count() > 0)
+				expires = std::chrono::steady_clock::now() + opt.ttl;
+
+			s.lru.emplace_front(std::string(target), std::move(rep), bytes, expires);
+			s.map.emplace(std::string_view(s.lru.front().target), s.lru.begin());
+			s.size += bytes;
+
+			std::size_t evicted = 0;
+
+			while (s.size > opt.max_size / shard_count)
+			{
+				s.erase(s.map.find(std::string_view(s.lru.back().target)));
+				s.stats.evictions++;
+				evicted++;
+			}
+
+			return evicted;
+		}
+
+		void erase(std::string_view target)
+		{
+			shard& s = shard_of(target);
+
+			std::lock_guard guard(s.mtx);
+
+			if (auto it = s.map.find(target); it != s.map.end())
+				s.erase(it);
+		}
+
+		/**
+		 * @brief Erase the entries whose target is matched, each shard is locked in turn.
+		 * @return The count of the erased entries.
+		 */
+		std::size_t erase_if(auto pred)
+		{
+			std::size_t count = 0;
+
+			for (shard& s : shards)
+			{
+				std::lock_guard guard(s.mtx);
+
+				for (auto it = s.map.begin(); it != s.map.end();)
+				{
+					if (pred(it->first))
+					{
+						auto next = std::next(it);
+						s.erase(it);
+						it = next;
+						count++;
+					}
+					else
+					{
+						++it;
+					}
+				}
+			}
+
+			return count;
+		}
+
+		void clear()
+		{
+			for (shard& s : shards)
+			{
+				std::lock_guard guard(s.mtx);
+
+				s.map.clear();
+				s.lru.clear();
+				s.size = 0;
+			}
+		}
+
+		statistics get_statistics()
+		{
+			statistics total{};
+
+			for (shard& s : shards)
+			{
+				std::lock_guard guard(s.mtx);
+
+				total.hits += s.stats.hits;
+				total.misses += s.stats.misses;
+				total.evictions += s.stats.evictions;
+				total.expirations += s.stats.expirations;
+				total.count += s.map.size();
+				total.size += s.size;
+			}
+
+			return total;
+		}
+
+		// the head and the key are counted too, they are not small for the small files.
+		static std::uint64_t response_size(std::string_view target, const serialized_response& rep) noexcept
+		{
+			return 128 + target.size() * 2 + rep.head.size() + rep.body.size();
+		}
+
+	protected:
+		struct entry
+		{
+			std::string target;
+			response_ptr rep;
+			std::uint64_t size = 0;
+			std::chrono::steady_clock::time_point expires;
+
+			entry(std::string t, response_ptr r, std::uint64_t n, std::chrono::steady_clock::time_point e)
+				: target(std::move(t)), rep(std::move(r)), size(n), expires(e)
+			{
+			}
+		};
+
+		// the keys of the map point into the targets of the lru list entries.
+		struct alignas(64) shard
+		{
+			using map_type = std::unordered_map<std::string_view, std::list<entry>::iterator>;
+
+			std::mutex mtx;
+			std::list<entry> lru;
+			map_type map;
+			std::uint64_t size = 0;
+			statistics stats{};
+
+			void erase(map_type::iterator it)
+			{
+				auto pos = it->second;
+				size -= pos->size;
+				map.erase(it);
+				lru.erase(pos);
+			}
+		};
+
+		// the high bits are used, the buckets of the map in the shard are selected by the low bits.
+		shard& shard_of(std::string_view target) noexcept
+		{
+			std::uint64_t h = std::uint64_t(std::hash<std::string_view>{}(target)) * 0x9e3779b97f4a7c15ull;
+			return shards[std::size_t(h >> 32) % shard_count];
+		}
+
+		options opt;
+
+		std::array<shard, shard_count> shards{};
+	};
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cerrno>
+#include <tuple>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/tcp/core.hpp>
+
+#if ASIO3_OS_LINUX
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace nas
+{
+#if ASIO3_OS_LINUX
+	/**
+	 * The data is moved from the socket into the pipe, then from the pipe into the other
+	 * socket by splice(), so it never be copied into the user space.
+	 */
+	class splice_pipe : public noncopyable
+	{
+	public:
+		splice_pipe() noexcept
+		{
+			if (::pipe2(fds, O_CLOEXEC | O_NONBLOCK) != 0)
+			{
+				fds[0] = -1;
+				fds[1] = -1;
+			}
+		}
+
+		~splice_pipe()
+		{
+			if (fds[0] != -1)
+				::close(fds[0]);
+			if (fds[1] != -1)
+				::close(fds[1]);
+		}
+
+		inline bool is_open() const noexcept
+		{
+			return fds[0] != -1 && fds[1] != -1;
+		}
+
+		inline int read_fd() const noexcept
+		{
+			return fds[0];
+		}
+
+		inline int write_fd() const noexcept
+		{
+			return fds[1];
+		}
+
+	protected:
+		int fds[2];
+	};
+
+	/**
+	 * @brief Transfer the data from one socket to the other until error or eof.
+	 * @param pipe - The opened pipe which the data is moved through.
+	 * @param from - The socket to read from.
+	 * @param to - The socket to write to.
+	 * @param on_transferred - Called with the bytes count after each piece of data was moved,
+	 *    return false to stop the transfer.
+	 * @return (error, transferred_bytes), the error is eof when the peer closed normally.
+	 */
+	net::awaitable<std::tuple<net::error_code, std::size_t>> async_splice_transfer(
+		splice_pipe& pipe, net::tcp_socket& from, net::tcp_socket& to, auto&& on_transferred)
+	{
+		constexpr std::size_t splice_size = 64 * 1024;
+		constexpr unsigned int splice_flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+
+		std::size_t total = 0;
+
+		net::error_code ec{};
+
+		// splice() may block on the sockets even if SPLICE_F_NONBLOCK is used.
+		from.native_non_blocking(true, ec);
+		if (!ec)
+			to.native_non_blocking(true, ec);
+		if (ec)
+			co_return std::tuple{ ec, total };
+
+		for (;;)
+		{
+			ssize_t n = ::splice(from.native_handle(), nullptr, pipe.write_fd(), nullptr,
+				splice_size, splice_flags);
+			if (n == 0)
+				co_return std::tuple{ net::error_code(net::error::eof), total };
+
+			if (n < 0)
+			{
+				if (errno == EINTR)
+					continue;
+
+				// the pipe is always drained below, so EAGAIN means the socket has nothing to read.
+				if (errno == EAGAIN || errno == EWOULDBLOCK)
+				{
+					auto [e1] = co_await from.async_wait(net::socket_base::wait_read, net::use_nothrow_awaitable);
+					if (e1)
+						co_return std::tuple{ e1, total };
+					continue;
+				}
+
+				co_return std::tuple{ net::error_code(errno, net::error::get_system_category()), total };
+			}
+
+			for (std::size_t pending = std::size_t(n); pending > 0;)
+			{
+				ssize_t m = ::splice(pipe.read_fd(), nullptr, to.native_handle(), nullptr,
+					pending, splice_flags);
+				if (m < 0)
+				{
+					if (errno == EINTR)
+						continue;
+
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+					{
+						auto [e2] = co_await to.async_wait(net::socket_base::wait_write, net::use_nothrow_awaitable);
+						if (e2)
+							co_return std::tuple{ e2, total };
+						continue;
+					}
+
+					co_return std::tuple{ net::error_code(errno, net::error::get_system_category()), total };
+				}
+
+				pending -= std::size_t(m);
+			}
+
+			total += std::size_t(n);
+
+			if (!on_transferred(std::size_t(n)))
+				co_return std::tuple{ net::error_code(net::error::operation_aborted), total };
+		}
+	}
+#endif
+}
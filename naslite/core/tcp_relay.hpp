@@ -0,0 +1,112 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <tuple>
+
+#include "net.hpp"
+#include "splice.hpp"
+#include "buffer_pool.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/tcp/core.hpp>
+
+namespace nas
+{
+	/**
+	 * The bytes which were relayed in each direction, they are only written by the relay and
+	 * read by the watchdog of the same session, both are in the same thread.
+	 */
+	struct relay_counters
+	{
+		std::uint64_t client_to_server = 0;
+		std::uint64_t server_to_client = 0;
+
+		inline std::uint64_t total() const noexcept
+		{
+			return client_to_server + server_to_client;
+		}
+	};
+
+	/**
+	 * @brief Relay the data from one socket to the other until error or eof. The data is moved
+	 *    by splice() in the kernel on linux, otherwise it is copied through a large pooled
+	 *    buffer, so each syscall moves up to 64KB instead of a small stack buffer.
+	 *    The clock isn't read for each piece of data, the idle time is checked by the
+	 *    async_relay_watchdog from the transferred bytes.
+	 * @param transferred - The bytes count of this direction, it is increased after each piece.
+	 * @return (error, transferred_bytes), the error is eof when the peer closed normally.
+	 */
+	inline net::awaitable<std::tuple<net::error_code, std::uint64_t>> async_relay(
+		net::tcp_socket& from, net::tcp_socket& to, std::uint64_t& transferred)
+	{
+	#if ASIO3_OS_LINUX
+		if (splice_pipe pipe; pipe.is_open())
+		{
+			auto [e1, n1] = co_await async_splice_transfer(pipe, from, to, [&transferred](std::size_t n) mutable
+			{
+				transferred += n;
+				return true;
+			});
+			co_return std::tuple{ e1, std::uint64_t(n1) };
+		}
+	#endif
+
+		pooled_buffer buffer;
+
+		std::uint64_t total = 0;
+
+		for (;;)
+		{
+			auto [e1, n1] = co_await from.async_read_some(buffer.buffer(), net::use_nothrow_awaitable);
+			if (e1)
+				co_return std::tuple{ e1, total };
+
+			auto [e2, n2] = co_await net::async_write(to, buffer.buffer(n1), net::use_nothrow_awaitable);
+			total += n2;
+			transferred += n2;
+			if (e2)
+				co_return std::tuple{ e2, total };
+		}
+	}
+
+	/**
+	 * @brief Wait until no data was relayed in the idle timeout. The counters are sampled
+	 *    several times in each idle timeout, and the alive time is only updated when they were
+	 *    changed, so the session is closed between 1 and 1.25 idle timeouts after it was idle.
+	 * @param on_sampled - void(const relay_counters&), it is called after each sample, the
+	 *    metrics can be flushed in it.
+	 */
+	net::awaitable<void> async_relay_watchdog(
+		const relay_counters& counters, std::chrono::system_clock::time_point& alive_time,
+		std::chrono::system_clock::duration idle_timeout, auto&& on_sampled)
+	{
+		net::steady_timer timer(co_await net::this_coro::executor);
+
+		std::uint64_t last_total = counters.total();
+
+		alive_time = std::chrono::system_clock::now();
+
+		for (;;)
+		{
+			timer.expires_after(idle_timeout / 4);
+			auto [e1] = co_await timer.async_wait(net::use_nothrow_awaitable);
+			if (e1)
+				co_return;
+
+			auto now = std::chrono::system_clock::now();
+
+			on_sampled(counters);
+
+			if (std::uint64_t total = counters.total(); total != last_total)
+			{
+				last_total = total;
+				alive_time = now;
+			}
+			else if (now - alive_time >= idle_timeout)
+			{
+				co_return;
+			}
+		}
+	}
+}
@@ -0,0 +1,385 @@
+#pragma once
+
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <tuple>
+#include <vector>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/udp/core.hpp>
+
+#if ASIO3_OS_LINUX
+#include <netinet/in.h>
+#include <netinet/udp.h>
+#include <sys/socket.h>
+#endif
+
+namespace nas
+{
+	/**
+	 * The datagrams are received and sent in batches, up to batch_size datagrams are received
+	 * by one recvmmsg() and the forwarded ones are sent by one sendmmsg() on linux, the runs
+	 * of the same size to the same endpoint are sent as one gso message if it is supported.
+	 * Each datagram is received into its own slot, and there is a head room before the slot,
+	 * so a header can be prepended in place, the payload is never copied.
+	 * The other platforms receive and send one datagram each time.
+	 */
+	class udp_batch : public noncopyable
+	{
+	public:
+		static constexpr std::size_t batch_size = 16;
+
+		// larger than the jumbo frame, the larger datagrams are dropped, never truncated.
+		static constexpr std::size_t slot_size = 9216;
+
+		// the longest socks5 udp header: RSV(2) FRAG(1) ATYP(1) LEN(1) DOMAIN(255) PORT(2)
+		static constexpr std::size_t head_room = 262;
+
+		struct datagram
+		{
+			net::ip::udp::endpoint endpoint; // the sender
+			char*       data = nullptr;
+			std::size_t size = 0;
+			bool        truncated = false; // it was larger than the slot
+		};
+
+		udp_batch() : memory(std::make_unique_for_overwrite<char[]>(batch_size * (head_room + slot_size)))
+		{
+			pending.reserve(batch_size);
+		}
+
+		// the datagrams of the last receive, they are valid until the next receive.
+		inline std::span<datagram> received() noexcept
+		{
+			return std::span<datagram>(datagrams.data(), count);
+		}
+
+		/**
+		 * @brief Write the header before the data of the received datagram.
+		 * @return The begin of the header, the header and the data are continuous.
+		 */
+		inline char* prepend(datagram& d, const void* head, std::size_t n) noexcept
+		{
+			std::size_t room = std::size_t(d.data - slot_begin(d));
+			if (n > room)
+				return nullptr;
+
+			d.data -= n;
+			d.size += n;
+			std::memcpy(d.data, head, n);
+			return d.data;
+		}
+
+		/**
+		 * @brief Queue a datagram to be sent by the next flush, the data must be valid until the
+		 *    flush, it is usually a part of a received datagram.
+		 * @return False if batch_size datagrams were queued already, it must be flushed first.
+		 */
+		inline bool add(const net::ip::udp::endpoint& endpoint, const char* data, std::size_t size)
+		{
+			if (pending.size() >= batch_size)
+				return false;
+
+			pending.emplace_back(outgoing{ endpoint, data, size });
+			return true;
+		}
+
+		inline std::size_t pending_count() const noexcept
+		{
+			return pending.size();
+		}
+
+		// the datagrams which failed to be sent, they are dropped like the network does.
+		inline std::size_t dropped_count() const noexcept
+		{
+			return dropped;
+		}
+
+		/**
+		 * @brief Wait until the socket is readable, then receive the datagrams which are ready.
+		 * @return (error, received_count)
+		 */
+		net::awaitable<std::tuple<net::error_code, std::size_t>> async_receive(net::udp_socket& sock)
+		{
+			count = 0;
+
+		#if ASIO3_OS_LINUX
+			net::error_code ec{};
+			sock.native_non_blocking(true, ec);
+			if (ec)
+				co_return std::tuple{ ec, std::size_t(0) };
+
+			for (std::size_t i = 0; i < batch_size; ++i)
+			{
+				datagram& d = datagrams[i];
+				d.data = slot_data(i);
+
+				iovs[i].iov_base = d.data;
+				iovs[i].iov_len = slot_size;
+
+				std::memset(std::addressof(msgs[i]), 0, sizeof(msgs[i]));
+				msgs[i].msg_hdr.msg_name = d.endpoint.data();
+				msgs[i].msg_hdr.msg_namelen = socklen_t(d.endpoint.capacity());
+				msgs[i].msg_hdr.msg_iov = std::addressof(iovs[i]);
+				msgs[i].msg_hdr.msg_iovlen = 1;
+			}
+
+			for (;;)
+			{
+				int n = ::recvmmsg(sock.native_handle(), msgs.data(), unsigned(batch_size), MSG_DONTWAIT, nullptr);
+				if (n < 0)
+				{
+					if (errno == EINTR)
+						continue;
+
+					if (errno == EAGAIN || errno == EWOULDBLOCK)
+					{
+						auto [e1] = co_await sock.async_wait(net::socket_base::wait_read, net::use_nothrow_awaitable);
+						if (e1)
+							co_return std::tuple{ e1, std::size_t(0) };
+						continue;
+					}
+
+					co_return std::tuple{ net::error_code(errno, net::error::get_system_category()), std::size_t(0) };
+				}
+
+				for (int i = 0; i < n; ++i)
+				{
+					datagram& d = datagrams[i];
+					d.endpoint.resize(msgs[i].msg_hdr.msg_namelen);
+					d.size = msgs[i].msg_len;
+					d.truncated = (msgs[i].msg_hdr.msg_flags & MSG_TRUNC) != 0;
+				}
+
+				count = std::size_t(n);
+
+				co_return std::tuple{ net::error_code{}, count };
+			}
+		#else
+			datagram& d = datagrams[0];
+			d.data = slot_data(0);
+
+			// the datagram which is larger than the buffer is an error on windows.
+			auto [e1, n1] = co_await sock.async_receive_from(
+				net::buffer(d.data, slot_size), d.endpoint, net::use_nothrow_awaitable);
+			if (e1 == net::error::message_size)
+			{
+				d.size = 0;
+				d.truncated = true;
+				count = 1;
+				co_return std::tuple{ net::error_code{}, count };
+			}
+			if (e1)
+				co_return std::tuple{ e1, std::size_t(0) };
+
+			d.size = n1;
+			d.truncated = false;
+			count = 1;
+
+			co_return std::tuple{ e1, count };
+		#endif
+		}
+
+		/**
+		 * @brief Send all the queued datagrams, a datagram which can't be sent is dropped, only
+		 *    the error of the socket itself is returned.
+		 * @return (error, sent_bytes)
+		 */
+		net::awaitable<std::tuple<net::error_code, std::size_t>> async_flush(net::udp_socket& sock)
+		{
+			std::size_t sent = 0;
+
+		#if ASIO3_OS_LINUX
+			std::size_t first = 0;
+
+			while (first < pending.size())
+			{
+				std::size_t n = build_messages(first);
+
+				int r = ::sendmmsg(sock.native_handle(), msgs.data(), unsigned(n), MSG_DONTWAIT);
+				if (r > 0)
+				{
+					for (int i = 0; i < r; ++i)
+					{
+						first += covers[i];
+						sent += msgs[i].msg_len;
+					}
+					continue;
+				}
+
+				int err = (r == 0 ? EAGAIN : errno);
+
+				if (err == EINTR)
+					continue;
+
+				if (err == EAGAIN || err == EWOULDBLOCK)
+				{
+					auto [e1] = co_await sock.async_wait(net::socket_base::wait_write, net::use_nothrow_awaitable);
+					if (e1)
+					{
+						pending.clear();
+						co_return std::tuple{ e1, sent };
+					}
+					continue;
+				}
+
+				// the gso isn't supported by the kernel or the device, or the size is larger than
+				// the mtu, send the datagrams one by one since now.
+				if (covers[0] > 1 && (err == EINVAL || err == EIO || err == ENOPROTOOPT || err == EMSGSIZE))
+				{
+					gso = false;
+					continue;
+				}
+
+				if (err == EBADF || err == ENOTSOCK)
+				{
+					pending.clear();
+					co_return std::tuple{ net::error_code(err, net::error::get_system_category()), sent };
+				}
+
+				// like the icmp unreachable or the too large datagram, only this one is dropped.
+				first += covers[0];
+				dropped += covers[0];
+			}
+		#else
+			for (outgoing& o : pending)
+			{
+				auto [e1, n1] = co_await sock.async_send_to(
+					net::buffer(o.data, o.size), o.endpoint, net::use_nothrow_awaitable);
+				if (e1 == net::error::operation_aborted || e1 == net::error::bad_descriptor)
+				{
+					pending.clear();
+					co_return std::tuple{ e1, sent };
+				}
+				if (e1)
+					dropped++;
+				sent += n1;
+			}
+		#endif
+
+			pending.clear();
+
+			co_return std::tuple{ net::error_code{}, sent };
+		}
+
+	protected:
+		struct outgoing
+		{
+			net::ip::udp::endpoint endpoint;
+			const char* data = nullptr;
+			std::size_t size = 0;
+		};
+
+		inline char* slot_data(std::size_t i) noexcept
+		{
+			return memory.get() + i * (head_room + slot_size) + head_room;
+		}
+
+		inline char* slot_begin(const datagram& d) noexcept
+		{
+			std::size_t i = std::size_t(std::addressof(d) - datagrams.data());
+			return memory.get() + i * (head_room + slot_size);
+		}
+
+	#if ASIO3_OS_LINUX
+		/**
+		 * Build the messages of the pending datagrams from the first one, each message is one
+		 * datagram, or a gso run: the datagrams of the same size to the same endpoint, the last
+		 * one of the run may be smaller.
+		 * @return The count of the messages.
+		 */
+		std::size_t build_messages(std::size_t first) noexcept
+		{
+			std::size_t m = 0;
+
+			for (std::size_t j = first; j < pending.size() && m < batch_size; ++m)
+			{
+				std::size_t k = j + 1;
+
+			#if defined(UDP_SEGMENT)
+				if (gso)
+				{
+					std::size_t total = pending[j].size;
+					while (k < pending.size() && k - j < max_gso_segments &&
+						pending[k].endpoint == pending[j].endpoint &&
+						pending[k - 1].size == pending[j].size &&
+						pending[k].size <= pending[j].size &&
+						total + pending[k].size <= max_gso_bytes)
+					{
+						total += pending[k].size;
+						++k;
+					}
+				}
+			#endif
+
+				for (std::size_t i = j; i < k; ++i)
+				{
+					iovs[i - first].iov_base = const_cast<char*>(pending[i].data);
+					iovs[i - first].iov_len = pending[i].size;
+				}
+
+				mmsghdr& h = msgs[m];
+				std::memset(std::addressof(h), 0, sizeof(h));
+				h.msg_hdr.msg_name = const_cast<void*>(static_cast<const void*>(pending[j].endpoint.data()));
+				h.msg_hdr.msg_namelen = socklen_t(pending[j].endpoint.size());
+				h.msg_hdr.msg_iov = std::addressof(iovs[j - first]);
+				h.msg_hdr.msg_iovlen = k - j;
+
+			#if defined(UDP_SEGMENT)
+				if (k - j > 1)
+				{
+					h.msg_hdr.msg_control = controls[m].data;
+					h.msg_hdr.msg_controllen = sizeof(controls[m].data);
+
+					cmsghdr* cm = CMSG_FIRSTHDR(std::addressof(h.msg_hdr));
+					cm->cmsg_level = SOL_UDP;
+					cm->cmsg_type = UDP_SEGMENT;
+					cm->cmsg_len = CMSG_LEN(sizeof(std::uint16_t));
+
+					std::uint16_t segment = std::uint16_t(pending[j].size);
+					std::memcpy(CMSG_DATA(cm), std::addressof(segment), sizeof(segment));
+				}
+			#endif
+
+				covers[m] = k - j;
+
+				j = k;
+			}
+
+			return m;
+		}
+
+		static constexpr std::size_t max_gso_segments = 64;
+		static constexpr std::size_t max_gso_bytes = 65507;
+
+		std::array<mmsghdr, batch_size> msgs{};
+		std::array<iovec, batch_size> iovs{};
+		std::array<std::size_t, batch_size> covers{};
+
+		struct alignas(cmsghdr) control_buffer
+		{
+			char data[CMSG_SPACE(sizeof(std::uint16_t))];
+		};
+
+		std::array<control_buffer, batch_size> controls{};
+	#endif
+
+		std::unique_ptr<char[]> memory;
+
+		std::array<datagram, batch_size> datagrams{};
+
+		std::size_t count = 0;
+
+		std::vector<outgoing> pending;
+
+		std::size_t dropped = 0;
+
+		bool gso = true;
+	};
+}
@@ -0,0 +1,382 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "net.hpp"
+#include "noncopyable.hpp"
+#include "udp_batch.hpp"
+
+#include <asio3/udp/core.hpp>
+
+namespace nas
+{
+	/**
+	 * All the udp associations of a thread share a small pool of udp sockets, like a nat.
+	 * The client sends its datagrams to the front socket which was advertised in the reply of
+	 * the udp associate, the datagrams to a remote are sent by a socket which isn't used by any
+	 * other association for the same remote, so the replies of the remote are mapped back to
+	 * the association by (socket, remote endpoint). The mappings are expired when they are
+	 * idle, a new socket is opened only when all the sockets were mapped for the same remote.
+	 * All the functions must be called in the thread of the table.
+	 */
+	class udp_nat_table : public noncopyable
+	{
+	public:
+		using time_point = std::chrono::steady_clock::time_point;
+
+		struct options
+		{
+			std::size_t front_count = 4; // the sockets of each ip protocol which the clients send to
+			std::size_t max_count = 64;  // the max sockets of each ip protocol
+			std::chrono::steady_clock::duration idle_timeout = std::chrono::seconds(60);
+		};
+
+		struct shared_socket
+		{
+			explicit shared_socket(const net::any_io_executor& ex) : sock(ex)
+			{
+			}
+
+			net::udp_socket sock;
+			udp_batch batch;
+			net::ip::udp::endpoint local_endpoint;
+		};
+
+		struct association
+		{
+			// the port is 0 until the first datagram is received, unless the client is on the
+			// loopback and declared its port.
+			net::ip::udp::endpoint client;
+
+			// the index of the socket which the client sends to.
+			std::size_t front = 0;
+
+			// it is updated when a datagram of this association is relayed.
+			std::chrono::system_clock::time_point* alive_time = nullptr;
+
+			// the replies are written to the tcp connection when the client used the extension protocol.
+			bool over_tcp = false;
+			std::deque<std::string> tcp_outbox;
+			net::steady_timer* tcp_notify = nullptr;
+
+			// the keys of the remote mappings, they are erased with the association.
+			std::vector<std::pair<std::size_t, net::ip::udp::endpoint>> remotes;
+		};
+
+		/**
+		 * The bound socket type of the udp associate, it doesn't open a socket, one of the front
+		 * sockets of the table of this thread is selected, and its port is sent to the client.
+		 */
+		class binding
+		{
+		public:
+			binding(const auto& executor, const net::ip::udp::endpoint& endpoint)
+			{
+				std::ignore = executor;
+
+				udp_nat_table* table = current();
+				if (!table)
+					throw net::system_error(net::error::operation_not_supported);
+
+				index = table->select_front(endpoint.protocol());
+				local = table->socket(index).local_endpoint;
+			}
+
+			inline net::ip::udp::endpoint local_endpoint() const noexcept
+			{
+				return local;
+			}
+
+			std::size_t index = 0;
+			net::ip::udp::endpoint local;
+		};
+
+		// the ipv4 endpoint is converted to the v4 mapped address for the ipv6 socket.
+		static net::ip::udp::endpoint as_protocol(const net::ip::udp::endpoint& endpoint, const net::ip::udp& protocol)
+		{
+			if (protocol == net::ip::udp::v6() && endpoint.address().is_v4())
+				return { net::ip::make_address_v6(net::ip::v4_mapped, endpoint.address().to_v4()), endpoint.port() };
+			return endpoint;
+		}
+
+		// the table of this thread, the binding can only get it from here.
+		static udp_nat_table*& current() noexcept
+		{
+			static thread_local udp_nat_table* table = nullptr;
+			return table;
+		}
+
+		/**
+		 * @param on_opened - void(std::size_t index), it is called when a socket is opened, the
+		 *    receive loop of the socket should be started in it.
+		 */
+		udp_nat_table(const net::any_io_executor& ex, options opts, std::function<void(std::size_t)> on_opened)
+			: executor(ex), opts(opts), on_opened(std::move(on_opened))
+		{
+		}
+
+		inline shared_socket& socket(std::size_t index) noexcept
+		{
+			return *sockets[index];
+		}
+
+		inline std::size_t socket_count() const noexcept
+		{
+			return sockets.size();
+		}
+
+		/**
+		 * @brief Select a front socket for a new association, they are selected in turn, and
+		 *    opened when they are selected at the first time.
+		 * @return The index of the socket, it throws the system_error if it can't be opened.
+		 */
+		std::size_t select_front(const net::ip::udp& protocol)
+		{
+			std::vector<std::size_t>& group = (protocol == net::ip::udp::v6() ? v6 : v4);
+			std::size_t& turn = (protocol == net::ip::udp::v6() ? v6_turn : v4_turn);
+
+			std::size_t n = (std::max)(opts.front_count, std::size_t(1));
+
+			if (group.size() < n && turn >= group.size())
+			{
+				net::error_code ec{};
+				std::optional<std::size_t> index = open(protocol, ec);
+				if (!index)
+					throw net::system_error(ec);
+				turn = (turn + 1) % n;
+				return *index;
+			}
+
+			std::size_t index = group[turn % group.size()];
+			turn = (turn + 1) % n;
+			return index;
+		}
+
+		void add(const std::shared_ptr<association>& a)
+		{
+			if (a->client.port() != 0)
+				clients[a->client] = a;
+			else
+				unlearned.emplace(a->client.address(), a);
+		}
+
+		void remove(association& a)
+		{
+			if (auto it = clients.find(a.client); it != clients.end() && it->second.get() == std::addressof(a))
+				clients.erase(it);
+
+			for (auto [it, end] = unlearned.equal_range(a.client.address()); it != end; ++it)
+			{
+				if (it->second.get() == std::addressof(a))
+				{
+					unlearned.erase(it);
+					break;
+				}
+			}
+
+			for (auto& [index, endpoint] : a.remotes)
+			{
+				remotes.erase(remote_key{ endpoint, index });
+			}
+
+			a.remotes.clear();
+		}
+
+		/**
+		 * @brief Find the association which the datagram is sent from its client. The client
+		 *    without the port is learned by its first datagram, if several of them were from
+		 *    the same address, the oldest one is learned.
+		 */
+		association* find_client(std::size_t index, const net::ip::udp::endpoint& sender)
+		{
+			if (auto it = clients.find(sender); it != clients.end())
+				return it->second->front == index ? it->second.get() : nullptr;
+
+			for (auto [it, end] = unlearned.equal_range(sender.address()); it != end; ++it)
+			{
+				if (it->second->front != index)
+					continue;
+
+				std::shared_ptr<association> a = std::move(it->second);
+				unlearned.erase(it);
+
+				a->client.port(sender.port());
+				clients[sender] = a;
+				return a.get();
+			}
+
+			return nullptr;
+		}
+
+		// find the association which the datagram is a reply of its remote.
+		association* find_remote(std::size_t index, const net::ip::udp::endpoint& sender, time_point now)
+		{
+			auto it = remotes.find(remote_key{ sender, index });
+			if (it == remotes.end())
+				return nullptr;
+
+			it->second.used_time = now;
+			return it->second.owner;
+		}
+
+		/**
+		 * @brief Get the socket which the datagrams of the association to the remote are sent by,
+		 *    the front socket is preferred, so the datagrams are usually relayed by one socket.
+		 * @param remote - The ipv4 remote is converted to the v4 mapped address if the sockets are
+		 *    ipv6, the replies are received from the mapped address, so the key must be same.
+		 * @return The index of the socket, or nullopt if no socket can be used.
+		 */
+		std::optional<std::size_t> map_remote(association& a, net::ip::udp::endpoint& remote, time_point now)
+		{
+			net::ip::udp protocol = sockets[a.front]->local_endpoint.protocol();
+
+			remote = as_protocol(remote, protocol);
+
+			if (std::optional<std::size_t> index = try_map(a, a.front, remote, now); index)
+				return index;
+
+			for (std::size_t index : (protocol == net::ip::udp::v6() ? v6 : v4))
+			{
+				if (index == a.front)
+					continue;
+
+				if (std::optional<std::size_t> r = try_map(a, index, remote, now); r)
+					return r;
+			}
+
+			if ((protocol == net::ip::udp::v6() ? v6 : v4).size() >= opts.max_count)
+				return std::nullopt;
+
+			net::error_code ec{};
+			std::optional<std::size_t> index = open(protocol, ec);
+			if (!index)
+				return std::nullopt;
+
+			return try_map(a, *index, remote, now);
+		}
+
+		// erase the mappings which are idle, it is called by a timer each second.
+		void expire(time_point now)
+		{
+			for (auto it = remotes.begin(); it != remotes.end();)
+			{
+				if (now - it->second.used_time < opts.idle_timeout)
+				{
+					++it;
+					continue;
+				}
+
+				std::erase(it->second.owner->remotes, std::pair{ it->first.index, it->first.endpoint });
+				it = remotes.erase(it);
+			}
+		}
+
+		void close()
+		{
+			net::error_code ec{};
+			for (std::unique_ptr<shared_socket>& s : sockets)
+			{
+				s->sock.close(ec);
+			}
+		}
+
+	protected:
+		struct remote_key
+		{
+			net::ip::udp::endpoint endpoint;
+			std::size_t index = 0;
+
+			inline bool operator==(const remote_key&) const = default;
+		};
+
+		struct remote_key_hash
+		{
+			inline std::size_t operator()(const remote_key& k) const noexcept
+			{
+				return std::hash<net::ip::udp::endpoint>()(k.endpoint) ^ (k.index * 0x9e3779b97f4a7c15ull);
+			}
+		};
+
+		struct remote_mapping
+		{
+			association* owner = nullptr;
+			time_point used_time{};
+		};
+
+		std::optional<std::size_t> try_map(association& a, std::size_t index, const net::ip::udp::endpoint& remote, time_point now)
+		{
+			auto [it, inserted] = remotes.try_emplace(remote_key{ remote, index }, remote_mapping{ std::addressof(a), now });
+			if (inserted)
+			{
+				a.remotes.emplace_back(index, remote);
+				return index;
+			}
+
+			if (it->second.owner != std::addressof(a))
+				return std::nullopt;
+
+			it->second.used_time = now;
+			return index;
+		}
+
+		std::optional<std::size_t> open(const net::ip::udp& protocol, net::error_code& ec)
+		{
+			std::unique_ptr<shared_socket> s = std::make_unique<shared_socket>(executor);
+
+			s->sock.open(protocol, ec);
+			if (ec)
+				return std::nullopt;
+
+			s->sock.bind(net::ip::udp::endpoint(protocol, 0), ec);
+			if (ec)
+				return std::nullopt;
+
+			s->local_endpoint = s->sock.local_endpoint(ec);
+			if (ec)
+				return std::nullopt;
+
+			// the socket is shared by many clients, the larger buffers can absorb more bursts.
+			net::error_code ignored{};
+			s->sock.set_option(net::socket_base::receive_buffer_size(4 * 1024 * 1024), ignored);
+			s->sock.set_option(net::socket_base::send_buffer_size(4 * 1024 * 1024), ignored);
+
+			std::size_t index = sockets.size();
+
+			sockets.emplace_back(std::move(s));
+
+			(protocol == net::ip::udp::v6() ? v6 : v4).emplace_back(index);
+
+			if (on_opened)
+				on_opened(index);
+
+			return index;
+		}
+
+		net::any_io_executor executor;
+
+		options opts;
+
+		std::function<void(std::size_t)> on_opened;
+
+		// the sockets are never closed until the table is closed, so the indexes are stable.
+		std::vector<std::unique_ptr<shared_socket>> sockets;
+
+		std::vector<std::size_t> v4, v6;
+
+		std::size_t v4_turn = 0, v6_turn = 0;
+
+		std::unordered_map<net::ip::udp::endpoint, std::shared_ptr<association>> clients;
+
+		std::unordered_multimap<net::ip::address, std::shared_ptr<association>> unlearned;
+
+		std::unordered_map<remote_key, remote_mapping, remote_key_hash> remotes;
+	};
+}
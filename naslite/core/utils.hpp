@@ -9,6 +9,7 @@
 #include <vector>
 #include <exception>
 #include <filesystem>
+#include <thread>
 
 #include <boost/process/v2.hpp>
 
@@ -81,4 +82,7 @@ namespace nas
 	int shutdown();
 	int restart();
 
+	// pin the thread to the cpu core, the cpu_index is zero based.
+	bool set_thread_affinity(std::thread& thread, std::size_t cpu_index);
+
 }
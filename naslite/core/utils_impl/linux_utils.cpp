@@ -6,6 +6,9 @@
 
 #if ASIO3_OS_LINUX || ASIO3_OS_UNIX
 
+#include <pthread.h>
+#include <sched.h>
+
 namespace nas
 {
 	namespace fs = std::filesystem;
@@ -134,6 +137,23 @@ namespace nas
 	{
 		return std::system("shutdown -r -t 3");
 	}
+
+	bool set_thread_affinity(std::thread& thread, std::size_t cpu_index)
+	{
+	#if ASIO3_OS_LINUX
+		if (cpu_index >= CPU_SETSIZE)
+			return false;
+
+		cpu_set_t cpuset;
+		CPU_ZERO(&cpuset);
+		CPU_SET(cpu_index, &cpuset);
+
+		return ::pthread_setaffinity_np(thread.native_handle(), sizeof(cpu_set_t), &cpuset) == 0;
+	#else
+		net::ignore_unused(thread, cpu_index);
+		return false;
+	#endif
+	}
 }
 
 #endif
@@ -283,6 +283,16 @@ namespace nas
 	{
 		return std::system("shutdown -r -t 3");
 	}
+
+	bool set_thread_affinity(std::thread& thread, std::size_t cpu_index)
+	{
+		if (cpu_index >= sizeof(DWORD_PTR) * 8)
+			return false;
+
+		DWORD_PTR mask = DWORD_PTR(1) << cpu_index;
+
+		return ::SetThreadAffinityMask(thread.native_handle(), mask) != 0;
+	}
 }
 
 #endif
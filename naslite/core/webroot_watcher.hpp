@@ -0,0 +1,230 @@
+#pragma once
+
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+
+#include "net.hpp"
+
+#include <asio3/core/predef.h>
+#include <asio3/http/util.hpp>
+
+#if ASIO3_OS_LINUX
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace nas
+{
+	/**
+	 * The files which were changed in the webroot, the targets are the url paths of the files,
+	 * like "/assets/index.js". All the cached entries should be evicted if the reset is true,
+	 * it is set when a directory was changed, or some events were lost.
+	 */
+	struct webroot_changes
+	{
+		bool reset = false;
+		std::unordered_set<std::string> targets;
+
+		// the target of the request or the cache key, the query and the coding are ignored, and it is url decoded.
+		inline bool is_changed(std::string_view target) const
+		{
+			if (reset)
+				return true;
+
+			return targets.contains(http::url_decode(target.substr(0, target.find_first_of("?#"))));
+		}
+	};
+
+	/**
+	 * Watches the webroot recursively by inotify, the events are collected until no event was
+	 * received in the debounce duration, so a redeploy of many files is reported only once.
+	 * It does nothing on the other platforms, the caches are only cleared by the api there.
+	 */
+	class webroot_watcher
+	{
+	public:
+		explicit webroot_watcher(const net::any_io_executor& ex)
+		#if ASIO3_OS_LINUX
+			: desc(ex)
+		#endif
+		{
+			std::ignore = ex;
+		}
+
+		/**
+		 * @brief Add the watches of the webroot and all of its sub directories.
+		 * @return False if the inotify isn't supported or the webroot can't be watched.
+		 */
+		bool open(const std::filesystem::path& webroot)
+		{
+		#if ASIO3_OS_LINUX
+			int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+			if (fd < 0)
+				return false;
+
+			net::error_code ec{};
+			desc.assign(fd, ec);
+			if (ec)
+			{
+				::close(fd);
+				return false;
+			}
+
+			root = webroot;
+
+			return add_watches(root, "/");
+		#else
+			std::ignore = webroot;
+			return false;
+		#endif
+		}
+
+		void close()
+		{
+		#if ASIO3_OS_LINUX
+			net::error_code ec{};
+			desc.close(ec);
+			dirs.clear();
+		#endif
+		}
+
+		/**
+		 * @brief Read the events until the watcher is closed.
+		 * @param on_changed - It is called in the thread of the executor.
+		 */
+		net::awaitable<void> run(auto on_changed, std::chrono::steady_clock::duration debounce)
+		{
+		#if ASIO3_OS_LINUX
+			for (;;)
+			{
+				auto [e1, n1] = co_await desc.async_read_some(net::buffer(buffer), net::use_nothrow_awaitable);
+				if (e1)
+					break;
+
+				webroot_changes changes{};
+
+				parse_events(n1, changes);
+
+				// wait until it is quiet, but not too long, otherwise a file which is written
+				// all the time would be never reported.
+				auto deadline = std::chrono::steady_clock::now() + debounce * 10;
+
+				while (std::chrono::steady_clock::now() < deadline)
+				{
+					auto result = co_await(
+						desc.async_read_some(net::buffer(buffer), net::use_nothrow_awaitable) ||
+						net::timeout(debounce));
+					if (net::is_timeout(result))
+						break;
+					auto [e2, n2] = std::get<0>(result);
+					if (e2)
+						co_return;
+
+					parse_events(n2, changes);
+				}
+
+				if (changes.reset || !changes.targets.empty())
+					on_changed(changes);
+			}
+		#else
+			std::ignore = on_changed;
+			std::ignore = debounce;
+			co_return;
+		#endif
+		}
+
+	protected:
+	#if ASIO3_OS_LINUX
+		static constexpr std::uint32_t watch_mask =
+			IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+			IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR;
+
+		// the symbolic links are not followed, the target of a link may be outside the webroot.
+		bool add_watches(const std::filesystem::path& dir, std::string prefix)
+		{
+			int wd = ::inotify_add_watch(desc.native_handle(), dir.c_str(), watch_mask);
+			if (wd < 0)
+				return false;
+
+			dirs[wd] = prefix;
+
+			std::error_code ec{};
+			for (auto it = std::filesystem::directory_iterator(dir, ec); !ec && it != std::filesystem::directory_iterator(); it.increment(ec))
+			{
+				if (it->is_directory(ec) && !it->is_symlink(ec))
+					add_watches(it->path(), prefix + it->path().filename().string() + "/");
+			}
+
+			return true;
+		}
+
+		void parse_events(std::size_t n, webroot_changes& changes)
+		{
+			for (std::size_t i = 0; i + sizeof(struct inotify_event) <= n;)
+			{
+				const struct inotify_event* ev = reinterpret_cast<const struct inotify_event*>(buffer.data() + i);
+
+				i += sizeof(struct inotify_event) + ev->len;
+
+				if (ev->mask & IN_Q_OVERFLOW)
+				{
+					changes.reset = true;
+					continue;
+				}
+
+				auto it = dirs.find(ev->wd);
+				if (it == dirs.end())
+					continue;
+
+				if (ev->mask & IN_IGNORED)
+				{
+					dirs.erase(it);
+					continue;
+				}
+
+				if (ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF))
+				{
+					changes.reset = true;
+					continue;
+				}
+
+				// the name is padded by the null chars.
+				std::string target = it->second;
+				if (ev->len)
+					target += ev->name;
+
+				if (ev->mask & IN_ISDIR)
+				{
+					changes.reset = true;
+
+					if (ev->mask & (IN_CREATE | IN_MOVED_TO))
+						add_watches(root / target.substr(1), target + "/");
+
+					continue;
+				}
+
+				// the precompressed siblings are the encoded variants of the original file.
+				if (target.ends_with(".gz") || target.ends_with(".br"))
+					changes.targets.emplace(target.substr(0, target.size() - 3));
+
+				changes.targets.emplace(std::move(target));
+			}
+		}
+
+		net::posix::stream_descriptor desc;
+
+		std::filesystem::path root;
+
+		// the watch descriptor and the url path of the directory, like "/assets/"
+		std::unordered_map<int, std::string> dirs;
+
+		alignas(struct inotify_event) std::array<char, 64 * 1024> buffer;
+	#endif
+	};
+}
@@ -9,6 +9,7 @@
 #include "../core/ievent.hpp"
 #include "../core/imodular_mgr.hpp"
 #include "../core/iconfig.hpp"
+#include "../core/metrics.hpp"
 
 #include <asio3/core/event_dispatcher.hpp>
 
@@ -49,9 +50,14 @@ namespace nas
 
 		std::shared_ptr<iconfig>          config{};
 
+		// must be declared before the logger, the queued logs are written when it is destroyed.
+		std::shared_ptr<spdlog::details::thread_pool> log_thread_pool{};
+
 		std::shared_ptr<spdlog::logger>   logger{};
 
 		std::shared_ptr<imodular_mgr>     modular{};
+
+		metrics_registry                  metrics{};
 	};
 }
 
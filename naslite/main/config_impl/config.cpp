@@ -79,6 +79,44 @@ namespace nas
 		return "trace";
 	}
 
+	std::uint32_t config_impl::get_log_queue_size()
+	{
+		std::shared_lock g(m_mutex);
+
+		if (json& j = m_jconfig["log_queue_size"]; j.is_string())
+			return std::uint32_t(std::stoul(j.get<std::string>()));
+
+		return 8192;
+	}
+
+	std::string config_impl::get_log_overflow_policy()
+	{
+		std::shared_lock g(m_mutex);
+
+		if (json& j = m_jconfig["log_overflow_policy"]; j.is_string())
+			return j.get<std::string>();
+
+		return "block";
+	}
+
+	std::vector<std::string> config_impl::get_dns_nameservers()
+	{
+		std::shared_lock g(m_mutex);
+
+		std::vector<std::string> nameservers;
+
+		if (json& j = m_jconfig["dns_nameservers"]; j.is_array())
+		{
+			for (json& v : j)
+			{
+				if (v.is_string())
+					nameservers.emplace_back(v.get<std::string>());
+			}
+		}
+
+		return nameservers;
+	}
+
 	const json& config_impl::get_modular_json(std::string_view modular_name)
 	{
 		std::shared_lock g(m_mutex);
@@ -171,6 +209,15 @@ namespace nas
 						.enable_cors = j["enable_cors"],
 						.requires_auth = j["requires_auth"],
 						.tokens = std::move(tokens),
+						.worker_threads = std::stoul(j.value("worker_threads", std::string("1"))),
+						.max_cache_file_size = std::stoull(j.value("max_cache_file_size", std::string("1048576"))),
+						.max_cache_size = std::stoull(j.value("max_cache_size", std::string("67108864"))),
+						.cache_ttl = std::stoul(j.value("cache_ttl", std::string("0"))),
+						.enable_cache_warmup = j.value("enable_cache_warmup", false),
+						.cache_warmup_size = std::stoull(j.value("cache_warmup_size", std::string("16777216"))),
+						.cache_control = j.value("cache_control", std::string("no-cache")),
+						.open_file_cache_size = std::stoul(j.value("open_file_cache_size", std::string("1024"))),
+						.open_file_cache_ttl = std::stoul(j.value("open_file_cache_ttl", std::string("5"))),
 					});
 			}
 		}
@@ -214,6 +261,8 @@ namespace nas
 					}
 					std::map<std::string, std::string> proxy_set_header;
 					std::map<std::string, std::string> proxy_options;
+					std::vector<upstream_server_info> upstream_servers;
+					health_check_info health_check;
 					if (std::string options = jsite["proxy_options"]; !options.empty())
 					{
 						std::vector<std::string> rows = net::split(options, '\n');
@@ -236,12 +285,79 @@ namespace nas
 							{
 								proxy_set_header.emplace(std::move(kvs[1]), std::move(kvs[2]));
 							}
+							else if (kvs.size() >= 2 && net::iequals(kvs.front(), "server"))
+							{
+								// nginx: server 127.0.0.1:8096 weight=2 max_fails=3 fail_timeout=10;
+								upstream_server_info server;
+								std::string_view address = kvs[1];
+								if (auto pos = address.rfind(':'); pos != std::string_view::npos)
+								{
+									server.host = address.substr(0, pos);
+									server.port = std::uint16_t(std::stoi(std::string(address.substr(pos + 1))));
+								}
+								if (server.host.size() > 1 && server.host.front() == '[' && server.host.back() == ']')
+								{
+									server.host = server.host.substr(1, server.host.size() - 2);
+								}
+								for (std::size_t i = 2; i < kvs.size(); ++i)
+								{
+									std::string_view kv = kvs[i];
+									auto pos = kv.find('=');
+									if (pos == std::string_view::npos)
+										continue;
+									std::string_view k = kv.substr(0, pos);
+									std::uint32_t v = std::uint32_t(std::stoul(std::string(kv.substr(pos + 1))));
+									if /**/ (net::iequals(k, "weight"))
+										server.weight = (std::clamp)(v, std::uint32_t(1), std::uint32_t(100));
+									else if (net::iequals(k, "max_fails"))
+										server.max_fails = v;
+									else if (net::iequals(k, "fail_timeout"))
+										server.fail_timeout = v;
+								}
+								if (!server.host.empty() && server.port != 0)
+								{
+									upstream_servers.emplace_back(std::move(server));
+								}
+							}
+							else if (kvs.size() >= 1 && net::iequals(kvs.front(), "health_check"))
+							{
+								// health_check type=http interval=5 timeout=3 rise=2 fall=3 uri=/ status=200;
+								health_check.enable = true;
+								for (std::size_t i = 1; i < kvs.size(); ++i)
+								{
+									std::string_view kv = kvs[i];
+									auto pos = kv.find('=');
+									if (pos == std::string_view::npos)
+										continue;
+									std::string_view k = kv.substr(0, pos);
+									std::string_view v = kv.substr(pos + 1);
+									if /**/ (net::iequals(k, "type"))
+										health_check.type = v;
+									else if (net::iequals(k, "uri"))
+										health_check.uri = v;
+									else if (net::iequals(k, "interval"))
+										health_check.interval = (std::max)(std::uint32_t(std::stoul(std::string(v))), std::uint32_t(1));
+									else if (net::iequals(k, "timeout"))
+										health_check.timeout = (std::max)(std::uint32_t(std::stoul(std::string(v))), std::uint32_t(1));
+									else if (net::iequals(k, "rise"))
+										health_check.rise = (std::max)(std::uint32_t(std::stoul(std::string(v))), std::uint32_t(1));
+									else if (net::iequals(k, "fall"))
+										health_check.fall = (std::max)(std::uint32_t(std::stoul(std::string(v))), std::uint32_t(1));
+									else if (net::iequals(k, "status"))
+										health_check.status = std::uint32_t(std::stoul(std::string(v)));
+								}
+							}
 							else if (kvs.size() == 2)
 							{
 								proxy_options.emplace(std::move(kvs[0]), std::move(kvs[1]));
 							}
 						}
 					}
+					auto get_option = [&proxy_options](const char* name, std::uint32_t default_value)
+					{
+						auto it = proxy_options.find(name);
+						return it == proxy_options.end() ? default_value : std::uint32_t(std::stoul(it->second));
+					};
 					proxy_sites.emplace(jsite["domain"], proxy_site_info{
 							.name = net::utf8_to_locale(jsite["name"].get<std::string>()),
 							.domain = jsite["domain"],
@@ -252,7 +368,15 @@ namespace nas
 							.requires_auth = jsite["requires_auth"],
 							.auth_roles = std::move(auth_roles),
 							.proxy_set_header = std::move(proxy_set_header),
-							.proxy_options = std::move(proxy_options),
+							.proxy_options = proxy_options,
+							.keepalive = get_option("keepalive", 0),
+							.keepalive_timeout = get_option("keepalive_timeout", 60),
+							.keepalive_requests = get_option("keepalive_requests", 1000),
+							.connect_timeout = get_option("proxy_connect_timeout", 60),
+							.connect_attempt_delay = get_option("proxy_connect_attempt_delay", 250),
+							.balance = proxy_options.contains("balance") ? proxy_options["balance"] : "round_robin",
+							.upstream_servers = std::move(upstream_servers),
+							.health_check = std::move(health_check),
 						});
 				}
 				cfgs.emplace_back(http_reverse_proxy_info{
@@ -260,10 +384,14 @@ namespace nas
 						.protocol = j["protocol"],
 						.name = net::utf8_to_locale(j["name"].get<std::string>()),
 						.ip_blacklist_minutes = std::stoul(j["ip_blacklist_minutes"].get<std::string>()),
+						.ip_blacklist_capacity = std::stoul(j.value("ip_blacklist_capacity", std::string("65536"))),
+						.ip_blacklist_file = net::utf8_to_locale(j.value("ip_blacklist_file", std::string())),
 						.listen_address = j["listen_address"],
 						.listen_port = std::uint16_t(std::stoi(j["listen_port"].get<std::string>())),
 						.cert_file = net::utf8_to_locale(j["cert_file"].get<std::string>()),
 						.key_file = net::utf8_to_locale(j["key_file"].get<std::string>()),
+						.worker_threads = std::stoul(j.value("worker_threads", std::string("1"))),
+						.cpu_affinity = j.value("cpu_affinity", false),
 						.proxy_sites = std::move(proxy_sites),
 					});
 			}
@@ -313,10 +441,17 @@ namespace nas
 						.protocol = j["protocol"],
 						.name = net::utf8_to_locale(j["name"].get<std::string>()),
 						.ip_blacklist_minutes = std::stoul(j["ip_blacklist_minutes"].get<std::string>()),
+						.ip_blacklist_capacity = std::stoul(j.value("ip_blacklist_capacity", std::string("65536"))),
+						.ip_blacklist_file = net::utf8_to_locale(j.value("ip_blacklist_file", std::string())),
 						.listen_address = j["listen_address"],
 						.listen_port = std::uint16_t(std::stoi(j["listen_port"].get<std::string>())),
 						.supported_method = std::move(supported_method),
 						.tokens = std::move(tokens),
+						.shared_udp_enable = j.value("shared_udp_enable", false),
+						.shared_udp_sockets = std::stoul(j.value("shared_udp_sockets", std::string("4"))),
+						.shared_udp_idle_timeout = std::stoul(j.value("shared_udp_idle_timeout", std::string("60"))),
+						.connect_timeout = std::stoul(j.value("connect_timeout", std::string("30"))),
+						.connect_attempt_delay = std::stoul(j.value("connect_attempt_delay", std::string("250"))),
 					});
 			}
 		}
@@ -419,6 +554,13 @@ namespace nas
 						.cors_allow_origin = j["cors_allow_origin"],
 						.requires_auth = j["requires_auth"],
 						.tokens = std::move(tokens),
+						.max_cache_file_size = std::stoull(j.value("max_cache_file_size", std::string("1048576"))),
+						.max_cache_size = std::stoull(j.value("max_cache_size", std::string("67108864"))),
+						.cache_ttl = std::stoul(j.value("cache_ttl", std::string("0"))),
+						.enable_cache_warmup = j.value("enable_cache_warmup", false),
+						.cache_warmup_size = std::stoull(j.value("cache_warmup_size", std::string("16777216"))),
+						.cache_control = j.value("cache_control", std::string("no-cache")),
+						.assets_cache_control = j.value("assets_cache_control", std::string("public, max-age=31536000, immutable")),
 					});
 				net::trim_both(cfg.cors_allow_headers);
 				net::trim_both(cfg.cors_allow_methods);
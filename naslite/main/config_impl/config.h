@@ -22,6 +22,12 @@ namespace nas
 
 		std::string get_log_level() override;
 
+		std::uint32_t get_log_queue_size() override;
+
+		std::string get_log_overflow_policy() override;
+
+		std::vector<std::string> get_dns_nameservers() override;
+
 		const json& get_modular_json(std::string_view modular_name) override;
 
 		bool set_modular_json(std::string_view modular_name, const std::string& value) override;
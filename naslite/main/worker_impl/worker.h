@@ -6,6 +6,7 @@
 #include "../../core/logger.hpp"
 #include "../../core/utils.hpp"
 #include "../../core/version.hpp"
+#include "../../core/dns_resolver.hpp"
 #include "../app.hpp"
 #include "../modular_mgr.hpp"
 #include "../config.hpp"
@@ -85,7 +86,9 @@ namespace nas
 				auto console_sink = std::make_shared<spdlog::sinks::stdout_color_sink_mt>();
 				console_sink->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%-5l] %^%v%$");
 
-				auto file_sink = std::make_shared<spdlog::sinks::basic_file_sink_mt>(filepath.string(), true);
+				// the old file is renamed to naslite.1.log when starting, so the last run is kept.
+				auto file_sink = std::make_shared<spdlog::sinks::rotating_file_sink_mt>(
+					filepath.string(), log_file_max_size, log_max_files, true);
 				file_sink->set_pattern("[%Y-%m-%d %H:%M:%S.%e] [%-5l] %v");
 
 				std::vector<spdlog::sink_ptr> sinks{ console_sink, file_sink };
@@ -123,16 +126,83 @@ namespace nas
 				return false;
 			}
 
+			if (!init_async_logger())
+				return false;
+
 			app.logger->set_level(spdlog::level::from_str(app.config->get_log_level()));
 
 			app.logger->info("load config successed: {}", filepath.string());
 
+			init_dns_options();
+
+			return true;
+		}
+
+		// the nameservers of the config are used instead of the resolv.conf, they are read only
+		// once, because the shared resolver is created when it is used at the first time.
+		static void init_dns_options()
+		{
+			dns_options& opts = default_dns_options();
+
+			if (!opts.nameservers.empty())
+				return;
+
+			for (const std::string& value : app.config->get_dns_nameservers())
+			{
+				if (std::optional<net::ip::udp::endpoint> ep = parse_dns_nameserver(value); ep)
+					opts.nameservers.emplace_back(*ep);
+				else
+					app.logger->error("invalid dns nameserver: {}", value);
+			}
+		}
+
+		// the logs are formatted in the caller thread and queued, then written to the sinks
+		// in one background thread, so the io threads never wait for the disk.
+		static bool init_async_logger()
+		{
+			// it is created only once, the config may be reloaded when restart.
+			if (app.log_thread_pool)
+				return true;
+
+			std::uint32_t queue_size = (std::max)(app.config->get_log_queue_size(), std::uint32_t(128));
+			std::string policy = app.config->get_log_overflow_policy();
+
+			// "drop" discards the oldest queued log when the queue is full, "block" waits for it.
+			spdlog::async_overflow_policy overflow_policy = net::iequals(policy, "drop") ?
+				spdlog::async_overflow_policy::overrun_oldest : spdlog::async_overflow_policy::block;
+
+			try
+			{
+				app.log_thread_pool = std::make_shared<spdlog::details::thread_pool>(queue_size, 1);
+
+				std::shared_ptr<spdlog::logger> logger = std::make_shared<spdlog::async_logger>(
+					"naslite_log", app.logger->sinks().begin(), app.logger->sinks().end(),
+					app.log_thread_pool, overflow_policy);
+				logger->set_level(app.logger->level());
+				logger->flush_on(spdlog::level::err);
+
+				app.logger->flush();
+				app.logger = std::move(logger);
+			}
+			catch (const std::exception& e)
+			{
+				app.log_thread_pool.reset();
+				app.logger->error("create async logger failed: {}", e.what());
+				return false;
+			}
+
+			app.logger->info("create async logger successed: queue size {} overflow policy {}",
+				queue_size, net::iequals(policy, "drop") ? "drop" : "block");
+
 			return true;
 		}
 
 		int run();
 
 	public:
+		static constexpr std::size_t log_file_max_size = 10 * 1024 * 1024;
+		static constexpr std::size_t log_max_files = 5;
+
 		std::vector<std::string> args;
 
 		bool has_service_flag = false;
@@ -9,6 +9,7 @@
 #include "../service_process_mgr/service_start_all_event.hpp"
 #include "../service_process_mgr/service_stop_all_event.hpp"
 #include "../../main/restart_naslite_event.hpp"
+#include "../http_reverse_proxy/upstream_status_event.hpp"
 #include "http_clear_cache_all_event.hpp"
 
 #include <jwt-cpp/jwt.h>
@@ -19,6 +20,7 @@ namespace nas
 {
 	using router_data = frontend_http_server::router_data;
 	using node = frontend_http_server::node;
+	using node_metrics = frontend_http_server::node_metrics;
 
 	template<typename T>
 	concept is_https_server = requires(T & a)
@@ -30,7 +32,13 @@ namespace nas
 	{
 		if (auto it = req.find(http::field::authorization); it != req.end())
 		{
-			std::string token{ it->value() };
+			std::string_view value = it->value();
+
+			// the prometheus scraper sends the token with the "Bearer" scheme.
+			if (value.size() > 7 && net::iequals(value.substr(0, 7), "Bearer "))
+				value.remove_prefix(7);
+
+			std::string token{ value };
 
 			try
 			{
@@ -51,7 +59,7 @@ namespace nas
 						.with_claim("object", jclaim)
 						.verify(decoded);
 
-					app.logger->trace("jwt_verify success: {}", req.target());
+					NAS_LOG_TRACE("jwt_verify success: {}", req.target());
 
 					return true;
 				}
@@ -91,6 +99,27 @@ namespace nas
 		}
 	}
 
+	// the responses of the router and the cache warmer must be same.
+	http::response<http::string_body> make_index_response(
+		std::shared_ptr<node>& p, const std::filesystem::path& filepath, std::string content)
+	{
+		auto res = http::make_html_response(std::move(content));
+		if (auto meta = load_file_metadata(filepath); meta)
+			set_file_validators(res, *meta, p->cfg.cache_control);
+		return res;
+	}
+
+	http::response<http::string_body> make_asset_response(
+		std::shared_ptr<node>& p, const std::filesystem::path& filepath, std::string content)
+	{
+		auto res = http::make_text_response(std::move(content));
+		res.set(http::field::content_type, http::extension_to_mimetype(filepath.extension().string()));
+		res.set(http::field::accept_ranges, "bytes");
+		if (auto meta = load_file_metadata(filepath); meta)
+			set_file_validators(res, *meta, p->cfg.assets_cache_control);
+		return res;
+	}
+
 	net::awaitable<bool> index_page(
 		std::shared_ptr<node>& p, auto& server, http::web_request& req, http::web_response& rep, router_data data)
 	{
@@ -102,14 +131,47 @@ namespace nas
 			co_return true;
 		}
 
-		rep = http::make_html_response(std::move(content));
+		rep = make_index_response(p, filepath, std::move(content));
 		co_return true;
 	}
 
+	// the pages of the vue app, all of them are routed to the index_page.
+	inline constexpr std::string_view vue_pages[] = {
+		"/view/signin",
+		"/view/http_reverse_proxy",
+		"/view/socks5_reverse_proxy",
+		"/view/static_http_server",
+		"/view/service_process_mgr",
+		"/view/frontend_http_server",
+	};
+
+	// same as the routes of the index_page, the unknown pages are not found by the router.
+	inline bool is_index_target(std::string_view target)
+	{
+		return target == "/" || std::ranges::find(vue_pages, target) != std::ranges::end(vue_pages);
+	}
+
+	// same as the routes of the static_assets.
+	inline bool is_static_asset_request(http::web_request& req)
+	{
+		return (req.method() == http::verb::get || req.method() == http::verb::head) &&
+			(target_path(req.target()) == "/favicon.ico" || req.target().starts_with("/assets/"));
+	}
+
+	// the pages and the assets of the vue app, the api responses and the other targets are never
+	// cached, otherwise any client can fill the caches with the targets which aren't routed.
+	inline bool is_cacheable_request(http::web_request& req)
+	{
+		std::string_view path = target_path(req.target());
+
+		return req.method() == http::verb::get && (is_index_target(path) ||
+			path == "/favicon.ico" || path.starts_with("/assets/"));
+	}
+
 	net::awaitable<bool> static_assets(
 		std::shared_ptr<node>& p, auto& server, http::web_request& req, http::web_response& rep, router_data data)
 	{
-		std::filesystem::path filepath = net::make_filepath(server->webroot, req.target());
+		std::filesystem::path filepath = resolve_filepath(server->webroot, req.target());
 
 		auto [ec, file, content] = co_await net::async_read_file_content(filepath.string());
 		if (ec)
@@ -118,9 +180,7 @@ namespace nas
 			co_return true;
 		}
 
-		auto res = http::make_text_response(std::move(content));
-		res.set(http::field::content_type, http::extension_to_mimetype(filepath.extension().string()));
-		rep = std::move(res);
+		rep = make_asset_response(p, filepath, std::move(content));
 		co_return true;
 	}
 
@@ -149,6 +209,12 @@ namespace nas
 		co_return true;
 	}
 
+	node_metrics make_node_metrics(std::shared_ptr<node>& p)
+	{
+		return make_http_server_metrics(app.metrics, "naslite_frontend_http",
+			metric_labels{ { "server", net::locale_to_utf8(p->cfg.name) } });
+	}
+
 	void init_server(std::shared_ptr<node>& p, auto& server)
 	{
 		std::error_code ec{};
@@ -173,55 +239,28 @@ namespace nas
 		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
 		{
 			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
-
-		server->router.add("/view/signin", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
-		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
-
-		server->router.add("/view/http_reverse_proxy", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
-		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
-
-		server->router.add("/view/socks5_reverse_proxy", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
-		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
-
-		server->router.add("/view/static_http_server", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
-		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
-
-		server->router.add("/view/service_process_mgr", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
-		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
+		});
 
-		server->router.add("/view/frontend_http_server", [p, server]
-		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
+		for (std::string_view page : vue_pages)
 		{
-			co_return co_await index_page(p, server, req, rep, data);
-		}, http::enable_cache);
+			server->router.add(std::string(page), [p, server]
+			(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
+			{
+				co_return co_await index_page(p, server, req, rep, data);
+			});
+		}
 
 		server->router.add("/favicon.ico", [p, server]
 		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
 		{
 			co_return co_await static_assets(p, server, req, rep, data);
-		}, http::enable_cache);
+		});
 
 		server->router.add("/assets/*", [p, server]
 		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
 		{
 			co_return co_await static_assets(p, server, req, rep, data);
-		}, http::enable_cache);
+		});
 
 		// for cors
 		server->router.add<http::verb::options>("*", [p, server]
@@ -331,6 +370,49 @@ namespace nas
 			co_return true;
 		}, aop_auth{});
 
+		server->router.add<http::verb::get>("/api/status/http_reverse_proxy/upstream", [p, server]
+		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
+		{
+			std::shared_ptr<upstream_status_event> e = std::make_shared<upstream_status_event>(p->ctx.get_executor());
+			if (app.event_dispatcher.dispatch(e))
+			{
+				co_await e->ch.async_receive(net::use_nothrow_awaitable);
+			}
+			else
+			{
+				e->ec = net::error::operation_aborted;
+				e->message.clear();
+				e->data.clear();
+			}
+
+			auto res = http::make_json_response(
+				e->data.dump(), e->ec ? http::status::no_content : http::status::ok);
+			set_cors(req, res, p->cfg);
+			rep = std::move(res);
+			co_return true;
+		}, aop_auth{});
+
+		server->router.add<http::verb::get>("/api/status/metrics", [p, server]
+		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
+		{
+			json j = app.metrics.to_json();
+			auto res = http::make_json_response(j.dump(), http::status::ok);
+			set_cors(req, res, p->cfg);
+			rep = std::move(res);
+			co_return true;
+		}, aop_auth{});
+
+		// for the prometheus scraper, the jwt token is set by the "authorization" of the scrape job.
+		server->router.add<http::verb::get>("/api/status/metrics/prometheus", [p, server]
+		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
+		{
+			auto res = http::make_text_response(app.metrics.to_prometheus(),
+				http::status::ok, "text/plain; version=0.0.4; charset=utf-8");
+			set_cors(req, res, p->cfg);
+			rep = std::move(res);
+			co_return true;
+		}, aop_auth{});
+
 		server->router.add<http::verb::get>("/api/config/service_process_mgr", [p, server]
 		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
 		{
@@ -598,7 +680,9 @@ namespace nas
 		server->router.add<http::verb::post>("/api/command/http/clear_cache/all", [p, server]
 		(http::web_request& req, http::web_response& rep, router_data data) mutable -> net::awaitable<bool>
 		{
-			server->router.get_cache().clear();
+			// the router runs in the thread of the node, so its metadata cache is cleared directly.
+			p->cache->clear();
+			p->metadata.clear();
 
 			std::shared_ptr<http_clear_cache_all_event> e =
 				std::make_shared<http_clear_cache_all_event>(p->ctx.get_executor());
@@ -621,6 +705,73 @@ namespace nas
 		}, aop_auth{});
 	}
 
+	// only the changed files are evicted, the pages of the vue app are mapped to the index file.
+	void invalidate_cache(std::shared_ptr<node>& p, const webroot_changes& changes)
+	{
+		std::string index = "/" + p->cfg.index;
+
+		auto is_changed = [&changes, &index](std::string_view target)
+		{
+			std::string_view path = target.substr(0, target.find_first_of("?#"));
+			if (is_index_target(path))
+				return changes.is_changed(index);
+			return changes.is_changed(target);
+		};
+
+		std::size_t count = p->cache->erase_if(is_changed);
+
+		p->metadata.erase_if(is_changed);
+
+		app.logger->debug("frontend_http_server webroot changed: {} files{}, {} cached responses are evicted",
+			changes.targets.size(), changes.reset ? " and directories" : "", count);
+	}
+
+	// only the index and the files which are routed to the static_assets are read.
+	void start_warmup(std::shared_ptr<node>& p, const std::filesystem::path& webroot)
+	{
+		p->warmer = std::make_unique<cache_warmer>(cache_warmer::options{
+			.max_size = p->cfg.cache_warmup_size,
+			.max_file_size = p->cfg.max_cache_file_size,
+			.threads = 2,
+		});
+
+		std::string index = "/" + p->cfg.index;
+
+		p->warmer->start(webroot,
+			[index](std::string_view target)
+			{
+				return target == index || target == "/favicon.ico" || target.starts_with("/assets/");
+			},
+			[p, index](std::string_view target, const std::filesystem::path& filepath, std::string content) mutable
+			{
+				if (target == index)
+					p->cache->add("/", make_serialized_response(make_index_response(p, filepath, std::move(content))));
+				else
+					p->cache->add(target, make_serialized_response(make_asset_response(p, filepath, std::move(content))));
+			},
+			[p](const cache_warmer::result& r) mutable
+			{
+				app.logger->info("frontend_http_server '{}' cache warm-up finished: {} files, {} bytes, {} ms",
+					p->cfg.name, r.files, r.bytes,
+					std::chrono::duration_cast<std::chrono::milliseconds>(r.elapsed).count());
+			});
+	}
+
+	// the conditional requests of the pages and the assets are answered by 304 from the metadata
+	// cache. the large assets and the range requests are streamed from the file directly, the
+	// router would cache the whole file in the memory.
+	file_target make_file_target(std::shared_ptr<node>& p, http::web_request& req)
+	{
+		bool is_asset = is_static_asset_request(req);
+
+		return file_target{
+			.file = is_asset || is_cacheable_request(req),
+			.streamable = is_asset,
+			.cacheable = is_cacheable_request(req),
+			.cache_control = is_asset ? p->cfg.assets_cache_control : p->cfg.cache_control,
+		};
+	}
+
 	net::awaitable<void> do_recv(std::shared_ptr<node>& p, auto& server, auto& session)
 	{
 		// This buffer is required to persist across reads
@@ -634,29 +785,43 @@ namespace nas
 			if (e1)
 				break;
 
-			app.logger->trace("frontend_http_server::request: {} {}", req.method_string(), req.target());
-
-			for (auto it = req.begin(); it != req.end(); ++it)
+			if (NAS_LOG_TRACE_ENABLED())
 			{
-				app.logger->trace("    {}: {}", it->name_string(), it->value());
+				NAS_LOG_TRACE("frontend_http_server::request: {} {}", req.method_string(), req.target());
+
+				for (auto it = req.begin(); it != req.end(); ++it)
+				{
+					NAS_LOG_TRACE("    {}: {}", it->name_string(), it->value());
+				}
 			}
 
 			session->update_alive_time();
 
-			http::web_response rep;
-			bool result = co_await server->router.route(req, rep, router_data{ session->socket, p->cfg });
+			bool is_asset = is_static_asset_request(req);
 
-			// Send the response
-			auto [e2, n2] = co_await beast::async_write(session->get_stream(), std::move(rep));
-			if (e2)
-				break;
+			bool keep_alive = co_await async_serve_file_request(session->get_stream(), req,
+				file_responder{ p->metadata, *p->cache, *p->metrics, p->cfg.max_cache_file_size },
+				make_file_target(p, req),
+				// the pages of the vue app are all the index file.
+				[&p, &server, &req, is_asset]() mutable
+				{
+					if (is_asset)
+						return resolve_filepath(server->webroot, req.target());
+					return server->webroot / p->cfg.index;
+				},
+				[p, is_asset](const std::filesystem::path& filepath, std::string content) mutable
+				{
+					if (is_asset)
+						return make_asset_response(p, filepath, std::move(content));
+					return make_index_response(p, filepath, std::move(content));
+				},
+				[&p, &server, &session, &req](http::web_response& rep) mutable -> net::awaitable<bool>
+				{
+					co_return co_await server->router.route(req, rep, router_data{ session->socket, p->cfg });
+				});
 
-			if (!result || !req.keep_alive())
-			{
-				// This means we should close the connection, usually because
-				// the response indicated the "Connection: close" semantic.
+			if (!keep_alive)
 				break;
-			}
 		}
 
 		session->close();
@@ -739,6 +904,14 @@ namespace nas
 
 			p->cfg = std::move(cfg);
 
+			p->metrics.emplace(make_node_metrics(p));
+
+			p->cache.emplace(response_cache::options{
+				.max_size = p->cfg.max_cache_size,
+				.max_object_size = p->cfg.max_cache_file_size,
+				.ttl = std::chrono::seconds(p->cfg.cache_ttl),
+			});
+
 			if /**/ (net::iequals(p->cfg.protocol, "http"))
 			{
 				p->server = std::make_shared<http_server_ex>(p->ctx.get_executor());
@@ -801,6 +974,25 @@ namespace nas
 			std::visit([&p](auto& server) mutable
 			{
 				net::co_spawn(server->get_executor(), start_server(p, server), net::detached);
+
+				if (p->cfg.enable_cache_warmup)
+					start_warmup(p, server->webroot);
+
+				p->watcher = std::make_shared<webroot_watcher>(p->ctx.get_executor());
+
+				if (p->watcher->open(server->webroot))
+				{
+					net::co_spawn(p->ctx.get_executor(), p->watcher->run(
+						[p](const webroot_changes& changes) mutable
+						{
+							invalidate_cache(p, changes);
+						}, std::chrono::milliseconds(300)), net::detached);
+				}
+				else
+				{
+					app.logger->info("    the webroot of '{}' isn't watched, the changed files are cached until the cache is cleared",
+						p->cfg.name);
+				}
 			}, p->server);
 		}
 		
@@ -811,11 +1003,17 @@ namespace nas
 	{
 		for (auto& p : nodes)
 		{
+			if (p->warmer)
+				p->warmer->stop();
+
 			std::visit([&p](auto& server) mutable
 			{
 				server->async_stop([p](net::error_code ec)
 				{
 					p->sock_for_temperatures.close(ec);
+
+					if (p->watcher)
+						p->watcher->close();
 				});
 			}, p->server);
 		}
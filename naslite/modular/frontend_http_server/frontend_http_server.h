@@ -7,6 +7,13 @@
 #include "../../core/iconfig.hpp"
 #include "../../core/utils.hpp"
 #include "../../core/imodular.hpp"
+#include "../../core/metrics.hpp"
+#include "../../core/file_sender.hpp"
+#include "../../core/response_cache.hpp"
+#include "../../core/webroot_watcher.hpp"
+#include "../../core/cache_warmer.hpp"
+#include "../../core/http_compress.hpp"
+#include "../../core/file_responder.hpp"
 
 #include <asio3/http/https_server.hpp>
 
@@ -28,12 +35,19 @@ namespace nas
 		using https_server_ex = net::basic_https_server<
 			net::https_session, http::basic_router<http::web_request, http::web_response, router_data>>;
 
+		using node_metrics = http_server_metrics;
+
 		struct node
 		{
 			frontend_http_server_info cfg{};
 			net::io_context_thread ctx{ 1 };
 			net::ip::tcp::socket sock_for_temperatures{ ctx.get_executor() };
 			std::variant<std::shared_ptr<http_server_ex>, std::shared_ptr<https_server_ex>> server;
+			std::optional<node_metrics> metrics;
+			file_metadata_cache metadata{}; // only used in the thread of the ctx
+			std::optional<response_cache> cache;
+			std::shared_ptr<webroot_watcher> watcher;
+			std::unique_ptr<cache_warmer> warmer;
 		};
 
 	public:
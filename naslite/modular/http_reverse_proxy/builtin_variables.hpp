@@ -24,6 +24,10 @@ namespace nas
 		virtual ~ibuiltin_variable() {}
 		virtual std::optional<std::string> get_value(request_info& info) = 0;
 		virtual std::string_view get_variable_name() = 0;
+
+		// the value doesn't change during the whole connection, so it can be computed once
+		// and reused by all the keep-alive requests of the connection.
+		virtual bool is_per_connection() { return false; }
 	};
 
 	struct http_host final
@@ -103,6 +107,10 @@ namespace nas
 		{
 			return "remote_addr";
 		}
+		virtual bool is_per_connection() override
+		{
+			return true;
+		}
 	};
 
 	struct remote_port final
@@ -130,6 +138,10 @@ namespace nas
 		{
 			return "remote_port";
 		}
+		virtual bool is_per_connection() override
+		{
+			return true;
+		}
 	};
 
 	struct proxy_add_x_forwarded_for final
@@ -232,6 +244,10 @@ namespace nas
 		{
 			return "ssl_client_cert";
 		}
+		virtual bool is_per_connection() override
+		{
+			return true;
+		}
 	};
 
 	class builtin_variables : public noncopyable
@@ -254,23 +270,22 @@ namespace nas
 	public:
 		static builtin_variables& instance() { static builtin_variables g; return g; }
 
-		std::optional<std::string> get_value(request_info& info, std::string_view variable)
+		// the variable name is case insensitive.
+		ibuiltin_variable* find(std::string_view variable)
 		{
-			if (!variable.empty())
+			std::string name{ variable };
+
+			for (auto& c : name)
 			{
-				for (auto& c : variable)
-				{
-					const_cast<std::string_view::reference>(c) =
-						static_cast<std::string_view::value_type>(std::tolower(c));
-				}
+				c = static_cast<std::string::value_type>(std::tolower(static_cast<unsigned char>(c)));
+			}
 
-				if (auto it = m_variable_map.find(variable); it != m_variable_map.end())
-				{
-					return it->second->get_value(info);
-				}
+			if (auto it = m_variable_map.find(name); it != m_variable_map.end())
+			{
+				return it->second.get();
 			}
 
-			return std::nullopt;
+			return nullptr;
 		}
 
 	protected:
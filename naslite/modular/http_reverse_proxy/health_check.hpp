@@ -0,0 +1,164 @@
+#pragma once
+
+#include <unordered_set>
+
+#include "../../core/net.hpp"
+#include "../../core/iconfig.hpp"
+#include "../../core/dns_resolver.hpp"
+
+#include "upstream.hpp"
+
+#include <asio3/core/defer.hpp>
+#include <asio3/http/core.hpp>
+#include <asio3/icmp/ping.hpp>
+
+namespace nas
+{
+	net::awaitable<net::error_code> tcp_probe(upstream_member& m)
+	{
+		net::tcp_socket sock(co_await net::this_coro::executor);
+
+		auto ec = co_await async_connect_host(sock, m.cfg.host, m.cfg.port);
+
+		net::error_code ignored{};
+		sock.shutdown(net::socket_base::shutdown_both, ignored);
+		sock.close(ignored);
+
+		co_return ec;
+	}
+
+	net::awaitable<net::error_code> http_probe(upstream_member& m, proxy_site_info& site)
+	{
+		net::tcp_socket sock(co_await net::this_coro::executor);
+
+		std::defer auto_close = [&sock]() mutable
+		{
+			net::error_code ignored{};
+			sock.shutdown(net::socket_base::shutdown_both, ignored);
+			sock.close(ignored);
+		};
+
+		if (auto e1 = co_await async_connect_host(sock, m.cfg.host, m.cfg.port); e1)
+			co_return e1;
+
+		http::request<http::empty_body> req{ http::verb::get, site.health_check.uri, 11 };
+		req.set(http::field::host, site.domain);
+		req.set(http::field::user_agent, "naslite-health-check");
+		req.set(http::field::connection, "close");
+
+		auto [e2, n2] = co_await http::async_write(sock, req);
+		if (e2)
+			co_return e2;
+
+		beast::flat_buffer buf;
+		http::response_parser<http::buffer_body> parser;
+
+		auto [e3, n3] = co_await http::async_read_header(sock, buf, parser);
+		if (e3)
+			co_return e3;
+
+		if (parser.get().result_int() != site.health_check.status)
+			co_return http::error::bad_status;
+
+		co_return net::error_code{};
+	}
+
+	net::awaitable<net::error_code> icmp_probe(upstream_member& m, proxy_site_info& site)
+	{
+		auto [ec, rep] = co_await net::co_ping(net::ping_option{
+			.host = m.cfg.host, .timeout = std::chrono::seconds(site.health_check.timeout) });
+		if (!ec && rep.is_timeout())
+			ec = net::error::timed_out;
+		co_return ec;
+	}
+
+	// only the result which is changed is logged, the probe may be failed for every interval.
+	void update_health_state(upstream_member& m, proxy_site_info& site, net::error_code ec)
+	{
+		health_check_info& hc = site.health_check;
+
+		m.check_time = std::chrono::system_clock::now();
+		m.check_message = ec ? ec.message() : "success";
+
+		if (!ec)
+		{
+			m.check_falls = 0;
+
+			if (++m.check_rises >= hc.rise && !m.healthy.load(std::memory_order_relaxed))
+			{
+				m.healthy.store(true, std::memory_order_relaxed);
+				m.fails.store(0, std::memory_order_relaxed);
+				m.down_until.store(0, std::memory_order_relaxed);
+
+				app.logger->info("upstream member is up: {} {}:{}", site.domain, m.cfg.host, m.cfg.port);
+			}
+		}
+		else
+		{
+			m.check_rises = 0;
+
+			if (++m.check_falls >= hc.fall && m.healthy.load(std::memory_order_relaxed))
+			{
+				m.healthy.store(false, std::memory_order_relaxed);
+
+				app.logger->warn("upstream member is down: {} {}:{} {}",
+					site.domain, m.cfg.host, m.cfg.port, ec.message());
+			}
+		}
+	}
+
+	/**
+	 * @brief Probe the member at every interval until the timer is canceled.
+	 * @param timers - The timer is registered into it, so it can be canceled when stop.
+	 * @param aborted - The flag of the node which is set when stop.
+	 */
+	net::awaitable<void> health_check(
+		upstream_member& m, proxy_site_info& site,
+		std::unordered_set<net::steady_timer*>& timers, std::atomic_flag& aborted)
+	{
+		health_check_info& hc = site.health_check;
+
+		net::steady_timer t(co_await net::this_coro::executor);
+
+		timers.emplace(std::addressof(t));
+		std::defer auto_remove_timer = [&timers, &t]() mutable
+		{
+			timers.erase(std::addressof(t));
+		};
+
+		while (!aborted.test())
+		{
+			auto begin = std::chrono::steady_clock::now();
+
+			net::error_code ec{};
+
+			if /**/ (net::iequals(hc.type, "icmp"))
+			{
+				ec = co_await icmp_probe(m, site);
+			}
+			else
+			{
+				auto result = co_await(
+					(net::iequals(hc.type, "http") ? http_probe(m, site) : tcp_probe(m)) ||
+					net::timeout(std::chrono::seconds(hc.timeout)));
+				if (net::is_timeout(result))
+					ec = net::error::timed_out;
+				else
+					ec = std::get<0>(result);
+			}
+
+			m.check_latency = ec ? -1 : std::chrono::duration_cast<std::chrono::milliseconds>(
+				std::chrono::steady_clock::now() - begin).count();
+
+			update_health_state(m, site, ec);
+
+			if (aborted.test())
+				break;
+
+			t.expires_after(std::chrono::seconds(hc.interval));
+			auto [e1] = co_await t.async_wait(net::use_nothrow_awaitable);
+			if (e1)
+				break;
+		}
+	}
+}
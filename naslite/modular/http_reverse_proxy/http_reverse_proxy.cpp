@@ -1,15 +1,20 @@
 #include "http_reverse_proxy.h"
 
 #include "../../main/app.hpp"
-#include "proxy_set_header.hpp"
+#include "../../core/splice.hpp"
+
+#include "health_check.hpp"
 
-#include <asio3/tcp/connect.hpp>
 #include <asio3/http/relay.hpp>
 #include <asio3/core/defer.hpp>
 
 namespace nas
 {
 	using safety = http_reverse_proxy::safety;
+	using shard = http_reverse_proxy::shard;
+	using site_context = http_reverse_proxy::site_context;
+	using site_metrics = http_reverse_proxy::site_metrics;
+	using node_metrics = http_reverse_proxy::node_metrics;
 	using node = http_reverse_proxy::node;
 
 	template<typename T>
@@ -29,6 +34,151 @@ namespace nas
 		net::ignore_unused(p, server);
 	}
 
+	site_metrics make_site_metrics(std::shared_ptr<node>& p, proxy_site_info& site)
+	{
+		metrics_registry& r = app.metrics;
+
+		metric_labels labels{ { "proxy", net::locale_to_utf8(p->cfg.name) }, { "site", site.domain } };
+
+		auto responses = [&r, &labels](std::string code) mutable
+		{
+			metric_labels l = labels;
+			l.emplace_back("code", std::move(code));
+			return std::addressof(r.counter("naslite_http_proxy_responses_total",
+				"The responses sent to the client by status class.", l));
+		};
+
+		return site_metrics{
+			.requests = r.counter("naslite_http_proxy_requests_total",
+				"The requests relayed to the upstream.", labels),
+			.responses = { responses("1xx"), responses("2xx"), responses("3xx"), responses("4xx"), responses("5xx") },
+			.upstream_errors = r.counter("naslite_http_proxy_upstream_errors_total",
+				"The requests failed because no upstream member can be connected.", labels),
+			.received_bytes = r.counter("naslite_http_proxy_received_bytes_total",
+				"The bytes received from the client.", labels),
+			.sent_bytes = r.counter("naslite_http_proxy_sent_bytes_total",
+				"The bytes sent to the client.", labels),
+			.connect_time = r.histogram("naslite_http_proxy_upstream_connect_seconds",
+				"The time of connecting to the upstream member, the pooled connections are not counted.", labels),
+			.first_byte_time = r.histogram("naslite_http_proxy_upstream_first_byte_seconds",
+				"The time from the request was relayed to the response header was received.", labels),
+		};
+	}
+
+	node_metrics make_node_metrics(std::shared_ptr<node>& p)
+	{
+		metrics_registry& r = app.metrics;
+
+		metric_labels labels{ { "proxy", net::locale_to_utf8(p->cfg.name) } };
+
+		return node_metrics{
+			.connections = r.gauge("naslite_http_proxy_connections",
+				"The client connections which are alive.", labels),
+			.rejected = r.counter("naslite_http_proxy_rejected_total",
+				"The client connections rejected by the ip blacklist.", labels),
+		};
+	}
+
+	inline void count_response(site_metrics& m, unsigned status) noexcept
+	{
+		std::size_t index = (std::clamp)(status / 100u, 1u, 5u) - 1;
+		m.responses[index]->add();
+	}
+
+	bool init_ssl_context(std::shared_ptr<node>& p, net::ssl::context& sslctx)
+	{
+		auto cert_file_path = to_canonical_path(app.exe_directory, p->cfg.cert_file);
+		auto key_file_path = to_canonical_path(app.exe_directory, p->cfg.key_file);
+
+		// nginx: ssl->ctx = SSL_CTX_new(SSLv23_method());
+		net::error_code ec{};
+		sslctx.set_options(
+			net::ssl::context::default_workarounds |
+			net::ssl::context::no_sslv2 |
+			net::ssl::context::single_dh_use, ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl options failed: {} {}", p->cfg.name, ec.message());
+			return false;
+		}
+		sslctx.use_certificate_chain_file(cert_file_path.string(), ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl certificate chain for '{}' failed: {} {}",
+				p->cfg.name, p->cfg.cert_file, ec.message());
+			return false;
+		}
+		sslctx.use_private_key_file(key_file_path.string(), asio::ssl::context::pem, ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl private key for '{}' failed: {} {}",
+				p->cfg.name, p->cfg.key_file, ec.message());
+			return false;
+		}
+		//sslctx.set_verify_mode(net::ssl::verify_peer);
+		//sslctx.set_verify_callback(
+		//	[](bool preverified, net::ssl::verify_context& ctx)
+		//	{
+		//		char subject_name[256];
+		//		X509* cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
+		//		X509_NAME_oneline(X509_get_subject_name(cert), subject_name, sizeof(subject_name));
+		//		app.logger->error("    ssl::verify_callback: {} {}", preverified, subject_name);
+		//		return preverified;
+		//	}
+		//);
+
+		return true;
+	}
+
+// only the SO_REUSEPORT of linux and the SO_REUSEPORT_LB of freebsd balance the connections
+// between the acceptors, the SO_REUSEPORT of the other bsd and macos only lets them bind the
+// same port, then one acceptor gets all the connections, so the shards use the round robin.
+#if ASIO3_OS_LINUX && defined(SO_REUSEPORT)
+#define NAS_REUSE_PORT SO_REUSEPORT
+#elif defined(SO_REUSEPORT_LB)
+#define NAS_REUSE_PORT SO_REUSEPORT_LB
+#endif
+
+#if defined(NAS_REUSE_PORT)
+	using reuse_port = net::detail::socket_option::boolean<SOL_SOCKET, NAS_REUSE_PORT>;
+
+	// same as tcp_server::async_listen, but each shard binds its own acceptor to the same
+	// endpoint, then the kernel balances the incoming connections between the acceptors.
+	net::awaitable<std::tuple<net::error_code, net::ip::tcp::endpoint>> async_listen_reuse_port(
+		auto& server, const std::string& listen_address, std::uint16_t listen_port)
+	{
+		net::ip::tcp::resolver resolver(server->get_executor());
+
+		auto [e1, eps] = co_await resolver.async_resolve(listen_address, std::to_string(listen_port),
+			net::ip::resolver_base::passive, net::use_nothrow_awaitable);
+		if (e1)
+			co_return std::tuple{ e1, net::ip::tcp::endpoint{} };
+
+		net::error_code ec{};
+		net::ip::tcp::endpoint endpoint = (*eps.begin()).endpoint();
+
+		auto& acceptor = server->acceptor;
+
+		acceptor.open(endpoint.protocol(), ec);
+		if (!ec)
+			acceptor.set_option(net::socket_base::reuse_address(true), ec);
+		if (!ec)
+			acceptor.set_option(reuse_port(true), ec);
+		if (!ec)
+			acceptor.bind(endpoint, ec);
+		if (!ec)
+			acceptor.listen(net::socket_base::max_listen_connections, ec);
+		if (ec)
+		{
+			net::error_code ec_ignore{};
+			acceptor.close(ec_ignore);
+			co_return std::tuple{ ec, net::ip::tcp::endpoint{} };
+		}
+
+		co_return std::tuple{ ec, endpoint };
+	}
+#endif
+
 	net::awaitable<void> watchdog(std::chrono::steady_clock::time_point& deadline)
 	{
 		asio::steady_timer timer(co_await net::this_coro::executor);
@@ -43,31 +193,64 @@ namespace nas
 	}
 
 	net::awaitable<void> tcp_transfer(
-		auto& server, auto& from, auto& to, proxy_site_info& site, net::tcp_socket& backend,
-		std::chrono::steady_clock::time_point& deadline, std::shared_ptr<safety>& safety_ptr)
+		std::shared_ptr<node>& p, auto& from, auto& to, proxy_site_info& site, net::tcp_socket& backend,
+		std::chrono::steady_clock::time_point& deadline, std::size_t& transferred_bytes)
 	{
 		net::error_code ec{};
-		std::array<char, net::tcp_frame_size> data;
+		bool spliced = false;
 
-		for (;;)
+		auto update_deadline = [&deadline]() mutable
 		{
 			deadline = (std::max)(deadline, std::chrono::steady_clock::now() + std::chrono::minutes(10));
+		};
 
-			safety_ptr->deadline = std::max(
-				safety_ptr->deadline, std::chrono::steady_clock::now() + std::chrono::minutes(10));
-
-			auto [e1, n1] = co_await from.async_read_some(net::buffer(data), net::use_nothrow_awaitable);
-			if (e1)
+	#if ASIO3_OS_LINUX
+		// both sides are plain tcp sockets, move the data by splice() in the kernel,
+		// the tls stream must be decrypted in the user space, so it can't be spliced.
+		if constexpr (
+			std::same_as<std::remove_cvref_t<decltype(from)>, net::tcp_socket> &&
+			std::same_as<std::remove_cvref_t<decltype(to)>, net::tcp_socket>)
+		{
+			if (splice_pipe pipe; pipe.is_open())
 			{
-				//app.logger->debug("tcp_transfer::read  failed: {} {}", site.domain, e1.message());
-				break;
+				spliced = true;
+
+				update_deadline();
+
+				auto [e1, n1] = co_await async_splice_transfer(pipe, from, to,
+				[&p, &transferred_bytes, &update_deadline](std::size_t n) mutable
+				{
+					transferred_bytes += n;
+					update_deadline();
+					return !p->aborted.test();
+				});
+				net::ignore_unused(e1, n1);
 			}
+		}
+	#endif
+
+		if (!spliced)
+		{
+			std::array<char, net::tcp_frame_size> data;
 
-			auto [e2, n2] = co_await net::async_write(to, net::buffer(data, n1), net::use_nothrow_awaitable);
-			if (e2 || server->is_aborted())
+			for (;;)
 			{
-				//app.logger->debug("tcp_transfer::write failed: {} {}", site.domain, e2.message());
-				break;
+				update_deadline();
+
+				auto [e1, n1] = co_await from.async_read_some(net::buffer(data), net::use_nothrow_awaitable);
+				if (e1)
+				{
+					//app.logger->debug("tcp_transfer::read  failed: {} {}", site.domain, e1.message());
+					break;
+				}
+
+				auto [e2, n2] = co_await net::async_write(to, net::buffer(data, n1), net::use_nothrow_awaitable);
+				transferred_bytes += n2;
+				if (e2 || p->aborted.test())
+				{
+					//app.logger->debug("tcp_transfer::write failed: {} {}", site.domain, e2.message());
+					break;
+				}
 			}
 		}
 
@@ -78,28 +261,37 @@ namespace nas
 	}
 
 	net::awaitable<void> do_transfer(
-		std::shared_ptr<node>& p, auto& server, auto& client, auto& backend,
-		std::shared_ptr<safety>& safety_ptr, proxy_site_info& site,
+		std::shared_ptr<node>& p, auto& client, auto& backend, proxy_site_info& site,
 		auto& client_endp, auto& client_ip, auto client_port)
 	{
 		std::chrono::steady_clock::time_point client_to_server_deadline{};
 		std::chrono::steady_clock::time_point server_to_client_deadline{};
 
+		std::size_t client_to_server_bytes = 0;
+		std::size_t server_to_client_bytes = 0;
+
 		co_await
 		(
 			(
-				tcp_transfer(server, client, backend, site, backend, client_to_server_deadline, safety_ptr) ||
+				tcp_transfer(p, client, backend, site, backend,
+					client_to_server_deadline, client_to_server_bytes) ||
 				watchdog(client_to_server_deadline)
 			)
 			&&
 			(
-				tcp_transfer(server, backend, client, site, backend, server_to_client_deadline, safety_ptr) ||
+				tcp_transfer(p, backend, client, site, backend,
+					server_to_client_deadline, server_to_client_bytes) ||
 				watchdog(server_to_client_deadline)
 			)
 		);
 
-		app.logger->debug("coroutine returned: {}:{} {} {}:{}",
-			client_ip, client_port, site.host, site.port, site.domain);
+		site_metrics& m = p->sites.at(std::addressof(site))->metrics;
+		m.received_bytes.add(client_to_server_bytes);
+		m.sent_bytes.add(server_to_client_bytes);
+
+		NAS_LOG_DEBUG("coroutine returned: {}:{} {} {}:{} sent: {} recvd: {}",
+			client_ip, client_port, site.host, site.port, site.domain,
+			client_to_server_bytes, server_to_client_bytes);
 	}
 
 	request_info get_request_info(auto& session, auto& req)
@@ -122,9 +314,61 @@ namespace nas
 		}
 	}
 
+	void close_conns(std::shared_ptr<safety>& safety_ptr)
+	{
+		for (auto& [k, v] : safety_ptr->conns)
+		{
+			std::visit([](auto& p)
+				{
+					net::error_code ec{};
+					p->lowest_layer().shutdown(net::socket_base::shutdown_both, ec);
+					p->lowest_layer().close(ec);
+				}, v);
+		}
+	}
+
+	// must be called in the io thread of the shard.
+	std::shared_ptr<safety> find_or_add_safety(std::shared_ptr<shard>& s, const net::ip::address& client_addr)
+	{
+		if (auto it = s->safety_map.find(client_addr); it != s->safety_map.end())
+			return it->second;
+
+		std::shared_ptr<safety> safety_ptr = std::make_shared<safety>();
+
+		s->safety_map.emplace(client_addr, safety_ptr);
+
+		return safety_ptr;
+	}
+
+	bool is_blacklisted(std::shared_ptr<node>& p, const net::ip::address& client_addr)
+	{
+		std::optional<ip_reputation::state> st = p->reputation->find(client_addr);
+
+		return st && st->is_blacklisted();
+	}
+
+	// the live connections are tracked by each shard, so the connections of the blacklisted
+	// ip must be closed in the other shards too.
+	void post_blacklist(std::shared_ptr<node>& p, std::shared_ptr<shard>& s, const net::ip::address& client_addr)
+	{
+		for (std::shared_ptr<shard>& other : p->shards)
+		{
+			if (other == s)
+				continue;
+
+			net::post(other->ctx.get_executor(), [other, client_addr]() mutable
+			{
+				if (auto it = other->safety_map.find(client_addr); it != other->safety_map.end())
+				{
+					close_conns(it->second);
+				}
+			});
+		}
+	}
+
 	bool check_auth(
-		std::shared_ptr<node>& p, std::shared_ptr<safety>& safety_ptr,
-		proxy_site_info& site, auto& req, auto& rep, auto& client_ip, auto client_port)
+		std::shared_ptr<node>& p, std::shared_ptr<shard>& s, std::shared_ptr<safety>& safety_ptr,
+		proxy_site_info& site, auto& req, auto& rep, auto& client_endp, auto& client_ip, auto client_port)
 	{
 		if (!site.requires_auth || site.auth_roles.empty())
 			return true;
@@ -150,10 +394,9 @@ namespace nas
 
 			if (rep.result_int() == role.result)
 			{
-				safety_ptr->has_authed = true;
-				safety_ptr->auth_failed_times = 0;
+				p->reputation->erase(client_endp.address());
 
-				app.logger->debug("http_reverse_proxy: authed success: {}:{} {} {} {}",
+				NAS_LOG_DEBUG("http_reverse_proxy: authed success: {}:{} {} {} {}",
 					client_ip, client_port, site.domain, req.method_string(), req.target());
 
 				return true;
@@ -163,30 +406,27 @@ namespace nas
 				app.logger->error("http_reverse_proxy: authed failure: {}:{} {} {} {}",
 					client_ip, client_port, site.domain, req.method_string(), req.target());
 
-				safety_ptr->auth_failed_times++;
-
-				if (safety_ptr->auth_failed_times > 3)
+				ip_reputation::state current = p->reputation->update(client_endp.address(),
+				[&p](ip_reputation::state& st) mutable
 				{
-					safety_ptr->deadline = std::max(safety_ptr->deadline,
-						std::chrono::steady_clock::now() + std::chrono::minutes(p->cfg.ip_blacklist_minutes));
+					st.auth_failed_times++;
+
+					if (st.is_blacklisted())
+						st.deadline = (std::max)(st.deadline,
+							ip_reputation::after(std::chrono::minutes(p->cfg.ip_blacklist_minutes)));
+					else
+						st.deadline = (std::max)(st.deadline,
+							ip_reputation::after(std::chrono::minutes(10 * st.auth_failed_times)));
+				});
 
+				if (current.is_blacklisted())
+				{
 					app.logger->critical("http_reverse_proxy: authed failed too much: {}:{} {} {}",
 						client_ip, client_port, site.domain, req.target());
 
-					for (auto& [k, v] : safety_ptr->conns)
-					{
-						std::visit([](auto& p)
-							{
-								net::error_code ec{};
-								p->lowest_layer().shutdown(net::socket_base::shutdown_both, ec);
-								p->lowest_layer().close(ec);
-							}, v);
-					}
-				}
-				else
-				{
-					safety_ptr->deadline = std::max(safety_ptr->deadline, std::chrono::steady_clock::now() +
-						std::chrono::minutes(10 * safety_ptr->auth_failed_times));
+					close_conns(safety_ptr);
+
+					post_blacklist(p, s, client_endp.address());
 				}
 
 				return false;
@@ -196,17 +436,127 @@ namespace nas
 		return true;
 	}
 
+	// select a member of the upstream group, take a idle connection from the pool of the member,
+	// or connect to it if there is none, the next member is tried if the connection failed.
+	net::awaitable<net::error_code> connect_backend(
+		std::shared_ptr<shard>& s, site_context& ctx, const net::ip::address& client_addr,
+		net::tcp_socket& backend, upstream_pool*& pool, std::size_t& member,
+		std::uint32_t& backend_requests, bool& reused)
+	{
+		upstream_group& upstream = ctx.upstream;
+
+		net::error_code ec = net::error::host_unreachable;
+
+		for (std::uint64_t tried = 0;;)
+		{
+			std::size_t index = upstream.select(client_addr, tried);
+			if (index == upstream_group::npos)
+				co_return ec;
+
+			tried |= std::uint64_t(1) << index;
+
+			upstream_member& m = *upstream.members[index];
+
+			pool = nullptr;
+			if (auto it = s->upstream_pools.find(std::addressof(m)); it != s->upstream_pools.end())
+				pool = std::addressof(it->second);
+
+			if (pool)
+			{
+				if (std::optional<upstream_pool::connection> conn = pool->acquire(); conn)
+				{
+					backend = std::move(conn->socket);
+					backend_requests = conn->requests;
+					reused = true;
+					member = index;
+					m.active++;
+					co_return net::error_code{};
+				}
+			}
+
+			auto begin = std::chrono::steady_clock::now();
+
+			ec = co_await async_connect_host(backend, m.cfg.host, m.cfg.port,
+				ctx.connect_attempt_delay, ctx.connect_timeout);
+			if (!ec)
+			{
+				ctx.metrics.connect_time.record(std::chrono::steady_clock::now() - begin);
+
+				upstream.on_connect_success(index);
+				backend_requests = 0;
+				reused = false;
+				member = index;
+				m.active++;
+				co_return ec;
+			}
+
+			upstream.on_connect_failure(index);
+
+			NAS_LOG_DEBUG("connect to upstream member failed: {}:{} {}",
+				m.cfg.host, m.cfg.port, ec.message());
+		}
+	}
+
+	// the header of the request must have been read already.
+	net::awaitable<std::tuple<net::error_code, std::uintptr_t, std::size_t, std::size_t>> relay_request(
+		auto& session, site_context& ctx, net::tcp_socket& backend, upstream_member& m,
+		std::uint32_t& backend_requests, bool reused,
+		beast::flat_buffer& buffer, http::request_parser<http::buffer_body>& parser)
+	{
+		auto [e1, p1, r1, w1] = co_await http::relay(session->get_stream(), backend, buffer, parser);
+
+		// the backend may close the pooled connection at the same time we reuse it, nothing
+		// has been sent yet in this case, so it is safe to retry with a new connection.
+		if (e1 && reused && w1 == 0 && p1 == reinterpret_cast<std::uintptr_t>(std::addressof(backend)))
+		{
+			net::error_code ec{};
+			backend.close(ec);
+
+			backend_requests = 0;
+
+			if (auto e2 = co_await async_connect_host(backend, m.cfg.host, m.cfg.port,
+				ctx.connect_attempt_delay, ctx.connect_timeout); e2)
+				co_return std::tuple{ e2, p1, r1, w1 };
+
+			co_return co_await http::relay(session->get_stream(), backend, buffer, parser);
+		}
+
+		co_return std::tuple{ e1, p1, r1, w1 };
+	}
+
 	net::awaitable<void> do_site_transfer(
-		std::shared_ptr<node>& p, auto& server, auto& session, std::shared_ptr<safety>& safety_ptr,
+		std::shared_ptr<node>& p, std::shared_ptr<shard>& s, auto& session, std::shared_ptr<safety>& safety_ptr,
 		beast::flat_buffer& buffer,
 		http::request_parser<http::buffer_body>& parser, proxy_site_info& site,
 		auto& client_endp, auto& client_ip, auto client_port)
 	{
+		site_context& ctx = *p->sites.at(std::addressof(site));
+		proxy_headers& headers = ctx.headers;
+		upstream_group& upstream = ctx.upstream;
+		connection_variables vars{ headers };
+
+		net::ip::address client_addr = client_endp.address();
 		net::tcp_socket backend(session->get_executor());
+		upstream_pool* pool = nullptr;
+		std::size_t member = upstream_group::npos;
+		std::uint32_t backend_requests = 0;
+		bool reused = false;
 
-		auto e8 = co_await net::connect(backend, site.host, site.port);
-		if (e8 || server->is_aborted())
+		// the connection is counted as in-flight of the member until it is released.
+		std::defer auto_release_member = [&upstream, &member]() mutable
 		{
+			if (member != upstream_group::npos)
+				upstream.members[member]->active--;
+		};
+
+		site_metrics& metrics = ctx.metrics;
+
+		auto e8 = co_await connect_backend(
+			s, ctx, client_addr, backend, pool, member, backend_requests, reused);
+		if (e8 || p->aborted.test())
+		{
+			metrics.upstream_errors.add();
+			count_response(metrics, 503);
 			app.logger->error("connect to backend service failed: {}:{} {} {}",
 				client_ip, client_port, site.domain, e8.message());
 			http::response<http::string_body> rep = http::make_error_page_response(http::status::service_unavailable);
@@ -214,25 +564,34 @@ namespace nas
 			co_return;
 		}
 
+		// the client stream is tracked too, the backend may be in the pool while the session
+		// is waiting for the next request, the blacklisted client must be closed then as well.
+		auto& client_stream = session->get_stream();
+
 		safety_ptr->conns.emplace(std::addressof(backend), std::addressof(backend));
-		std::defer auto_remove_conn = [&safety_ptr, &backend]() mutable
+		safety_ptr->conns.emplace(std::addressof(client_stream), std::addressof(client_stream));
+		std::defer auto_remove_conn = [&safety_ptr, &backend, &client_stream]() mutable
 		{
 			safety_ptr->conns.erase(std::addressof(backend));
+			safety_ptr->conns.erase(std::addressof(client_stream));
 		};
 
-		set_proxy_headers(site, get_request_info(session, parser.get()));
+		set_proxy_headers(headers, vars, get_request_info(session, parser.get()));
 
-		if (!site.proxy_set_header.empty())
+		// walking all the headers is only worth when they will be written.
+		if (!site.proxy_set_header.empty() && NAS_LOG_TRACE_ENABLED())
 		{
-			app.logger->trace("http_reverse_proxy::request: {} {}", parser.get().method_string(), parser.get().target());
+			NAS_LOG_TRACE("http_reverse_proxy::request: {} {}", parser.get().method_string(), parser.get().target());
 
 			for (auto it = parser.get().begin(); it != parser.get().end(); ++it)
 			{
-				app.logger->trace("    {}: {}", it->name_string(), it->value());
+				NAS_LOG_TRACE("    {}: {}", it->name_string(), it->value());
 			}
 		}
 
-		auto [e0, p0, r0, w0] = co_await http::relay(session->get_stream(), backend, buffer, parser);
+		auto [e0, p0, r0, w0] = co_await relay_request(
+			session, ctx, backend, *upstream.members[member], backend_requests, reused, buffer, parser);
+		metrics.received_bytes.add(w0);
 		if (e0)
 		{
 			app.logger->error("relay first http request failed: {}:{} {} {}",
@@ -240,45 +599,49 @@ namespace nas
 			co_return;
 		}
 
+		metrics.requests.add();
+
+		// the time point which the request was relayed, the time to first byte begins from it.
+		auto relayed_time = std::chrono::steady_clock::now();
+
 		auto req = parser.release();
 		auto log_level = app.logger->level();
 
-		if ((!site.requires_auth || site.auth_roles.empty()) && site.proxy_set_header.empty())
+		// the pooled backend connections must be returned at the end of each response,
+		// so the http messages must be parsed even if the site doesn't requires auth.
+		if ((!site.requires_auth || site.auth_roles.empty()) && site.proxy_set_header.empty() && !site.keepalive)
 		{
-			app.logger->debug("don't requries auth, switch to tcp transfer: {}:{} {}",
+			NAS_LOG_DEBUG("don't requries auth, switch to tcp transfer: {}:{} {}",
 				client_ip, client_port, site.domain);
 			if (auto b = buffer.data(); b.size())
 			{
-				app.logger->debug("send remaining data to backend: {}:{} {} {}",
+				NAS_LOG_DEBUG("send remaining data to backend: {}:{} {} {}",
 					client_ip, client_port, site.domain, b.size());
 				co_await net::async_write(backend, b, net::use_nothrow_awaitable);
 			}
 			co_return co_await do_transfer(
-				p, server, session->get_stream(), backend, safety_ptr, site, client_endp, client_ip, client_port);
+				p, session->get_stream(), backend, site, client_endp, client_ip, client_port);
 		}
 
 		beast::flat_buffer buffer_backend;
 
-		for (; !server->is_aborted();)
+		for (; !p->aborted.test();)
 		{
-			safety_ptr->deadline = std::max(
-				safety_ptr->deadline, std::chrono::steady_clock::now() + std::chrono::minutes(10));
-
-			app.logger->trace("recvd request: {}:{} {} {} {}",
+			NAS_LOG_TRACE("recvd request: {}:{} {} {} {}",
 				client_ip, client_port, site.domain, req.method_string(), req.target());
 
 			if (websocket::is_upgrade(req))
 			{
-				app.logger->debug("websocket upgrade, switch to tcp transfer: {}:{} {}",
+				NAS_LOG_DEBUG("websocket upgrade, switch to tcp transfer: {}:{} {}",
 					client_ip, client_port, site.domain);
 				if (auto b = buffer.data(); b.size())
 				{
-					app.logger->debug("send remaining data to backend: {}:{} {} {}",
+					NAS_LOG_DEBUG("send remaining data to backend: {}:{} {} {}",
 						client_ip, client_port, site.domain, b.size());
 					co_await net::async_write(backend, b, net::use_nothrow_awaitable);
 				}
 				co_return co_await do_transfer(
-					p, server, session->get_stream(), backend, safety_ptr, site, client_endp, client_ip, client_port);
+					p, session->get_stream(), backend, site, client_endp, client_ip, client_port);
 			}
 
 			http::response_parser<http::buffer_body> rep_parser;
@@ -289,7 +652,7 @@ namespace nas
 			}
 			if (req.method() == http::verb::head && log_level > spdlog::level::trace)
 			{
-				app.logger->trace("recvd head response begin: {}:{} {} [{}]",
+				NAS_LOG_TRACE("recvd head response begin: {}:{} {} [{}]",
 					client_ip, client_port, site.domain, req.target());
 				//std::array<char, 1024> buf;
 				//auto [e1, n1] = co_await net::async_read_some(backend, net::buffer(buf), net::use_nothrow_awaitable);
@@ -298,7 +661,12 @@ namespace nas
 				//co_await net::delay(std::chrono::seconds(1));
 			}
 			auto [e1, p1, r1, w1] = co_await http::relay(
-				backend, session->get_stream(), buffer_backend, rep_parser, [](auto&...) {});
+				backend, session->get_stream(), buffer_backend, rep_parser,
+				[&metrics, &relayed_time](auto&...) mutable
+				{
+					metrics.first_byte_time.record(std::chrono::steady_clock::now() - relayed_time);
+				});
+			metrics.sent_bytes.add(w1);
 			if (e1)
 			{
 				app.logger->error("relay response failed: {}:{} {} {} {}",
@@ -307,61 +675,123 @@ namespace nas
 			}
 			else
 			{
+				count_response(metrics, rep_parser.get().result_int());
+
 				if (req.method() == http::verb::head && log_level > spdlog::level::trace)
 				{
 					std::stringstream ss;
 					ss << rep_parser.get().base();
-					app.logger->trace("recvd head response end: {}:{} {} [{}]",
+					NAS_LOG_TRACE("recvd head response end: {}:{} {} [{}]",
 						client_ip, client_port, site.domain, ss.str());
 				}
 			}
 
-			if (!check_auth(p, safety_ptr, site, req, rep_parser.get(), client_ip, client_port) &&
-				safety_ptr->auth_failed_times > 3)
+			++backend_requests;
+
+			if (!check_auth(p, s, safety_ptr, site, req, rep_parser.get(), client_endp, client_ip, client_port) &&
+				is_blacklisted(p, client_endp.address()))
 				co_return;
 
 			if (!req.keep_alive())
 			{
-				app.logger->trace("keep alive of request is false, go exit: {}:{} {} {}",
+				NAS_LOG_TRACE("keep alive of request is false, go exit: {}:{} {} {}",
 					client_ip, client_port, site.domain, req.target());
 				break;
 			}
 
+			// the response is completed, give the backend connection back to the pool while
+			// waiting for the next request of the client, the remaining data in buffer_backend
+			// means the backend sent something unexpected, so don't reuse it in this case.
+			if (site.keepalive)
+			{
+				if (pool && rep_parser.get().keep_alive() && buffer_backend.size() == 0 &&
+					rep_parser.get().result() != http::status::switching_protocols)
+				{
+					pool->release(backend, backend_requests);
+				}
+				else
+				{
+					net::error_code ec{};
+					backend.shutdown(net::socket_base::shutdown_both, ec);
+					backend.close(ec);
+				}
+
+				upstream.members[member]->active--;
+				member = upstream_group::npos;
+			}
+
 			http::request_parser<http::buffer_body> req_parser;
 			req_parser.body_limit((std::numeric_limits<std::size_t>::max)());
-			auto req_header_cb = [&session, &site, &req_parser, log_level, &client_ip, client_port]
-			(auto& req, net::error_code&) mutable
+
+			auto [e2, n2] = co_await http::async_read_header(session->get_stream(), buffer, req_parser);
+			if (e2)
+			{
+				NAS_LOG_DEBUG("read request failed: {}:{} {} {} {}",
+					client_ip, client_port, site.domain, req.method_string(), e2.message());
+				break;
+			}
+
+			if (req_parser.get().method() == http::verb::head && site.skip_body_for_head_request)
+			{
+				req_parser.skip(true);
+			}
+
+			if (req_parser.get().method() == http::verb::head && log_level > spdlog::level::trace)
+			{
+				std::stringstream ss;
+				ss << req_parser.get().base();
+				NAS_LOG_TRACE("recvd head request begin: {}:{} {} [{}]",
+					client_ip, client_port, site.domain, ss.str());
+			}
+
+			set_proxy_headers(headers, vars, get_request_info(session, req_parser.get()));
+
+			if (!site.proxy_set_header.empty() && NAS_LOG_TRACE_ENABLED())
 			{
-				if (req.method() == http::verb::head && site.skip_body_for_head_request)
+				NAS_LOG_TRACE("http_reverse_proxy::request: {} {}",
+					req_parser.get().method_string(), req_parser.get().target());
+
+				for (auto it = req_parser.get().begin(); it != req_parser.get().end(); ++it)
 				{
-					req_parser.skip(true);
+					NAS_LOG_TRACE("    {}: {}", it->name_string(), it->value());
 				}
+			}
 
-				if (req.method() == http::verb::head && log_level > spdlog::level::trace)
+			if (!backend.is_open())
+			{
+				// the ip may be blacklisted by another session while this one was idle.
+				if (is_blacklisted(p, client_addr))
 				{
-					std::stringstream ss;
-					ss << req.base();
-					app.logger->trace("recvd head request begin: {}:{} {} [{}]",
-						client_ip, client_port, site.domain, ss.str());
+					NAS_LOG_DEBUG("the client is blacklisted, go exit: {}:{} {}",
+						client_ip, client_port, site.domain);
+					break;
 				}
 
-				set_proxy_headers(site, get_request_info(session, req));
-
-				if (!site.proxy_set_header.empty())
+				auto e4 = co_await connect_backend(
+					s, ctx, client_addr, backend, pool, member, backend_requests, reused);
+				if (e4 || p->aborted.test())
 				{
-					app.logger->trace("http_reverse_proxy::request: {} {}", req.method_string(), req.target());
-
-					for (auto it = req.begin(); it != req.end(); ++it)
-					{
-						app.logger->trace("    {}: {}", it->name_string(), it->value());
-					}
+					metrics.upstream_errors.add();
+					count_response(metrics, 503);
+					app.logger->error("connect to backend service failed: {}:{} {} {}",
+						client_ip, client_port, site.domain, e4.message());
+					http::response<http::string_body> rep =
+						http::make_error_page_response(http::status::service_unavailable);
+					co_await http::async_write(session->get_stream(), rep);
+					break;
 				}
-			};
-			auto [e3, p3, r3, w3] = co_await http::relay(
-				session->get_stream(), backend, buffer, req_parser, req_header_cb);
+			}
+			else
+			{
+				reused = false;
+			}
+
+			auto [e3, p3, r3, w3] = co_await relay_request(
+				session, ctx, backend, *upstream.members[member], backend_requests, reused, buffer, req_parser);
+			metrics.received_bytes.add(w3);
 			if (e3)
 			{
-				app.logger->debug("relay request failed: {}:{} {} {} {}",
+				NAS_LOG_DEBUG("relay request failed: {}:{} {} {} {}",
 					client_ip, client_port, site.domain, req.method_string(), e3.message());
 				break;
 			}
@@ -369,17 +799,21 @@ namespace nas
 			{
 				if (req_parser.get().method() == http::verb::head && log_level > spdlog::level::trace)
 				{
-					app.logger->trace("recvd head request end: {}:{} {} [{}]",
+					NAS_LOG_TRACE("recvd head request end: {}:{} {} [{}]",
 						client_ip, client_port, site.domain, req_parser.get().target());
 				}
 			}
 
+			metrics.requests.add();
+
+			relayed_time = std::chrono::steady_clock::now();
+
 			req = req_parser.release();
 		}
 	}
 
 	net::awaitable<void> do_recv(
-		std::shared_ptr<node>& p, auto& server, auto& session, std::shared_ptr<safety>& safety_ptr,
+		std::shared_ptr<node>& p, std::shared_ptr<shard>& s, auto& session, std::shared_ptr<safety>& safety_ptr,
 		auto& client_endp, auto& client_ip, auto client_port)
 	{
 		beast::flat_buffer buffer;
@@ -418,71 +852,43 @@ namespace nas
 		}
 		else
 		{
-			co_await do_site_transfer(p, server, session, safety_ptr, buffer, parser,
+			co_await do_site_transfer(p, s, session, safety_ptr, buffer, parser,
 				it_site->second, client_endp, client_ip, client_port);
 		}
 	}
 
 	net::awaitable<void> do_session(
-		std::shared_ptr<node>& p, auto& server, auto& session, std::shared_ptr<safety>& safety_ptr,
+		std::shared_ptr<node>& p, std::shared_ptr<shard>& s, auto& server, auto& session,
+		std::shared_ptr<safety>& safety_ptr,
 		auto& client_endp, auto& client_ip, auto client_port)
 	{
 		co_await server->session_map.async_add(session);
 		co_await
 		(
-			do_recv(p, server, session, safety_ptr, client_endp, client_ip, client_port) ||
+			do_recv(p, s, session, safety_ptr, client_endp, client_ip, client_port) ||
 			net::watchdog(session->alive_time, net::http_idle_timeout)
 		);
 		co_await server->session_map.async_remove(session);
 	}
 
-	net::awaitable<void> do_auth_persist(
-		std::shared_ptr<node> p, std::shared_ptr<safety> safety_ptr,
-		auto client_endp, auto client_ip, auto client_port)
-	{
-		net::steady_timer t(co_await net::this_coro::executor);
-		safety_ptr->timer = std::addressof(t);
-		while (safety_ptr->deadline > std::chrono::steady_clock::now())
-		{
-			t.expires_at(safety_ptr->deadline);
-			auto [e1] = co_await t.async_wait(net::use_nothrow_awaitable);
-			if (e1)
-				break;
-		}
-		p->safety_map.erase(client_endp.address());
-	}
-
 	std::tuple<bool, std::shared_ptr<safety>> safety_check(
-		std::shared_ptr<node>& p, auto& client, auto& client_endp, auto& client_ip, auto client_port)
+		std::shared_ptr<node>& p, std::shared_ptr<shard>& s, auto& client_endp, auto& client_ip, auto client_port)
 	{
-		std::shared_ptr<safety> safety_ptr;
-		if (auto it = p->safety_map.find(client_endp.address()); it == p->safety_map.end())
+		if (is_blacklisted(p, client_endp.address()))
 		{
-			safety_ptr = std::make_shared<safety>();
-			safety_ptr->has_authed = false;
-			safety_ptr->auth_failed_times = 0;
-			safety_ptr->deadline = std::chrono::steady_clock::now() + std::chrono::minutes(10);
-
-			it = p->safety_map.emplace(client_endp.address(), safety_ptr).first;
-
-			net::co_spawn(client.get_executor(), do_auth_persist(
-				p, safety_ptr, client_endp, client_ip, client_port), net::detached);
-		}
-		else
-		{
-			safety_ptr = it->second;
-			if (safety_ptr->auth_failed_times > 3)
-			{
-				app.logger->error("http_reverse_proxy: reject a client from blacklist: {}:{}",
-					client_ip, client_port);
-				return { false, std::move(safety_ptr)};
-			}
+			p->metrics->rejected.add();
+			app.logger->error("http_reverse_proxy: reject a client from blacklist: {}:{}",
+				client_ip, client_port);
+			return { false, nullptr };
 		}
 
+		std::shared_ptr<safety> safety_ptr = find_or_add_safety(s, client_endp.address());
+		safety_ptr->sessions++;
+
 		return { true, std::move(safety_ptr) };
 	}
 
-	net::awaitable<void> client_join(std::shared_ptr<node> p, auto& server, auto client)
+	net::awaitable<void> client_join(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server, auto client)
 	{
 		net::error_code ec{};
 		auto client_endp = client.lowest_layer().remote_endpoint(ec);
@@ -494,19 +900,28 @@ namespace nas
 		auto client_ip = client_endp.address().to_string(ec);
 		auto client_port = client_endp.port();
 
-		p->client_count++;
-		app.logger->trace("client join: {}:{} current client count: {}", client_ip, client_port, p->client_count);
+		int client_count = ++p->client_count;
+		p->metrics->connections.add();
+		NAS_LOG_TRACE("client join: {}:{} current client count: {}", client_ip, client_port, client_count);
 
 		std::defer auto_log_when_destroyed = [&p, &client_ip, client_port]() mutable
 		{
-			p->client_count--;
-			app.logger->trace("client exit: {}:{} current client count: {}", client_ip, client_port, p->client_count);
+			p->metrics->connections.sub();
+			int client_count = --p->client_count;
+			NAS_LOG_TRACE("client exit: {}:{} current client count: {}", client_ip, client_port, client_count);
 		};
 
-		auto [result, safety_ptr] = safety_check(p, client, client_endp, client_ip, client_port);
+		auto [result, safety_ptr] = safety_check(p, s, client_endp, client_ip, client_port);
 		if (!result)
 			co_return;
 
+		// the ip is removed from the shard when all of its sessions are finished.
+		std::defer auto_release_safety = [&s, &safety_ptr, &client_endp]() mutable
+		{
+			if (--safety_ptr->sessions == 0)
+				s->safety_map.erase(client_endp.address());
+		};
+
 		if constexpr (is_https_server<decltype(server)>)
 		{
 			auto session = std::make_shared<net::https_session>(std::move(client), server->ssl_context);
@@ -518,21 +933,66 @@ namespace nas
 					client_ip, client_port, p->cfg.name, e2.message());
 				co_return;
 			}
-			co_await do_session(p, server, session, safety_ptr, client_endp, client_ip, client_port);
+			co_await do_session(p, s, server, session, safety_ptr, client_endp, client_ip, client_port);
 		}
 		else
 		{
 			auto session = std::make_shared<net::http_session>(std::move(client));
-			co_await do_session(p, server, session, safety_ptr, client_endp, client_ip, client_port);
+			co_await do_session(p, s, server, session, safety_ptr, client_endp, client_ip, client_port);
 		}
 	}
 
-	net::awaitable<void> start_server(std::shared_ptr<node> p, auto& server)
+	net::awaitable<void> sweep_upstream_pools(std::shared_ptr<node> p, std::shared_ptr<shard> s)
+	{
+		net::steady_timer t(co_await net::this_coro::executor);
+		s->sweep_timer = std::addressof(t);
+		while (!p->aborted.test())
+		{
+			t.expires_after(std::chrono::seconds(1));
+			auto [e1] = co_await t.async_wait(net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			for (auto& [member, pool] : s->upstream_pools)
+			{
+				pool.sweep();
+			}
+		}
+		s->sweep_timer = nullptr;
+	}
+
+	// one timer drives the timing wheel of the ip reputation table for all the shards.
+	net::awaitable<void> expire_ip_reputation(std::shared_ptr<node> p, std::shared_ptr<shard> s)
+	{
+		net::steady_timer t(co_await net::this_coro::executor);
+		s->expire_timer = std::addressof(t);
+		while (!p->aborted.test())
+		{
+			t.expires_after(std::chrono::seconds(1));
+			auto [e1] = co_await t.async_wait(net::use_nothrow_awaitable);
+			if (e1)
+				break;
+
+			p->reputation->expire();
+		}
+		s->expire_timer = nullptr;
+	}
+
+	net::awaitable<void> start_server(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server)
 	{
 		// delay some time to ensure the init log finished.
 		co_await net::delay(std::chrono::milliseconds(500));
 
+	#if defined(NAS_REUSE_PORT)
+		auto [ec, ep] = co_await async_listen_reuse_port(server, p->cfg.listen_address, p->cfg.listen_port);
+	#else
+		// without the balanced reuse port only the first shard listens, and the accepted
+		// clients are dispatched to all the shards in turn.
+		if (s->index > 0)
+			co_return;
+
 		auto [ec, ep] = co_await server->async_listen(p->cfg.listen_address, p->cfg.listen_port);
+	#endif
 		if (ec)
 		{
 			app.logger->error("http_reverse_proxy listen failure: {} {}:{} {}",
@@ -540,9 +1000,10 @@ namespace nas
 			co_return;
 		}
 
-		app.logger->info("http_reverse_proxy listen success: {} {}:{}",
-			p->cfg.name, server->get_listen_address(), server->get_listen_port());
+		app.logger->info("http_reverse_proxy listen success: {} {}:{} thread: {}",
+			p->cfg.name, server->get_listen_address(), server->get_listen_port(), s->index);
 
+	#if defined(NAS_REUSE_PORT)
 		while (!server->is_aborted())
 		{
 			auto [e1, client] = co_await server->acceptor.async_accept();
@@ -552,9 +1013,31 @@ namespace nas
 			}
 			else
 			{
-				net::co_spawn(server->get_executor(), client_join(p, server, std::move(client)), net::detached);
+				net::co_spawn(server->get_executor(), client_join(p, s, server, std::move(client)), net::detached);
+			}
+		}
+	#else
+		std::size_t next = 0;
+
+		while (!server->is_aborted())
+		{
+			std::shared_ptr<shard>& target = p->shards[next++ % p->shards.size()];
+			auto& target_server = std::get<std::remove_cvref_t<decltype(server)>>(target->server);
+
+			net::tcp_socket client(target_server->get_executor());
+
+			auto [e1] = co_await server->acceptor.async_accept(client);
+			if (e1)
+			{
+				co_await net::delay(std::chrono::milliseconds(100));
+			}
+			else
+			{
+				net::co_spawn(target_server->get_executor(),
+					client_join(p, target, target_server, std::move(client)), net::detached);
 			}
 		}
+	#endif
 	}
 
 	http_reverse_proxy::http_reverse_proxy() : imodular()
@@ -574,67 +1057,106 @@ namespace nas
 
 			p->cfg = std::move(cfg);
 
-			if /**/ (net::iequals(p->cfg.protocol, "http"))
+			if (!net::iequals(p->cfg.protocol, "http") && !net::iequals(p->cfg.protocol, "https"))
 			{
-				p->server = std::make_shared<net::http_server>(p->ctx.get_executor());
+				app.logger->error("    the protocol config '{}' of '{}' is invalid",
+					p->cfg.protocol, p->cfg.name);
+				continue;
 			}
-			else if (net::iequals(p->cfg.protocol, "https"))
+
+			p->metrics.emplace(make_node_metrics(p));
+
+			for (auto& [domain, site] : p->cfg.proxy_sites)
 			{
-				auto cert_file_path = to_canonical_path(app.exe_directory, p->cfg.cert_file);
-				auto key_file_path = to_canonical_path(app.exe_directory, p->cfg.key_file);
+				std::vector<std::string> errors;
 
-				// nginx: ssl->ctx = SSL_CTX_new(SSLv23_method());
-				net::error_code ec{};
-				net::ssl::context sslctx(net::ssl::context::sslv23);
-				sslctx.set_options(
-					net::ssl::context::default_workarounds |
-					net::ssl::context::no_sslv2 |
-					net::ssl::context::single_dh_use, ec);
-				if (ec)
+				p->sites.emplace(std::addressof(site),
+					std::make_unique<site_context>(site, errors, make_site_metrics(p, site)));
+
+				for (std::string& error : errors)
 				{
-					app.logger->error("    set ssl options failed: {} {}", p->cfg.name, ec.message());
+					app.logger->error("    the proxy_set_header of '{}' is invalid: {}", site.domain, error);
+				}
+			}
+
+			p->reputation = std::make_unique<ip_reputation>(p->cfg.ip_blacklist_capacity, p->cfg.ip_blacklist_file);
+
+			if (!p->cfg.ip_blacklist_file.empty() && !p->reputation->is_persistent())
+			{
+				app.logger->error("    the ip_blacklist_file '{}' of '{}' can't be mapped, the blacklist is in memory only",
+					p->cfg.ip_blacklist_file, p->cfg.name);
+			}
+
+			std::size_t cpu_count = (std::max)(std::thread::hardware_concurrency(), 1u);
+			std::size_t worker_threads = p->cfg.worker_threads == 0 ? cpu_count : p->cfg.worker_threads;
+
+			// the cert and key are checked once before any shard thread is created.
+			if (!net::iequals(p->cfg.protocol, "http"))
+			{
+				net::ssl::context sslctx(net::ssl::context::sslv23);
+				if (!init_ssl_context(p, sslctx))
 					continue;
+			}
+
+			bool result = true;
+
+			for (std::size_t i = 0; i < worker_threads; ++i)
+			{
+				std::shared_ptr<shard> s = std::make_shared<shard>();
+
+				s->index = i;
+
+				if (net::iequals(p->cfg.protocol, "http"))
+				{
+					s->server = std::make_shared<net::http_server>(s->ctx.get_executor());
 				}
-				sslctx.use_certificate_chain_file(cert_file_path.string(), ec);
-				if (ec)
+				else
 				{
-					app.logger->error("    set ssl certificate chain for '{}' failed: {} {}",
-						p->cfg.name, p->cfg.cert_file, ec.message());
-					continue;
+					net::ssl::context sslctx(net::ssl::context::sslv23);
+					if (result = init_ssl_context(p, sslctx); !result)
+						break;
+
+					s->server = std::make_shared<net::https_server>(s->ctx.get_executor(), std::move(sslctx));
 				}
-				sslctx.use_private_key_file(key_file_path.string(), asio::ssl::context::pem, ec);
-				if (ec)
+
+				if (p->cfg.cpu_affinity && !set_thread_affinity(s->ctx.thread, i % cpu_count))
 				{
-					app.logger->error("    set ssl private key for '{}' failed: {} {}",
-						p->cfg.name, p->cfg.key_file, ec.message());
-					continue;
+					app.logger->error("    set cpu affinity for '{}' thread {} failed",
+						p->cfg.name, i);
 				}
-				//sslctx.set_verify_mode(net::ssl::verify_peer);
-				//sslctx.set_verify_callback(
-				//	[](bool preverified, net::ssl::verify_context& ctx)
-				//	{
-				//		char subject_name[256];
-				//		X509* cert = X509_STORE_CTX_get_current_cert(ctx.native_handle());
-				//		X509_NAME_oneline(X509_get_subject_name(cert), subject_name, sizeof(subject_name));
-				//		app.logger->error("    ssl::verify_callback: {} {}", preverified, subject_name);
-				//		return preverified;
-				//	}
-				//);
-
-				p->server = std::make_shared<net::https_server>(p->ctx.get_executor(), std::move(sslctx));
+
+				std::visit([&p](auto& server) mutable
+					{
+						init_server(p, server);
+					}, s->server);
+
+				for (auto& [domain, site] : p->cfg.proxy_sites)
+				{
+					if (site.keepalive == 0)
+						continue;
+
+					for (auto& m : p->sites.at(std::addressof(site))->upstream.members)
+					{
+						s->upstream_pools.emplace(m.get(), upstream_pool(
+							site.keepalive, std::chrono::seconds(site.keepalive_timeout), site.keepalive_requests));
+					}
+				}
+
+				p->shards.emplace_back(std::move(s));
 			}
-			else
+
+			// the shards which were created already are never started, their threads are joined,
+			// and the routers which hold the node are released with them.
+			if (!result)
 			{
-				app.logger->error("    the protocol config '{}' of '{}' is invalid",
-					p->cfg.protocol, p->cfg.name);
+				for (auto& s : p->shards)
+				{
+					s->ctx.join();
+				}
+				p->shards.clear();
 				continue;
 			}
 
-			std::visit([&p](auto& server) mutable
-				{
-					init_server(p, server);
-				}, p->server);
-
 			nodes.emplace_back(std::move(p));
 		}
 
@@ -645,44 +1167,92 @@ namespace nas
 	{
 		for (auto& p : nodes)
 		{
-			std::visit([&p](auto& server) mutable
+			for (auto& s : p->shards)
+			{
+				std::visit([&p, &s](auto& server) mutable
+					{
+						net::co_spawn(server->get_executor(), start_server(p, s, server), net::detached);
+					}, s->server);
+
+				if (!s->upstream_pools.empty())
 				{
-					net::co_spawn(server->get_executor(), start_server(p, server), net::detached);
-				}, p->server);
+					net::co_spawn(s->ctx.get_executor(), sweep_upstream_pools(p, s), net::detached);
+				}
+			}
+
+			// the health state is only modified in the first shard, the other shards only read
+			// the atomic flag of the member.
+			std::shared_ptr<shard>& s = p->shards.front();
+
+			net::co_spawn(s->ctx.get_executor(), expire_ip_reputation(p, s), net::detached);
+
+			for (auto& [domain, site] : p->cfg.proxy_sites)
+			{
+				if (!site.health_check.enable)
+					continue;
+
+				for (auto& m : p->sites.at(std::addressof(site))->upstream.members)
+				{
+					net::co_spawn(s->ctx.get_executor(),
+						health_check(*m, site, s->health_timers, p->aborted), net::detached);
+				}
+			}
 		}
 
+		app.event_dispatcher.append_listener(typeid(*this).name(), typeid(upstream_status_event),
+			[this](std::shared_ptr<ievent> e) mutable
+			{
+				std::shared_ptr<upstream_status_event> ev = std::static_pointer_cast<upstream_status_event>(e);
+				net::co_spawn(ev->ch.get_executor(), handle_event(ev), net::detached);
+			});
+
 		return true;
 	}
 
 	void http_reverse_proxy::stop()
 	{
+		app.event_dispatcher.remove_listener(typeid(*this).name());
+
 		for (auto& p : nodes)
 		{
-			std::visit([&p](auto& server) mutable
+			p->aborted.test_and_set();
+
+			for (auto& s : p->shards)
 			{
-				server->async_stop([&p](net::error_code)
+				std::visit([&s](auto& server) mutable
 				{
-					for (auto& [addr, ptr] : p->safety_map)
+					server->async_stop([&s](net::error_code)
 					{
-						if (ptr->timer)
-							net::cancel_timer(*(ptr->timer));
+						for (auto& [addr, ptr] : s->safety_map)
+						{
+							close_conns(ptr);
+						}
+
+						if (s->sweep_timer)
+							net::cancel_timer(*(s->sweep_timer));
 
-						for (auto& [k, v] : ptr->conns)
+						if (s->expire_timer)
+							net::cancel_timer(*(s->expire_timer));
+
+						for (net::steady_timer* t : s->health_timers)
 						{
-							std::visit([](auto& p)
-							{
-								net::error_code ec{};
-								p->lowest_layer().shutdown(net::socket_base::shutdown_both, ec);
-								p->lowest_layer().close(ec);
-							}, v);
+							net::cancel_timer(*t);
 						}
-					}
-				});
-			}, p->server);
+
+						for (auto& [member, pool] : s->upstream_pools)
+						{
+							pool.clear();
+						}
+					});
+				}, s->server);
+			}
 		}
 		for (auto& p : nodes)
 		{
-			p->ctx.join();
+			for (auto& s : p->shards)
+			{
+				s->ctx.join();
+			}
 		}
 	}
 
@@ -690,4 +1260,42 @@ namespace nas
 	{
 		nodes.clear();
 	}
+
+	net::awaitable<void> http_reverse_proxy::handle_event(std::shared_ptr<upstream_status_event> e)
+	{
+		for (auto& p : nodes)
+		{
+			// change thread to the first shard, the health check results are modified in it.
+			co_await net::dispatch(net::bind_executor(
+				p->shards.front()->ctx.get_executor(), net::use_nothrow_awaitable));
+
+			std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+
+			for (auto& [domain, site] : p->cfg.proxy_sites)
+			{
+				for (auto& m : p->sites.at(std::addressof(site))->upstream.members)
+				{
+					json item = json::object();
+					item["name"] = net::locale_to_utf8(p->cfg.name);
+					item["domain"] = site.domain;
+					item["host"] = m->cfg.host;
+					item["port"] = m->cfg.port;
+					item["weight"] = m->cfg.weight;
+					item["active"] = m->active.load(std::memory_order_relaxed);
+					item["health_check"] = site.health_check.enable ? site.health_check.type : "";
+					item["status"] = m->is_available(now) ? "up" : "down";
+					item["latency"] = m->check_latency;
+					item["message"] = m->check_message;
+					item["check_time"] = std::chrono::duration_cast<std::chrono::milliseconds>(
+						m->check_time.time_since_epoch()).count();
+
+					e->data.emplace_back(std::move(item));
+				}
+			}
+		}
+
+		// change thread to caller io_context
+		co_await net::dispatch(net::bind_executor(e->ch.get_executor(), net::use_nothrow_awaitable));
+		co_await e->ch.async_send(net::error_code{}, net::use_nothrow_awaitable);
+	}
 }
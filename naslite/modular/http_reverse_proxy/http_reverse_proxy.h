@@ -1,12 +1,22 @@
 #pragma once
 
 #include <variant>
+#include <atomic>
+#include <unordered_set>
 
 #include "../../core/net.hpp"
 #include "../../core/json.hpp"
 #include "../../core/iconfig.hpp"
 #include "../../core/utils.hpp"
 #include "../../core/imodular.hpp"
+#include "../../core/ip_reputation.hpp"
+#include "../../core/metrics.hpp"
+#include "../../core/dns_resolver.hpp"
+
+#include "upstream.hpp"
+#include "upstream_pool.hpp"
+#include "proxy_set_header.hpp"
+#include "upstream_status_event.hpp"
 
 #include <asio3/http/https_server.hpp>
 
@@ -17,23 +27,74 @@ namespace nas
 		, public pfr::base_dynamic_creator<imodular, http_reverse_proxy>
 	{
 	public:
+		// the live connections of a client ip in a shard, they are closed when the ip is blacklisted,
+		// the auth state of the ip is kept in the ip reputation table of the node.
 		struct safety
 		{
-			bool has_authed;
-			std::int32_t auth_failed_times;
-			std::chrono::steady_clock::time_point deadline;
-			net::steady_timer* timer = nullptr;
+			std::size_t sessions = 0;
 			std::unordered_map<void*,
 				std::variant<net::tcp_socket*, net::ssl::stream<net::tcp_socket>*>> conns;
 		};
 
-		struct node
+		// every shard is a listener thread with its own io_context, server and safety map,
+		// the sessions of a shard never touch the data of the other shards.
+		struct shard
 		{
-			http_reverse_proxy_info cfg{};
+			std::size_t index = 0;
 			net::io_context_thread ctx{ 1 };
 			std::variant<std::shared_ptr<net::http_server>, std::shared_ptr<net::https_server>> server;
 			std::unordered_map<net::ip::address, std::shared_ptr<safety>> safety_map;
-			int client_count = 0;
+			std::unordered_map<const upstream_member*, upstream_pool> upstream_pools;
+			net::steady_timer* sweep_timer = nullptr;
+			net::steady_timer* expire_timer = nullptr;
+			std::unordered_set<net::steady_timer*> health_timers;
+		};
+
+		struct site_metrics
+		{
+			metric_counter&   requests;
+			std::array<metric_counter*, 5> responses; // 1xx 2xx 3xx 4xx 5xx
+			metric_counter&   upstream_errors;
+			metric_counter&   received_bytes;
+			metric_counter&   sent_bytes;
+			metric_histogram& connect_time;
+			metric_histogram& first_byte_time;
+		};
+
+		struct node_metrics
+		{
+			metric_gauge&     connections;
+			metric_counter&   rejected;
+		};
+
+		// the runtime data of a proxy site, it is shared by all the shards.
+		struct site_context
+		{
+			site_context(proxy_site_info& site, std::vector<std::string>& errors, site_metrics m)
+				: headers(compile_proxy_headers(site, errors)), upstream(site), metrics(m)
+				, connect_attempt_delay(std::chrono::milliseconds(site.connect_attempt_delay))
+				, connect_timeout(std::chrono::seconds(site.connect_timeout))
+			{
+			}
+
+			proxy_headers  headers;
+			upstream_group upstream;
+			site_metrics   metrics;
+
+			// the addresses of a backend are raced by the happy eyeballs connect.
+			std::chrono::steady_clock::duration connect_attempt_delay;
+			std::chrono::steady_clock::duration connect_timeout;
+		};
+
+		struct node
+		{
+			http_reverse_proxy_info cfg{};
+			std::unordered_map<const proxy_site_info*, std::unique_ptr<site_context>> sites;
+			std::vector<std::shared_ptr<shard>> shards;
+			std::unique_ptr<ip_reputation> reputation;
+			std::optional<node_metrics> metrics;
+			std::atomic_flag aborted{};
+			std::atomic<int> client_count{ 0 };
 		};
 
 	public:
@@ -47,6 +108,8 @@ namespace nas
 
 		virtual void uninit() override;
 
+		net::awaitable<void> handle_event(std::shared_ptr<upstream_status_event> e);
+
 	public:
 		std::vector<std::shared_ptr<node>> nodes;
 	};
@@ -4,74 +4,232 @@
 
 namespace nas
 {
-	void set_proxy_headers(proxy_site_info& site, request_info info)
+	/**
+	 * A proxy_set_header value which is compiled into literal segments and variables at init,
+	 * so the value doesn't need to be parsed again for each request.
+	 * The string_views point into the proxy_set_header map of the site config.
+	 */
+	struct proxy_header_template
+	{
+		struct segment
+		{
+			std::string_view   literal;
+			ibuiltin_variable* variable = nullptr;
+			bool               per_connection = false;
+			std::size_t        slot = 0; // the index in connection_variables::slots
+		};
+
+		std::string_view     name;
+		std::vector<segment> segments;
+		std::size_t          literal_size = 0;
+		std::size_t          variable_count = 0;
+	};
+
+	struct proxy_headers
+	{
+		std::vector<proxy_header_template> headers;
+		std::size_t connection_slots = 0;
+		std::size_t max_variable_count = 0;
+	};
+
+	/**
+	 * The memoized per connection variables, and the reused buffers for the per request variables.
+	 */
+	struct connection_variables
+	{
+		struct slot
+		{
+			bool resolved = false;
+			std::optional<std::string> value;
+		};
+
+		std::vector<slot> slots;
+		std::vector<std::optional<std::string>> values;
+		std::vector<std::string_view> views;
+
+		explicit connection_variables(const proxy_headers& compiled)
+			: slots(compiled.connection_slots)
+			, values(compiled.max_variable_count)
+			, views(compiled.max_variable_count)
+		{
+		}
+	};
+
+	inline bool is_variable_char(char c) noexcept
+	{
+		return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+	}
+
+	// syntax is same as nginx: "$name" or "${name}", the name of "$name" ends at the first
+	// character which is not a letter, digit or underscore.
+	// the header which contains unknown variable is never set, so it is dropped and the reason
+	// is appended into the errors.
+	proxy_headers compile_proxy_headers(proxy_site_info& site, std::vector<std::string>& errors)
 	{
 		builtin_variables& builtin = builtin_variables::instance();
 
+		proxy_headers compiled;
+
+		std::map<ibuiltin_variable*, std::size_t> slots;
+
 		for (auto& [field_name, field_value] : site.proxy_set_header)
 		{
 			if (field_value.empty())
 				continue;
 
-			std::string_view variables = field_value;
+			proxy_header_template tpl;
+			tpl.name = field_name;
 
-			std::string value;
+			std::string_view value = field_value;
 
-			int total_vars = 0, failed_vars = 0;
+			auto add_literal = [&tpl](std::string_view literal) mutable
+			{
+				if (literal.empty())
+					return;
+				tpl.segments.emplace_back(proxy_header_template::segment{ .literal = literal });
+				tpl.literal_size += literal.size();
+			};
 
-			std::vector<std::string_view> vars;
-			std::size_t pos_start = 0, pos_begin = 0, pos_end;
-			while ((pos_end = variables.find('$', pos_start)) != std::string::npos)
+			auto add_variable = [&](std::string_view name) mutable -> bool
 			{
-				std::string_view token = variables.substr(pos_begin, pos_end - pos_begin);
-				pos_begin = pos_end;
-				pos_start = pos_end + 1;
-				vars.emplace_back(std::move(token));
-			}
-			vars.emplace_back(variables.substr(pos_begin));
+				ibuiltin_variable* var = builtin.find(name);
+				if (!var)
+					return false;
+
+				bool per_connection = var->is_per_connection();
+
+				std::size_t slot = 0;
+				if (per_connection)
+				{
+					slot = slots.emplace(var, slots.size()).first->second;
+				}
+
+				tpl.segments.emplace_back(proxy_header_template::segment{
+					.variable = var, .per_connection = per_connection, .slot = slot });
+				tpl.variable_count++;
+				return true;
+			};
 
-			value = vars.front();
+			std::string error;
 
-			for (std::size_t i = 1; i < vars.size(); ++i)
+			for (std::size_t pos = 0; pos < value.size() && error.empty();)
 			{
-				std::string_view var = vars[i];
+				std::size_t dollar = value.find('$', pos);
 
-				if (var.starts_with("${"))
+				add_literal(value.substr(pos, dollar - pos));
+
+				if (dollar == std::string_view::npos)
+					break;
+
+				if (dollar + 1 < value.size() && value[dollar + 1] == '{')
 				{
-					if (auto pos = var.find('}', 1); pos != std::string_view::npos)
+					std::size_t close = value.find('}', dollar + 2);
+					if (close == std::string_view::npos)
 					{
-						++total_vars;
-						std::optional<std::string> os = builtin.get_value(info, var.substr(2, pos - 2));
-						if (os)
-							value += std::move(os.value());
-						else
-							++failed_vars;
-						value += var.substr(pos + 1);
+						add_literal(value.substr(dollar));
+						break;
 					}
-					else
+
+					std::string_view name = value.substr(dollar + 2, close - dollar - 2);
+					if (!add_variable(name))
+						error = fmt::format("unknown variable '{}' in header '{}'", name, field_name);
+
+					pos = close + 1;
+				}
+				else
+				{
+					std::size_t end = dollar + 1;
+					while (end < value.size() && is_variable_char(value[end]))
+						++end;
+
+					if (end == dollar + 1)
 					{
-						value += var;
+						add_literal(value.substr(dollar, 1));
+						pos = end;
+						continue;
 					}
+
+					std::string_view name = value.substr(dollar + 1, end - dollar - 1);
+					if (!add_variable(name))
+						error = fmt::format("unknown variable '{}' in header '{}'", name, field_name);
+
+					pos = end;
+				}
+			}
+
+			if (!error.empty())
+			{
+				errors.emplace_back(std::move(error));
+				continue;
+			}
+
+			compiled.max_variable_count = (std::max)(compiled.max_variable_count, tpl.variable_count);
+			compiled.headers.emplace_back(std::move(tpl));
+		}
+
+		compiled.connection_slots = slots.size();
+
+		return compiled;
+	}
+
+	void set_proxy_headers(proxy_headers& compiled, connection_variables& vars, request_info info)
+	{
+		for (proxy_header_template& tpl : compiled.headers)
+		{
+			std::size_t size = tpl.literal_size, index = 0;
+
+			bool failed = false;
+
+			for (proxy_header_template::segment& seg : tpl.segments)
+			{
+				if (!seg.variable)
 					continue;
+
+				std::optional<std::string>* value = nullptr;
+
+				if (seg.per_connection)
+				{
+					connection_variables::slot& slot = vars.slots[seg.slot];
+					if (!slot.resolved)
+					{
+						slot.value = seg.variable->get_value(info);
+						slot.resolved = true;
+					}
+					value = std::addressof(slot.value);
+				}
+				else
+				{
+					value = std::addressof(vars.values[index]);
+					*value = seg.variable->get_value(info);
 				}
 
-				if (var.front() == '$')
+				if (!value->has_value())
 				{
-					++total_vars;
-					std::optional<std::string> os = builtin.get_value(info, var.substr(1));
-					if (os)
-						value += std::move(os.value());
-					else
-						++failed_vars;
-					continue;
+					failed = true;
+					break;
 				}
 
-				assert(false);
-				value += var;
+				vars.views[index++] = value->value();
+				size += value->value().size();
+			}
+
+			if (failed)
+				continue;
+
+			std::string result;
+			result.reserve(size);
+
+			index = 0;
+
+			for (proxy_header_template::segment& seg : tpl.segments)
+			{
+				if (seg.variable)
+					result += vars.views[index++];
+				else
+					result += seg.literal;
 			}
 
-			if (failed_vars == 0)
-				info.header.set(field_name, std::move(value));
+			info.header.set(tpl.name, std::move(result));
 		}
 	}
 }
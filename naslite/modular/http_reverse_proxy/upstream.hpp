@@ -0,0 +1,301 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+
+#include "../../core/net.hpp"
+#include "../../core/iconfig.hpp"
+
+namespace nas
+{
+	/**
+	 * A backend of the upstream group, the counters are atomic because the members are
+	 * shared by all the shards, the policy decision never takes any lock.
+	 */
+	struct upstream_member
+	{
+		upstream_server_info cfg;
+
+		// the connections which are using this member currently.
+		std::atomic<std::int32_t> active{ 0 };
+
+		// the continuous connect failures since the last success.
+		std::atomic<std::uint32_t> fails{ 0 };
+
+		// steady_clock ticks, the member is skipped before this time point.
+		std::atomic<std::int64_t> down_until{ 0 };
+
+		// set by the active health check, the member is skipped while it is false.
+		std::atomic<bool> healthy{ true };
+
+		// the result of the health check, only accessed in the thread of the health check.
+		std::uint32_t check_rises = 0;
+		std::uint32_t check_falls = 0;
+		std::int64_t  check_latency = -1; // milliseconds
+		std::string   check_message;
+		std::chrono::system_clock::time_point check_time{};
+
+		explicit upstream_member(upstream_server_info info) : cfg(std::move(info))
+		{
+		}
+
+		inline bool is_available(std::int64_t now) const noexcept
+		{
+			return healthy.load(std::memory_order_relaxed) && now >= down_until.load(std::memory_order_relaxed);
+		}
+	};
+
+	class upstream_group
+	{
+	public:
+		enum class policy
+		{
+			round_robin,
+			least_conn,
+			weighted,
+			ip_hash,
+		};
+
+		// the tried members of a request are recorded in a 64 bits mask.
+		static constexpr std::size_t max_members = 64;
+
+		// virtual nodes of each weight unit on the consistent hash ring.
+		static constexpr std::uint32_t ring_replicas = 40;
+
+		explicit upstream_group(proxy_site_info& site)
+		{
+			upstream_server_info primary{ .host = site.host, .port = site.port };
+
+			for (upstream_server_info& server : site.upstream_servers)
+			{
+				if (server.host == primary.host && server.port == primary.port)
+					primary = server;
+			}
+
+			members.emplace_back(std::make_unique<upstream_member>(primary));
+
+			for (upstream_server_info& server : site.upstream_servers)
+			{
+				if (members.size() >= max_members)
+					break;
+
+				if (server.host == primary.host && server.port == primary.port)
+					continue;
+
+				members.emplace_back(std::make_unique<upstream_member>(server));
+			}
+
+			if /**/ (net::iequals(site.balance, "least_conn"))
+				mode = policy::least_conn;
+			else if (net::iequals(site.balance, "weighted"))
+				mode = policy::weighted;
+			else if (net::iequals(site.balance, "ip_hash"))
+				mode = policy::ip_hash;
+			else
+				mode = policy::round_robin;
+
+			build_schedule();
+			build_ring();
+		}
+
+		/**
+		 * @brief Select a available member which hasn't been tried yet.
+		 * @param client_addr - Used by the ip_hash policy.
+		 * @param tried - The bit mask of the members which are tried already.
+		 * @return The index of the selected member, or npos if there are none.
+		 */
+		std::size_t select(const net::ip::address& client_addr, std::uint64_t tried)
+		{
+			std::int64_t now = std::chrono::steady_clock::now().time_since_epoch().count();
+
+			// same as nginx, a single member is never marked as down by the connect failures,
+			// but it is still skipped if the health check found it is down, so the client get
+			// the 503 at once instead of waiting for the connect timeout.
+			if (members.size() == 1)
+				return ((tried & 1) || !members[0]->healthy.load(std::memory_order_relaxed)) ? npos : 0;
+
+			switch (mode)
+			{
+			case policy::least_conn: return select_least_conn(now, tried);
+			case policy::ip_hash:    return select_ip_hash(client_addr, now, tried);
+			default:                 return select_schedule(now, tried);
+			}
+		}
+
+		void on_connect_success(std::size_t index) noexcept
+		{
+			members[index]->fails.store(0, std::memory_order_relaxed);
+		}
+
+		void on_connect_failure(std::size_t index) noexcept
+		{
+			upstream_member& m = *members[index];
+
+			if (m.cfg.max_fails == 0)
+				return;
+
+			if (m.fails.fetch_add(1, std::memory_order_relaxed) + 1 >= m.cfg.max_fails)
+			{
+				m.fails.store(0, std::memory_order_relaxed);
+				m.down_until.store((std::chrono::steady_clock::now() +
+					std::chrono::seconds(m.cfg.fail_timeout)).time_since_epoch().count(), std::memory_order_relaxed);
+			}
+		}
+
+		static constexpr std::size_t npos = std::size_t(-1);
+
+		std::vector<std::unique_ptr<upstream_member>> members;
+
+		policy mode = policy::round_robin;
+
+	protected:
+		inline bool is_candidate(std::size_t index, std::int64_t now, std::uint64_t tried) const noexcept
+		{
+			return !(tried & (std::uint64_t(1) << index)) && members[index]->is_available(now);
+		}
+
+		std::size_t select_schedule(std::int64_t now, std::uint64_t tried)
+		{
+			std::size_t start = next.fetch_add(1, std::memory_order_relaxed);
+
+			for (std::size_t i = 0; i < schedule.size(); ++i)
+			{
+				std::size_t index = schedule[(start + i) % schedule.size()];
+				if (is_candidate(index, now, tried))
+					return index;
+			}
+
+			return npos;
+		}
+
+		std::size_t select_least_conn(std::int64_t now, std::uint64_t tried)
+		{
+			// begin with a rotating offset, so the members with equal load are used in turn.
+			std::size_t start = next.fetch_add(1, std::memory_order_relaxed);
+			std::size_t best = npos;
+			std::int64_t best_active = 0, best_weight = 1;
+
+			for (std::size_t i = 0; i < members.size(); ++i)
+			{
+				std::size_t index = (start + i) % members.size();
+				if (!is_candidate(index, now, tried))
+					continue;
+
+				std::int64_t active = members[index]->active.load(std::memory_order_relaxed);
+				std::int64_t weight = members[index]->cfg.weight;
+
+				// compare active/weight without division.
+				if (best == npos || active * best_weight < best_active * weight)
+				{
+					best = index;
+					best_active = active;
+					best_weight = weight;
+				}
+			}
+
+			return best;
+		}
+
+		std::size_t select_ip_hash(const net::ip::address& client_addr, std::int64_t now, std::uint64_t tried)
+		{
+			std::uint64_t hash;
+			if (client_addr.is_v4())
+			{
+				auto bytes = client_addr.to_v4().to_bytes();
+				hash = fnv1a(bytes.data(), bytes.size());
+			}
+			else
+			{
+				auto bytes = client_addr.to_v6().to_bytes();
+				hash = fnv1a(bytes.data(), bytes.size());
+			}
+
+			auto it = std::lower_bound(ring.begin(), ring.end(), std::pair{ hash, std::uint32_t(0) });
+
+			// walk clockwise until a available member is found.
+			for (std::size_t i = 0; i < ring.size(); ++i, ++it)
+			{
+				if (it == ring.end())
+					it = ring.begin();
+
+				if (is_candidate(it->second, now, tried))
+					return it->second;
+			}
+
+			return npos;
+		}
+
+		// the smooth weighted round robin of nginx, the sequence is computed once, so the
+		// selection is only a atomic increment.
+		void build_schedule()
+		{
+			if (mode != policy::weighted)
+			{
+				for (std::size_t i = 0; i < members.size(); ++i)
+					schedule.emplace_back(std::uint32_t(i));
+				return;
+			}
+
+			std::int64_t total = 0;
+			for (auto& m : members)
+				total += m->cfg.weight;
+
+			std::vector<std::int64_t> current(members.size(), 0);
+
+			for (std::int64_t n = 0; n < total; ++n)
+			{
+				std::size_t best = 0;
+				for (std::size_t i = 0; i < members.size(); ++i)
+				{
+					current[i] += members[i]->cfg.weight;
+					if (current[i] > current[best])
+						best = i;
+				}
+				current[best] -= total;
+				schedule.emplace_back(std::uint32_t(best));
+			}
+		}
+
+		void build_ring()
+		{
+			if (mode != policy::ip_hash)
+				return;
+
+			for (std::size_t i = 0; i < members.size(); ++i)
+			{
+				std::string key = members[i]->cfg.host + ":" + std::to_string(members[i]->cfg.port) + "#";
+
+				std::uint32_t replicas = ring_replicas * members[i]->cfg.weight;
+				for (std::uint32_t r = 0; r < replicas; ++r)
+				{
+					std::string vnode = key + std::to_string(r);
+					ring.emplace_back(fnv1a(vnode.data(), vnode.size()), std::uint32_t(i));
+				}
+			}
+
+			std::sort(ring.begin(), ring.end());
+		}
+
+		static std::uint64_t fnv1a(const void* data, std::size_t size) noexcept
+		{
+			const unsigned char* p = static_cast<const unsigned char*>(data);
+			std::uint64_t hash = 14695981039346656037ull;
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				hash ^= p[i];
+				hash *= 1099511628211ull;
+			}
+			return hash;
+		}
+
+	protected:
+		std::atomic<std::size_t> next{ 0 };
+
+		std::vector<std::uint32_t> schedule;
+
+		std::vector<std::pair<std::uint64_t, std::uint32_t>> ring;
+	};
+}
@@ -0,0 +1,154 @@
+#pragma once
+
+#include <deque>
+#include <chrono>
+#include <optional>
+
+#include "../../core/net.hpp"
+
+namespace nas
+{
+	/**
+	 * The idle keep-alive backend connections of a proxy site.
+	 * Each shard has its own pools, and a pool is only accessed in the io thread of the shard,
+	 * so it doesn't need any lock, and the pooled sockets are always bound to the right executor.
+	 */
+	class upstream_pool
+	{
+	public:
+		struct connection
+		{
+			net::tcp_socket socket;
+			std::uint32_t   requests = 0;
+			std::chrono::steady_clock::time_point idle_since{};
+		};
+
+		upstream_pool(std::uint32_t max_idle, std::chrono::seconds idle_timeout, std::uint32_t max_requests)
+			: max_idle(max_idle), idle_timeout(idle_timeout), max_requests(max_requests)
+		{
+		}
+
+		~upstream_pool()
+		{
+			clear();
+		}
+
+		upstream_pool(upstream_pool&&) = default;
+		upstream_pool& operator=(upstream_pool&&) = default;
+
+		/**
+		 * @brief Take out the most recently used idle connection which is still usable.
+		 */
+		std::optional<connection> acquire()
+		{
+			auto now = std::chrono::steady_clock::now();
+
+			while (!idle.empty())
+			{
+				connection conn = std::move(idle.back());
+				idle.pop_back();
+
+				if (now - conn.idle_since < idle_timeout && is_alive(conn.socket))
+					return conn;
+
+				close(conn.socket);
+			}
+
+			return std::nullopt;
+		}
+
+		/**
+		 * @brief Put the connection back after a response has completed with keep-alive.
+		 *    Return false if the connection can't be reused, it is closed in this case.
+		 */
+		bool release(net::tcp_socket& socket, std::uint32_t requests)
+		{
+			if (!socket.is_open() || requests >= max_requests)
+			{
+				close(socket);
+				return false;
+			}
+
+			if (idle.size() >= max_idle)
+			{
+				// drop the least recently used one.
+				close(idle.front().socket);
+				idle.pop_front();
+			}
+
+			idle.emplace_back(connection{ std::move(socket), requests, std::chrono::steady_clock::now() });
+
+			return true;
+		}
+
+		/**
+		 * @brief Close the connections which have been idle for too long.
+		 *    The deque is ordered by the idle time, so only the front need to be checked.
+		 */
+		void sweep()
+		{
+			auto now = std::chrono::steady_clock::now();
+
+			while (!idle.empty() && now - idle.front().idle_since >= idle_timeout)
+			{
+				close(idle.front().socket);
+				idle.pop_front();
+			}
+		}
+
+		void clear()
+		{
+			for (connection& conn : idle)
+			{
+				close(conn.socket);
+			}
+
+			idle.clear();
+		}
+
+		inline std::size_t size() const noexcept
+		{
+			return idle.size();
+		}
+
+	protected:
+		// a idle keep-alive connection must have nothing to read, if it is readable, the
+		// backend has closed it or sent unexpected data, the connection can't be reused.
+		static bool is_alive(net::tcp_socket& socket)
+		{
+			if (!socket.is_open())
+				return false;
+
+			net::error_code ec{};
+
+			bool non_blocking = socket.non_blocking();
+
+			socket.non_blocking(true, ec);
+			if (ec)
+				return false;
+
+			char c;
+			socket.receive(net::buffer(&c, 1), net::socket_base::message_peek, ec);
+
+			bool alive = (ec == net::error::would_block);
+
+			socket.non_blocking(non_blocking, ec);
+
+			return alive;
+		}
+
+		static void close(net::tcp_socket& socket)
+		{
+			net::error_code ec{};
+			socket.shutdown(net::socket_base::shutdown_both, ec);
+			socket.close(ec);
+		}
+
+	protected:
+		std::uint32_t        max_idle;
+		std::chrono::seconds idle_timeout;
+		std::uint32_t        max_requests;
+
+		std::deque<connection> idle;
+	};
+}
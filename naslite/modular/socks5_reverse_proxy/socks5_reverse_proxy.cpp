@@ -4,8 +4,8 @@
 
 namespace nas
 {
-	using safety = socks5_reverse_proxy::safety;
 	using node = socks5_reverse_proxy::node;
+	using node_metrics = socks5_reverse_proxy::node_metrics;
 	using time_point = std::chrono::steady_clock::time_point;
 
 	void init_server(std::shared_ptr<node>& p)
@@ -13,19 +13,48 @@ namespace nas
 		net::ignore_unused(p);
 	}
 
-	net::awaitable<void> do_auth_persist(
-		std::shared_ptr<node> p, std::shared_ptr<safety> safety_ptr, net::ip::address addr)
+	node_metrics make_node_metrics(std::shared_ptr<node>& p)
+	{
+		metrics_registry& r = app.metrics;
+
+		metric_labels labels{ { "proxy", net::locale_to_utf8(p->cfg.name) } };
+
+		return node_metrics{
+			.sessions = r.counter("naslite_socks5_proxy_sessions_total",
+				"The client connections which are accepted.", labels),
+			.connections = r.gauge("naslite_socks5_proxy_connections",
+				"The client connections which are alive.", labels),
+			.auth_failures = r.counter("naslite_socks5_proxy_auth_failures_total",
+				"The failed username/password authentications.", labels),
+			.rejected = r.counter("naslite_socks5_proxy_rejected_total",
+				"The client connections rejected by the ip blacklist.", labels),
+			.received_bytes = r.counter("naslite_socks5_proxy_received_bytes_total",
+				"The bytes received from the client.", labels),
+			.sent_bytes = r.counter("naslite_socks5_proxy_sent_bytes_total",
+				"The bytes sent to the client.", labels),
+			.udp_dropped = r.counter("naslite_socks5_proxy_udp_dropped_total",
+				"The udp datagrams which are dropped, they are too large, malformed or can't be sent.", labels),
+		};
+	}
+
+	// one timer drives the timing wheel of the ip reputation table and the expiry of the udp mappings.
+	net::awaitable<void> expire_ip_reputation(std::shared_ptr<node> p)
 	{
 		net::steady_timer t(co_await net::this_coro::executor);
-		safety_ptr->timer = std::addressof(t);
-		while (safety_ptr->deadline > std::chrono::steady_clock::now())
+		p->expire_timer = std::addressof(t);
+		while (!p->server.is_aborted())
 		{
-			t.expires_at(safety_ptr->deadline);
+			t.expires_after(std::chrono::seconds(1));
 			auto [e1] = co_await t.async_wait(net::use_nothrow_awaitable);
 			if (e1)
 				break;
+
+			p->reputation->expire();
+
+			if (p->udp_nat)
+				p->udp_nat->expire(std::chrono::steady_clock::now());
 		}
-		p->safety_map.erase(addr);
+		p->expire_timer = nullptr;
 	}
 
 	net::awaitable<bool> socks5_auth(std::shared_ptr<node> p, socks5::handshake_info& info)
@@ -47,107 +76,188 @@ namespace nas
 			}
 		}
 
+		p->metrics->auth_failures.add();
+
 		app.logger->error("socks5_reverse_proxy: authed failure: {}:{} {} {}",
 			addr.to_string(ec), port, info.username, info.password);
 
-		std::shared_ptr<safety> safety_ptr;
-		if (auto it = p->safety_map.find(addr); it == p->safety_map.end())
+		ip_reputation::state current = p->reputation->update(addr, [&p](ip_reputation::state& st) mutable
 		{
-			safety_ptr = std::make_shared<safety>();
-			safety_ptr->has_authed = false;
-			safety_ptr->auth_failed_times = 1;
-			safety_ptr->deadline = std::chrono::steady_clock::now() + std::chrono::minutes(10);
+			st.auth_failed_times++;
 
-			it = p->safety_map.emplace(addr, safety_ptr).first;
+			if (st.is_blacklisted())
+				st.deadline = (std::max)(st.deadline,
+					ip_reputation::after(std::chrono::minutes(p->cfg.ip_blacklist_minutes)));
+			else
+				st.deadline = (std::max)(st.deadline,
+					ip_reputation::after(std::chrono::minutes(10 * st.auth_failed_times)));
+		});
 
-			net::co_spawn(p->ctx.get_executor(), do_auth_persist(p, safety_ptr, addr), net::detached);
-		}
-		else
+		if (current.is_blacklisted())
 		{
-			safety_ptr = it->second;
-			safety_ptr->auth_failed_times++;
-			if (safety_ptr->auth_failed_times > 3)
-			{
-				safety_ptr->deadline = std::max(safety_ptr->deadline,
-					std::chrono::steady_clock::now() + std::chrono::minutes(p->cfg.ip_blacklist_minutes));
-
-				app.logger->critical("socks5_reverse_proxy: authed failed too much: {}:{} {} {}",
-					addr.to_string(ec), port, info.username, info.password);
-			}
-			else
-			{
-				safety_ptr->deadline = std::max(safety_ptr->deadline, std::chrono::steady_clock::now() +
-					std::chrono::minutes(10 * safety_ptr->auth_failed_times));
-			}
+			app.logger->critical("socks5_reverse_proxy: authed failed too much: {}:{} {} {}",
+				addr.to_string(ec), port, info.username, info.password);
 		}
 
 		co_return false;
 	}
 
-	net::awaitable<void> tcp_transfer(
-		std::shared_ptr<net::socks5_session>& conn, net::tcp_socket& from, net::tcp_socket& to)
+	// the domain is resolved by the shared resolver, the address of the protocol of the socket is preferred.
+	net::awaitable<std::optional<net::ip::udp::endpoint>> resolve_udp_endpoint(
+		std::string domain, std::uint16_t port, net::ip::udp protocol)
 	{
-		std::array<char, 1024> data;
+		auto [e1, addrs] = co_await default_dns_resolver().async_resolve(domain);
+		if (e1)
+			co_return std::nullopt;
 
-		for (;;)
+		auto it = std::find_if(addrs.begin(), addrs.end(), [&protocol](const net::ip::address& addr)
 		{
-			conn->update_alive_time();
+			return addr.is_v6() == (protocol == net::ip::udp::v6());
+		});
+		if (it == addrs.end())
+			it = addrs.begin();
 
-			auto [e1, n1] = co_await net::async_read_some(from, net::buffer(data));
-			if (e1)
-				break;
+		co_return udp_nat_table::as_protocol(net::ip::udp::endpoint(*it, port), protocol);
+	}
 
-			auto [e2, n2] = co_await net::async_write(to, net::buffer(data, n1));
-			if (e2)
-				break;
+	// the datagram to a domain is sent by its own coroutine like the nat_send_to_domain, so the
+	// batches of the association aren't blocked by the resolving, the session keeps the socket.
+	net::awaitable<void> udp_send_to_domain(
+		std::shared_ptr<node> p, std::shared_ptr<net::socks5_session> conn, net::ip::udp protocol,
+		std::string data, std::string domain, std::uint16_t port)
+	{
+		net::udp_socket& bound = *conn->get_backend_udp_socket();
+
+		std::optional<net::ip::udp::endpoint> remote = co_await resolve_udp_endpoint(
+			std::move(domain), port, protocol);
+
+		// the association may be finished while resolving.
+		if (!remote || !bound.is_open())
+		{
+			p->metrics->udp_dropped.add();
+			co_return;
 		}
+
+		co_await net::async_send_to(bound, net::buffer(data), *remote);
 	}
 
+	/**
+	 * The datagrams are relayed in batches, all the datagrams which are ready are received at
+	 * once, the socks5 udp headers are parsed and prepended in place, then the forwarded ones
+	 * are sent at once, so there are two syscalls for a batch, not for each datagram.
+	 */
 	net::awaitable<void> udp_transfer(
-		std::shared_ptr<net::socks5_session>& conn, net::tcp_socket& front, net::udp_socket& bound)
+		std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn,
+		net::tcp_socket& front, net::udp_socket& bound)
 	{
-		std::array<char, 1024> data;
-		net::ip::udp::endpoint sender_endpoint{};
+		std::unique_ptr<udp_batch> batch = std::make_unique<udp_batch>();
 
-		for (;;)
+		// the datagrams to the tcp frontend are written by one gathered write.
+		std::vector<net::const_buffer> front_buffers;
+
+		net::error_code ec{};
+
+		// same as socks5::is_data_come_from_frontend, but the address of the front is read once.
+		net::ip::address front_addr = front.remote_endpoint(ec).address();
+		if (ec)
+			co_return;
+
+		net::ip::udp::endpoint front_endpoint = conn->get_frontend_udp_endpoint();
+
+		net::ip::udp protocol = bound.local_endpoint(ec).protocol();
+
+		auto is_from_frontend = [&front_addr, &conn](const net::ip::udp::endpoint& sender)
 		{
-			conn->update_alive_time();
+			if (front_addr.is_loopback())
+				return sender.address() == front_addr && sender.port() == conn->handshake_info.dest_port;
+			return sender.address() == front_addr;
+		};
 
-			auto [e1, n1] = co_await net::async_receive_from(bound, net::buffer(data), sender_endpoint);
+		for (;;)
+		{
+			auto [e1, n1] = co_await batch->async_receive(bound);
 			if (e1)
 				break;
 
-			if (socks5::is_data_come_from_frontend(front, sender_endpoint, conn->handshake_info))
-			{
-				conn->last_read_channel = net::protocol::udp;
+			conn->update_alive_time();
 
-				auto [e2, n2] = co_await socks5::async_forward_data_to_backend(bound, net::buffer(data, n1));
-				if (e2)
-					break;
-			}
-			else
+			std::size_t received_bytes = 0, sent_bytes = 0, dropped = batch->dropped_count();
+
+			for (udp_batch::datagram& d : batch->received())
 			{
-				if (conn->last_read_channel == net::protocol::udp)
+				if (d.truncated)
 				{
-					auto [e2, n2] = co_await socks5::async_forward_data_to_frontend(
-						bound, net::buffer(data, n1), sender_endpoint, conn->get_frontend_udp_endpoint());
-					if (e2)
-						break;
+					p->metrics->udp_dropped.add();
+					continue;
+				}
+
+				if (is_from_frontend(d.endpoint))
+				{
+					conn->last_read_channel = net::protocol::udp;
+
+					received_bytes += d.size;
+
+					auto [err, ep, domain, data] = socks5::parse_udp_packet(std::string_view(d.data, d.size), false);
+					if (err != 0)
+					{
+						p->metrics->udp_dropped.add();
+						continue;
+					}
+
+					if (domain.empty())
+					{
+						batch->add(ep, data.data(), data.size());
+						continue;
+					}
+
+					net::co_spawn(bound.get_executor(), udp_send_to_domain(p, conn, protocol,
+						std::string(data), std::string(domain), ep.port()), net::detached);
 				}
 				else
 				{
-					auto [e2, n2] = co_await socks5::async_forward_data_to_frontend(
-						front, net::buffer(data, n1), sender_endpoint);
-					if (e2)
-						break;
+					sent_bytes += d.size;
+
+					if (conn->last_read_channel == net::protocol::udp)
+					{
+						auto head = socks5::make_udp_header(d.endpoint.address(), d.endpoint.port(), 0);
+						if (char* packet = batch->prepend(d, head.data(), head.size()); packet)
+							batch->add(front_endpoint, packet, d.size);
+					}
+					else
+					{
+						auto head = socks5::make_udp_header(d.endpoint.address(), d.endpoint.port(), d.size);
+						if (char* packet = batch->prepend(d, head.data(), head.size()); packet)
+							front_buffers.emplace_back(packet, d.size);
+					}
 				}
 			}
+
+			p->metrics->received_bytes.add(received_bytes);
+			p->metrics->sent_bytes.add(sent_bytes);
+
+			auto [e4, n4] = co_await batch->async_flush(bound);
+
+			p->metrics->udp_dropped.add(batch->dropped_count() - dropped);
+
+			if (e4)
+				break;
+
+			if (!front_buffers.empty())
+			{
+				auto [e5, n5] = co_await net::async_write(front, front_buffers);
+				front_buffers.clear();
+				if (e5)
+					break;
+			}
 		}
 	}
 
 	net::awaitable<void> ext_transfer(
-		std::shared_ptr<net::socks5_session>& conn, net::tcp_socket& front, net::udp_socket& bound)
+		std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn,
+		net::tcp_socket& front, net::udp_socket& bound)
 	{
+		net::error_code ec{};
+
 		std::string buf;
 
 		for (;;)
@@ -162,6 +272,8 @@ namespace nas
 
 			conn->last_read_channel = net::protocol::tcp;
 
+			p->metrics->received_bytes.add(n1);
+
 			// this packet is a extension protocol base of below:
 			// +----+------+------+----------+----------+----------+
 			// |RSV | FRAG | ATYP | DST.ADDR | DST.PORT |   DATA   |
@@ -182,10 +294,18 @@ namespace nas
 				}
 				else
 				{
-					auto [e2, n2] = co_await net::async_send_to(
-						bound, net::buffer(real_data), std::move(domain), ep.port());
-					if (e2)
-						break;
+					std::optional<net::ip::udp::endpoint> remote = co_await resolve_udp_endpoint(
+						std::string(domain), ep.port(), bound.local_endpoint(ec).protocol());
+					if (remote)
+					{
+						auto [e2, n2] = co_await net::async_send_to(bound, net::buffer(real_data), *remote);
+						if (e2)
+							break;
+					}
+					else
+					{
+						p->metrics->udp_dropped.add();
+					}
 				}
 			}
 			else
@@ -196,16 +316,323 @@ namespace nas
 			buf.erase(0, n1);
 		}
 
+		front.shutdown(net::socket_base::shutdown_both, ec);
+		front.close(ec);
+	}
+
+	// the udp associate selects one of the shared sockets instead of binding a new socket.
+	struct shared_udp_auth_config : socks5::auth_config
+	{
+		using udp_associate_bound_socket_type = udp_nat_table::binding;
+	};
+
+	net::awaitable<net::error_code> socks5_accept(std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn)
+	{
+		if (!p->udp_nat)
+			co_return co_await socks5::accept(conn->socket, conn->auth_config, conn->handshake_info);
+
+		shared_udp_auth_config auth_cfg{ conn->auth_config };
+
+		co_return co_await socks5::accept(conn->socket, auth_cfg, conn->handshake_info);
+	}
+
+	// the datagram to a domain is sent by its own coroutine, the shared socket isn't blocked by the resolving.
+	net::awaitable<void> nat_send_to_domain(
+		std::shared_ptr<node> p, std::size_t index, net::ip::udp::endpoint client,
+		std::string data, std::string domain, std::uint16_t port)
+	{
+		udp_nat_table& table = *p->udp_nat;
+
+		std::optional<net::ip::udp::endpoint> remote = co_await resolve_udp_endpoint(
+			std::move(domain), port, table.socket(index).local_endpoint.protocol());
+
+		// the association may be removed while resolving.
+		udp_nat_table::association* a = table.find_client(index, client);
+
+		std::optional<std::size_t> out;
+		if (remote && a)
+			out = table.map_remote(*a, *remote, std::chrono::steady_clock::now());
+
+		if (!out)
+		{
+			p->metrics->udp_dropped.add();
+			co_return;
+		}
+
+		co_await net::async_send_to(table.socket(*out).sock, net::buffer(data), *remote);
+	}
+
+	/**
+	 * The receive loop of a shared socket, the datagrams of all the associations which use this
+	 * socket are relayed here in batches like the udp_transfer, the sender of each datagram is
+	 * looked up in the table to find its association, the unknown senders are dropped.
+	 */
+	net::awaitable<void> nat_transfer(std::shared_ptr<node> p, std::size_t index)
+	{
+		udp_nat_table& table = *p->udp_nat;
+		udp_nat_table::shared_socket& shared = table.socket(index);
+		net::udp_socket& sock = shared.sock;
+		udp_batch& batch = shared.batch;
+
+		// the replies of the extension protocol are queued to the writer of the association.
+		static constexpr std::size_t max_tcp_outbox = 256;
+
+		auto unmapped_address = [](const net::ip::udp::endpoint& ep)
+		{
+			net::ip::address addr = ep.address();
+			if (addr.is_v6() && addr.to_v6().is_v4_mapped())
+				return net::ip::address(net::ip::make_address_v4(net::ip::v4_mapped, addr.to_v6()));
+			return addr;
+		};
+
+		while (sock.is_open())
+		{
+			auto [e1, n1] = co_await batch.async_receive(sock);
+			if (e1 == net::error::operation_aborted || e1 == net::error::bad_descriptor)
+				break;
+			// the icmp errors of a remote may be reported by the socket, it is shared by others.
+			if (e1)
+				continue;
+
+			auto now = std::chrono::steady_clock::now();
+			auto alive_time = std::chrono::system_clock::now();
+
+			std::size_t received_bytes = 0, sent_bytes = 0, dropped = batch.dropped_count();
+
+			for (udp_batch::datagram& d : batch.received())
+			{
+				if (d.truncated)
+				{
+					p->metrics->udp_dropped.add();
+					continue;
+				}
+
+				if (udp_nat_table::association* a = table.find_client(index, d.endpoint); a)
+				{
+					*(a->alive_time) = alive_time;
+					a->over_tcp = false;
+
+					received_bytes += d.size;
+
+					auto [err, ep, domain, data] = socks5::parse_udp_packet(std::string_view(d.data, d.size), false);
+					if (err != 0)
+					{
+						p->metrics->udp_dropped.add();
+						continue;
+					}
+
+					if (!domain.empty())
+					{
+						net::co_spawn(sock.get_executor(), nat_send_to_domain(
+							p, index, d.endpoint, std::string(data), std::string(domain), ep.port()), net::detached);
+						continue;
+					}
+
+					std::optional<std::size_t> out = table.map_remote(*a, ep, now);
+					if (!out)
+					{
+						p->metrics->udp_dropped.add();
+						continue;
+					}
+
+					if (*out == index)
+						batch.add(ep, data.data(), data.size());
+					else
+						co_await net::async_send_to(table.socket(*out).sock, net::buffer(data), ep);
+				}
+				else if (udp_nat_table::association* a = table.find_remote(index, d.endpoint, now); a)
+				{
+					*(a->alive_time) = alive_time;
+
+					sent_bytes += d.size;
+
+					if (!a->over_tcp)
+					{
+						auto head = socks5::make_udp_header(unmapped_address(d.endpoint), d.endpoint.port(), 0);
+						char* packet = batch.prepend(d, head.data(), head.size());
+						if (!packet)
+							p->metrics->udp_dropped.add();
+						else if (a->front == index)
+							batch.add(a->client, packet, d.size);
+						else
+							co_await net::async_send_to(table.socket(a->front).sock, net::buffer(packet, d.size), a->client);
+					}
+					else
+					{
+						auto head = socks5::make_udp_header(unmapped_address(d.endpoint), d.endpoint.port(), d.size);
+						char* packet = batch.prepend(d, head.data(), head.size());
+						if (!packet || a->tcp_outbox.size() >= max_tcp_outbox)
+						{
+							p->metrics->udp_dropped.add();
+							continue;
+						}
+
+						a->tcp_outbox.emplace_back(packet, d.size);
+						if (a->tcp_notify)
+							a->tcp_notify->cancel();
+					}
+				}
+				else
+				{
+					p->metrics->udp_dropped.add();
+				}
+			}
+
+			p->metrics->received_bytes.add(received_bytes);
+			p->metrics->sent_bytes.add(sent_bytes);
+
+			auto [e4, n4] = co_await batch.async_flush(sock);
+
+			p->metrics->udp_dropped.add(batch.dropped_count() - dropped);
+
+			if (e4)
+				break;
+		}
+	}
+
+	// read the extension protocol of the association, the datagrams are sent by the shared sockets.
+	net::awaitable<void> nat_ext_transfer(
+		std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn,
+		udp_nat_table::association& a, net::tcp_socket& front)
+	{
+		udp_nat_table& table = *p->udp_nat;
+
+		std::string buf;
+
+		for (;;)
+		{
+			conn->update_alive_time();
+
+			auto [e1, n1] = co_await net::async_read_until(
+				front, net::dynamic_buffer(buf), socks5::udp_match_condition{});
+			if (e1)
+				break;
+
+			conn->last_read_channel = net::protocol::tcp;
+			a.over_tcp = true;
+
+			p->metrics->received_bytes.add(n1);
+
+			auto [err, ep, domain, real_data] = socks5::parse_udp_packet(net::buffer(buf.data(), n1), true);
+			if (err != 0)
+				break;
+
+			bool resolved = true;
+
+			if (!domain.empty())
+			{
+				std::optional<net::ip::udp::endpoint> remote = co_await resolve_udp_endpoint(
+					std::string(domain), ep.port(), table.socket(a.front).local_endpoint.protocol());
+				if (remote)
+					ep = *remote;
+				resolved = remote.has_value();
+			}
+
+			// a datagram which can't be sent is dropped, the shared socket is still usable.
+			std::optional<std::size_t> out;
+			if (resolved)
+				out = table.map_remote(a, ep, std::chrono::steady_clock::now());
+
+			if (out)
+				co_await net::async_send_to(table.socket(*out).sock, net::buffer(real_data), ep);
+			else
+				p->metrics->udp_dropped.add();
+
+			buf.erase(0, n1);
+		}
+
 		net::error_code ec{};
 		front.shutdown(net::socket_base::shutdown_both, ec);
 		front.close(ec);
 	}
 
-	net::awaitable<void> do_proxy(std::shared_ptr<net::socks5_session>& conn)
+	// the replies to the extension protocol are written by one gathered write each time.
+	net::awaitable<void> nat_reply_writer(udp_nat_table::association& a, net::tcp_socket& front)
+	{
+		std::deque<std::string> sending;
+		std::vector<net::const_buffer> buffers;
+
+		for (;;)
+		{
+			if (a.tcp_outbox.empty())
+			{
+				// the timer is canceled when a reply is queued, or this coroutine is canceled.
+				a.tcp_notify->expires_at(net::steady_timer::time_point::max());
+				co_await a.tcp_notify->async_wait(net::use_nothrow_awaitable);
+				if ((co_await net::this_coro::cancellation_state).cancelled() != net::cancellation_type::none)
+					break;
+				continue;
+			}
+
+			sending.swap(a.tcp_outbox);
+
+			for (std::string& s : sending)
+			{
+				buffers.emplace_back(net::buffer(s));
+			}
+
+			auto [e1, n1] = co_await net::async_write(front, buffers);
+			sending.clear();
+			buffers.clear();
+			if (e1)
+				break;
+		}
+	}
+
+	// the association only has a table entry and a tcp connection, no udp socket is opened.
+	net::awaitable<void> shared_udp_associate(std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn)
+	{
+		udp_nat_table& table = *p->udp_nat;
+		udp_nat_table::binding& bound = *std::any_cast<udp_nat_table::binding>(
+			std::addressof(conn->handshake_info.bound_socket));
+
+		net::tcp_socket& front_client = conn->socket;
+		net::steady_timer notify(front_client.get_executor());
+
+		// same as socks5::is_data_come_from_frontend, only the loopback client is matched by the
+		// declared port, the others may be behind a napt which changes the port, so their port is
+		// learned from the first datagram whatever port was declared.
+		net::ip::udp::endpoint client = conn->get_frontend_udp_endpoint();
+		if (!client.address().is_loopback())
+			client.port(0);
+
+		std::shared_ptr<udp_nat_table::association> a = std::make_shared<udp_nat_table::association>();
+		a->client = udp_nat_table::as_protocol(client, bound.local_endpoint().protocol());
+		a->front = bound.index;
+		a->alive_time = std::addressof(conn->alive_time);
+		a->tcp_notify = std::addressof(notify);
+
+		table.add(a);
+
+		co_await(
+			nat_ext_transfer(p, conn, *a, front_client) ||
+			nat_reply_writer(*a, front_client) ||
+			net::watchdog(conn->alive_time, net::proxy_idle_timeout));
+
+		table.remove(*a);
+		a->tcp_notify = nullptr;
+
+		net::error_code ec{};
+		front_client.close(ec);
+	}
+
+	// the accept negotiates, resolves the dest domain and connects the dest, so its deadline is
+	// the time of the negotiation, the lookups of all the nameservers, and the connect timeout.
+	std::chrono::steady_clock::duration accept_timeout(std::shared_ptr<node>& p)
+	{
+		const dns_options& dns = default_dns_resolver().options();
+
+		std::chrono::steady_clock::duration resolve_timeout = dns.timeout *
+			std::int64_t((std::max)(dns.attempts, std::size_t(1)) * (std::max)(dns.nameservers.size(), std::size_t(1)));
+
+		return std::chrono::seconds(5) + resolve_timeout + std::chrono::seconds((std::max)(p->cfg.connect_timeout, 1u));
+	}
+
+	net::awaitable<void> do_proxy(std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session>& conn)
 	{
 		auto result = co_await(
-			socks5::accept(conn->socket, conn->auth_config, conn->handshake_info) ||
-			net::timeout(std::chrono::seconds(5)));
+			socks5_accept(p, conn) ||
+			net::timeout(accept_timeout(p)));
 		if (net::is_timeout(result))
 			co_return;
 		auto e1 = std::get<0>(result);
@@ -218,68 +645,88 @@ namespace nas
 		{
 			net::tcp_socket& front_client = conn->socket;
 			net::tcp_socket& back_client = *conn->get_backend_tcp_socket();
+
+			relay_counters counters{};
+			relay_counters flushed{};
+
+			// the metrics are flushed by the watchdog, not for each piece of data.
+			auto flush_metrics = [&p, &flushed](const relay_counters& c) mutable
+			{
+				p->metrics->received_bytes.add(c.client_to_server - flushed.client_to_server);
+				p->metrics->sent_bytes.add(c.server_to_client - flushed.server_to_client);
+				flushed = c;
+			};
+
 			co_await(
-				tcp_transfer(conn, front_client, back_client) ||
-				tcp_transfer(conn, back_client, front_client) ||
-				net::watchdog(conn->alive_time, net::proxy_idle_timeout));
+				async_relay(front_client, back_client, counters.client_to_server) ||
+				async_relay(back_client, front_client, counters.server_to_client) ||
+				async_relay_watchdog(counters, conn->alive_time, net::proxy_idle_timeout, flush_metrics));
 			front_client.close(ec);
 			back_client.close(ec);
+
+			flush_metrics(counters);
+
+			NAS_LOG_DEBUG("socks5_reverse_proxy: connect finished: {}:{} -> {}:{} sent: {} recvd: {}",
+				conn->handshake_info.client_endpoint.address().to_string(ec), conn->handshake_info.client_endpoint.port(),
+				conn->handshake_info.dest_address, conn->handshake_info.dest_port,
+				counters.server_to_client, counters.client_to_server);
+		}
+		else if (conn->handshake_info.cmd == socks5::command::udp_associate && p->udp_nat)
+		{
+			co_await shared_udp_associate(p, conn);
 		}
 		else if (conn->handshake_info.cmd == socks5::command::udp_associate)
 		{
 			net::tcp_socket& front_client = conn->socket;
 			net::udp_socket& back_client = *conn->get_backend_udp_socket();
 			co_await(
-				udp_transfer(conn, front_client, back_client) ||
-				ext_transfer(conn, front_client, back_client) ||
+				udp_transfer(p, conn, front_client, back_client) ||
+				ext_transfer(p, conn, front_client, back_client) ||
 				net::watchdog(conn->alive_time, net::proxy_idle_timeout));
 			front_client.close(ec);
 			back_client.close(ec);
 		}
 	}
 
-	std::tuple<bool, std::shared_ptr<safety>> safety_check(std::shared_ptr<node>& p, auto& client)
+	bool safety_check(std::shared_ptr<node>& p, auto& client)
 	{
 		net::error_code ec{};
 		auto endp = client.lowest_layer().remote_endpoint(ec);
 		if (ec)
-			return { false, nullptr };
+			return false;
 
 		auto addr = endp.address();
 		auto port = endp.port();
 
-		auto& safety_map = p->safety_map;
-
-		std::shared_ptr<safety> safety_ptr;
-
-		if (auto it = safety_map.find(addr); it != safety_map.end())
+		if (std::optional<ip_reputation::state> st = p->reputation->find(addr); st && st->is_blacklisted())
 		{
-			if (it->second->auth_failed_times > 3)
-			{
-				safety_ptr = it->second;
-				app.logger->error("socks5_reverse_proxy: reject a client from forbiddened ip: {}:{}",
-					addr.to_string(ec), port);
-				return { false, std::move(safety_ptr) };
-			}
+			p->metrics->rejected.add();
+			app.logger->error("socks5_reverse_proxy: reject a client from forbiddened ip: {}:{}",
+				addr.to_string(ec), port);
+			return false;
 		}
 
-		return { true, std::move(safety_ptr) };
+		return true;
 	}
 
 	net::awaitable<void> client_join(std::shared_ptr<node>& p, std::shared_ptr<net::socks5_session> session)
 	{
-		auto [result, safety_ptr] = safety_check(p, session->socket);
-		if (!result)
+		if (!safety_check(p, session->socket))
 			co_return;
 
 		co_await p->server.session_map.async_add(session);
 
+		p->metrics->sessions.add();
+		p->metrics->connections.add();
+
 		session->socket.set_option(net::ip::tcp::no_delay(true));
 		session->socket.set_option(net::socket_base::keep_alive(true));
 
-		co_await do_proxy(session);
+		co_await do_proxy(p, session);
 		co_await session->async_disconnect();
 
+		p->metrics->connections.sub();
+
 		co_await p->server.session_map.async_remove(session);
 	}
 
@@ -290,6 +737,9 @@ namespace nas
 
 		auto& server = p->server;
 
+		// the binding of the udp associate finds the table by the thread, this is the node thread.
+		udp_nat_table::current() = p->udp_nat.get();
+
 		auto [ec, ep] = co_await server.async_listen(p->cfg.listen_address, p->cfg.listen_port);
 		if (ec)
 		{
@@ -335,6 +785,33 @@ namespace nas
 
 			p->cfg = std::move(cfg);
 
+			p->metrics.emplace(make_node_metrics(p));
+
+			p->reputation = std::make_unique<ip_reputation>(p->cfg.ip_blacklist_capacity, p->cfg.ip_blacklist_file);
+
+			if (!p->cfg.ip_blacklist_file.empty() && !p->reputation->is_persistent())
+			{
+				app.logger->error("    the ip_blacklist_file '{}' of '{}' can't be mapped, the blacklist is in memory only",
+					p->cfg.ip_blacklist_file, p->cfg.name);
+			}
+
+			if (p->cfg.shared_udp_enable)
+			{
+				std::size_t front_count = (std::max)(p->cfg.shared_udp_sockets, 1u);
+
+				// the receive loop is started when a shared socket is opened.
+				std::weak_ptr<node> w = p;
+				p->udp_nat = std::make_unique<udp_nat_table>(p->ctx.get_executor(), udp_nat_table::options{
+					.front_count = front_count,
+					.max_count = front_count * 16,
+					.idle_timeout = std::chrono::seconds((std::max)(p->cfg.shared_udp_idle_timeout, 1u)),
+				}, [w](std::size_t index)
+				{
+					if (std::shared_ptr<node> p = w.lock(); p)
+						net::co_spawn(p->ctx.get_executor(), nat_transfer(p, index), net::detached);
+				});
+			}
+
 			init_server(p);
 
 			nodes.emplace_back(std::move(p));
@@ -356,7 +833,18 @@ namespace nas
 
 			auth_cfg.on_auth = std::bind_front(socks5_auth, p);
 
+			// the dest domain of the connect is resolved by the shared caching resolver.
+			auth_cfg.on_resolve = [](std::string_view host)
+			{
+				return default_dns_resolver().async_resolve(host);
+			};
+
+			auth_cfg.connect_attempt_delay = std::chrono::milliseconds(p->cfg.connect_attempt_delay);
+			auth_cfg.connect_timeout = std::chrono::seconds((std::max)(p->cfg.connect_timeout, 1u));
+
 			net::co_spawn(p->server.get_executor(), start_server(p, std::move(auth_cfg)), net::detached);
+
+			net::co_spawn(p->ctx.get_executor(), expire_ip_reputation(p), net::detached);
 		}
 
 		return true;
@@ -368,21 +856,10 @@ namespace nas
 		{
 			p->server.async_stop([&p](net::error_code)
 			{
-				for (auto& [addr, ptr] : p->safety_map)
-				{
-					if (ptr->timer)
-						net::cancel_timer(*(ptr->timer));
-
-					for (auto& [k, v] : ptr->conns)
-					{
-						std::visit([](auto& p)
-						{
-							net::error_code ec{};
-							p->lowest_layer().shutdown(net::socket_base::shutdown_both, ec);
-							p->lowest_layer().close(ec);
-						}, v);
-					}
-				}
+				if (p->expire_timer)
+					net::cancel_timer(*(p->expire_timer));
+				if (p->udp_nat)
+					p->udp_nat->close();
 			});
 		}
 		for (auto& p : nodes)
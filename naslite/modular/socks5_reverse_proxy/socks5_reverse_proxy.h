@@ -5,6 +5,12 @@
 #include "../../core/iconfig.hpp"
 #include "../../core/utils.hpp"
 #include "../../core/imodular.hpp"
+#include "../../core/ip_reputation.hpp"
+#include "../../core/metrics.hpp"
+#include "../../core/dns_resolver.hpp"
+#include "../../core/tcp_relay.hpp"
+#include "../../core/udp_batch.hpp"
+#include "../../core/udp_nat_table.hpp"
 
 #include <asio3/proxy/socks5_server.hpp>
 
@@ -15,14 +21,15 @@ namespace nas
 		, public pfr::base_dynamic_creator<imodular, socks5_reverse_proxy>
 	{
 	public:
-		struct safety
+		struct node_metrics
 		{
-			bool has_authed;
-			std::int32_t auth_failed_times;
-			std::chrono::steady_clock::time_point deadline;
-			net::steady_timer* timer = nullptr;
-			std::unordered_map<void*,
-				std::variant<net::tcp_socket*, net::ssl::stream<net::tcp_socket>*>> conns;
+			metric_counter&   sessions;
+			metric_gauge&     connections;
+			metric_counter&   auth_failures;
+			metric_counter&   rejected;
+			metric_counter&   received_bytes;
+			metric_counter&   sent_bytes;
+			metric_counter&   udp_dropped;
 		};
 
 		struct node
@@ -30,7 +37,10 @@ namespace nas
 			socks5_reverse_proxy_info cfg{};
 			net::io_context_thread ctx{ 1 };
 			net::socks5_server server{ ctx.get_executor() };
-			std::unordered_map<net::ip::address, std::shared_ptr<safety>> safety_map;
+			std::unique_ptr<ip_reputation> reputation;
+			net::steady_timer* expire_timer = nullptr;
+			std::optional<node_metrics> metrics;
+			std::unique_ptr<udp_nat_table> udp_nat; // only when the shared udp is enabled
 		};
 
 	public:
@@ -5,6 +5,8 @@
 namespace nas
 {
 	using node = static_http_server::node;
+	using shard = static_http_server::shard;
+	using node_metrics = static_http_server::node_metrics;
 
 	template<typename T>
 	concept is_https_server = requires(T & a)
@@ -12,25 +14,105 @@ namespace nas
 		a->ssl_context;
 	};
 
-	void init_server(std::shared_ptr<node>& p, auto& server)
+	node_metrics make_node_metrics(std::shared_ptr<node>& p)
+	{
+		return make_http_server_metrics(app.metrics, "naslite_static_http",
+			metric_labels{ { "server", net::locale_to_utf8(p->cfg.name) } });
+	}
+
+	void init_webroot(std::shared_ptr<node>& p)
 	{
 		std::error_code ec{};
 		if (std::filesystem::absolute(p->cfg.webroot, ec) == std::filesystem::path(p->cfg.webroot))
-			server->webroot = p->cfg.webroot;
+			p->webroot = p->cfg.webroot;
 		else
-			server->webroot = app.exe_directory / p->cfg.webroot;
+			p->webroot = app.exe_directory / p->cfg.webroot;
 
 		if (ec)
 			app.logger->error("    the webroot config '{}' is invalid: {}", p->cfg.webroot, ec.message());
 
-		server->webroot = std::filesystem::canonical(server->webroot, ec);
+		p->webroot = std::filesystem::canonical(p->webroot, ec);
 
-		if (!std::filesystem::exists(server->webroot, ec) && !ec)
+		if (!std::filesystem::exists(p->webroot, ec) && !ec)
 			app.logger->error("    the webroot directory '{}' of '{}' is not exists",
 				p->cfg.webroot, p->cfg.name);
 		else
 			app.logger->info("    the webroot directory of '{}' is: {}",
-				p->cfg.name, server->webroot.string());
+				p->cfg.name, p->webroot.string());
+	}
+
+	bool init_ssl_context(std::shared_ptr<node>& p, net::ssl::context& sslctx)
+	{
+		auto cert_file_path = to_canonical_path(app.exe_directory, p->cfg.cert_file);
+		auto key_file_path = to_canonical_path(app.exe_directory, p->cfg.key_file);
+
+		// nginx: ssl->ctx = SSL_CTX_new(SSLv23_method());
+		net::error_code ec{};
+		sslctx.set_options(
+			net::ssl::context::default_workarounds |
+			net::ssl::context::no_sslv2 |
+			net::ssl::context::single_dh_use, ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl options failed: {} {}", p->cfg.name, ec.message());
+			return false;
+		}
+		sslctx.use_certificate_chain_file(cert_file_path.string(), ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl certificate chain for '{}' failed: {} {}",
+				p->cfg.name, p->cfg.cert_file, ec.message());
+			return false;
+		}
+		sslctx.use_private_key_file(key_file_path.string(), net::ssl::context::pem, ec);
+		if (ec)
+		{
+			app.logger->error("    set ssl private key for '{}' failed: {} {}",
+				p->cfg.name, p->cfg.key_file, ec.message());
+			return false;
+		}
+		return true;
+	}
+
+	inline bool is_file_request(http::web_request& req)
+	{
+		return req.method() == http::verb::get || req.method() == http::verb::head;
+	}
+
+	// same as the routes of the router, the webroot is canonical, so it isn't resolved again.
+	std::filesystem::path make_request_filepath(std::shared_ptr<node>& p, http::web_request& req)
+	{
+		if (target_path(req.target()) == "/")
+			return p->webroot / p->cfg.index;
+		return resolve_filepath(p->webroot, req.target());
+	}
+
+	// the responses of the router and the cache warmer must be same.
+	http::response<http::string_body> make_index_response(
+		std::shared_ptr<node>& p, const std::filesystem::path& filepath, std::string content)
+	{
+		auto res = http::make_html_response(std::move(content));
+		if (auto meta = load_file_metadata(filepath); meta)
+			set_file_validators(res, *meta, p->cfg.cache_control);
+		return res;
+	}
+
+	http::response<http::string_body> make_static_file_response(
+		std::shared_ptr<node>& p, const std::filesystem::path& filepath, std::string content)
+	{
+		auto res = http::make_text_response(std::move(content));
+		res.set(http::field::content_type, http::extension_to_mimetype(filepath.extension().string()));
+		res.set(http::field::accept_ranges, "bytes");
+		if (auto meta = load_file_metadata(filepath); meta)
+			set_file_validators(res, *meta, p->cfg.cache_control);
+		return res;
+	}
+
+	// the responses are cached in the response_cache of the node, not in the router of each shard,
+	// so they are shared by all the shards.
+	void init_server(std::shared_ptr<node>& p, auto& server)
+	{
+		server->webroot = p->webroot;
 
 		server->router.add("/", [p, server]
 		(http::web_request& req, http::web_response& rep) mutable -> net::awaitable<bool>
@@ -43,14 +125,14 @@ namespace nas
 				co_return true;
 			}
 
-			rep = http::make_html_response(std::move(content));
+			rep = make_index_response(p, filepath, std::move(content));
 			co_return true;
-		}, http::enable_cache);
+		});
 
 		server->router.add("*", [p, server]
 		(http::web_request& req, http::web_response& rep) mutable -> net::awaitable<bool>
 		{
-			std::filesystem::path filepath = net::make_filepath(server->webroot, req.target());
+			std::filesystem::path filepath = resolve_filepath(server->webroot, req.target());
 
 			auto [ec, file, content] = co_await net::async_read_file_content(filepath.string());
 			if (ec)
@@ -59,14 +141,23 @@ namespace nas
 				co_return true;
 			}
 
-			auto res = http::make_text_response(std::move(content));
-			res.set(http::field::content_type, http::extension_to_mimetype(filepath.extension().string()));
-			rep = std::move(res);
+			rep = make_static_file_response(p, filepath, std::move(content));
 			co_return true;
-		}, http::enable_cache);
+		});
+	}
+
+	// the files are served by the metadata cache of the shard and the response cache of the node.
+	file_target make_file_target(std::shared_ptr<node>& p, http::web_request& req)
+	{
+		return file_target{
+			.file = is_file_request(req),
+			.streamable = true,
+			.cacheable = http::is_cache_enabled(req),
+			.cache_control = p->cfg.cache_control,
+		};
 	}
 
-	net::awaitable<void> do_recv(std::shared_ptr<node> p, auto& server, auto& session)
+	net::awaitable<void> do_recv(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server, auto& session)
 	{
 		// This buffer is required to persist across reads
 		beast::flat_buffer buf;
@@ -81,40 +172,39 @@ namespace nas
 
 			session->update_alive_time();
 
-			if (!p->lock.try_send())
-			{
-				co_await p->lock.async_send(net::deferred);
-			}
-
-			[[maybe_unused]] net::defer_unlock defered_unlock{ p->lock };
-
-			http::web_response rep;
-			bool result = co_await server->router.route(req, rep);
-
-			// Send the response
-			auto [e2, n2] = co_await beast::async_write(session->get_stream(), std::move(rep));
-			if (e2)
-				break;
+			bool keep_alive = co_await async_serve_file_request(session->get_stream(), req,
+				file_responder{ s->metadata, *p->cache, *p->metrics, p->cfg.max_cache_file_size },
+				make_file_target(p, req),
+				[&p, &req]() mutable
+				{
+					return make_request_filepath(p, req);
+				},
+				[p, index = target_path(req.target()) == "/"](const std::filesystem::path& filepath, std::string content) mutable
+				{
+					if (index)
+						return make_index_response(p, filepath, std::move(content));
+					return make_static_file_response(p, filepath, std::move(content));
+				},
+				[&server, &req](http::web_response& rep) mutable -> net::awaitable<bool>
+				{
+					co_return co_await server->router.route(req, rep);
+				});
 
-			if (!result || !req.keep_alive())
-			{
-				// This means we should close the connection, usually because
-				// the response indicated the "Connection: close" semantic.
+			if (!keep_alive)
 				break;
-			}
 		}
 
 		session->close();
 	}
 
-	net::awaitable<void> do_session(std::shared_ptr<node> p, auto& server, auto session)
+	net::awaitable<void> do_session(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server, auto session)
 	{
 		co_await server->session_map.async_add(session);
-		co_await(do_recv(p, server, session) || net::watchdog(session->alive_time, net::http_idle_timeout));
+		co_await(do_recv(p, s, server, session) || net::watchdog(session->alive_time, net::http_idle_timeout));
 		co_await server->session_map.async_remove(session);
 	}
 
-	net::awaitable<void> client_join(std::shared_ptr<node> p, auto& server, auto client)
+	net::awaitable<void> client_join(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server, auto client)
 	{
 		if constexpr (is_https_server<decltype(server)>)
 		{
@@ -127,20 +217,77 @@ namespace nas
 					p->cfg.name, p->cfg.listen_address, p->cfg.listen_port, e2.message());
 				co_return;
 			}
-			co_await do_session(p, server, std::move(session));
+			co_await do_session(p, s, server, std::move(session));
 		}
 		else
 		{
 			auto session = std::make_shared<net::http_session>(std::move(client));
-			co_await do_session(p, server, std::move(session));
+			co_await do_session(p, s, server, std::move(session));
+		}
+	}
+
+	// only the changed files are evicted, the "/" is mapped to the index file.
+	void invalidate_cache(std::shared_ptr<node>& p, const webroot_changes& changes)
+	{
+		auto is_changed = [changes = std::make_shared<const webroot_changes>(changes),
+			index = "/" + p->cfg.index](std::string_view target)
+		{
+			if (target.substr(0, target.find_first_of("?#")) == "/")
+				return changes->is_changed(index);
+			return changes->is_changed(target);
+		};
+
+		std::size_t count = p->cache->erase_if(is_changed);
+
+		// the metadata caches are only used in the threads of the shards.
+		for (auto& s : p->shards)
+		{
+			net::post(s->ctx.get_executor(), [s, is_changed]() mutable
+			{
+				s->metadata.erase_if(is_changed);
+			});
 		}
+
+		app.logger->debug("static_http_server webroot changed: {} files{}, {} cached responses are evicted",
+			changes.targets.size(), changes.reset ? " and directories" : "", count);
 	}
 
-	net::awaitable<void> start_server(std::shared_ptr<node> p, auto& server)
+	// the server is listening at the same time, the requests before the file was read are
+	// answered by the router as usual.
+	void start_warmup(std::shared_ptr<node>& p)
+	{
+		p->warmer = std::make_unique<cache_warmer>(cache_warmer::options{
+			.max_size = p->cfg.cache_warmup_size,
+			.max_file_size = p->cfg.max_cache_file_size,
+			.threads = (std::min)(p->shards.size(), std::size_t(4)),
+		});
+
+		p->warmer->start(p->webroot,
+			[](std::string_view) { return true; },
+			[p, index = "/" + p->cfg.index](std::string_view target,
+				const std::filesystem::path& filepath, std::string content) mutable
+			{
+				if (target == index)
+					p->cache->add("/", make_serialized_response(make_index_response(p, filepath, content)));
+
+				p->cache->add(target, make_serialized_response(make_static_file_response(p, filepath, std::move(content))));
+			},
+			[p](const cache_warmer::result& r) mutable
+			{
+				app.logger->info("static_http_server '{}' cache warm-up finished: {} files, {} bytes, {} ms",
+					p->cfg.name, r.files, r.bytes,
+					std::chrono::duration_cast<std::chrono::milliseconds>(r.elapsed).count());
+			});
+	}
+
+	net::awaitable<void> start_server(std::shared_ptr<node> p, std::shared_ptr<shard> s, auto& server)
 	{
 		// delay some time to ensure the init log finished.
 		co_await net::delay(std::chrono::milliseconds(500));
 
+		if (s->index > 0)
+			co_return;
+
 		auto [ec, ep] = co_await server->async_listen(p->cfg.listen_address, p->cfg.listen_port);
 		if (ec)
 		{
@@ -149,19 +296,27 @@ namespace nas
 			co_return;
 		}
 
-		app.logger->info("static_http_server listen success: {} {}:{}",
-			p->cfg.name, server->get_listen_address(), server->get_listen_port());
+		app.logger->info("static_http_server listen success: {} {}:{} threads: {}",
+			p->cfg.name, server->get_listen_address(), server->get_listen_port(), p->shards.size());
+
+		std::size_t next = 0;
 
 		while (!server->is_aborted())
 		{
-			auto [e1, client] = co_await server->acceptor.async_accept();
+			std::shared_ptr<shard>& target = p->shards[next++ % p->shards.size()];
+			auto& target_server = std::get<std::remove_cvref_t<decltype(server)>>(target->server);
+
+			net::tcp_socket client(target_server->get_executor());
+
+			auto [e1] = co_await server->acceptor.async_accept(client);
 			if (e1)
 			{
 				co_await net::delay(std::chrono::milliseconds(100));
 			}
 			else
 			{
-				net::co_spawn(server->get_executor(), client_join(p, server, std::move(client)), net::detached);
+				net::co_spawn(target_server->get_executor(),
+					client_join(p, target, target_server, std::move(client)), net::detached);
 			}
 		}
 	}
@@ -184,54 +339,62 @@ namespace nas
 
 			p->cfg = std::move(cfg);
 
-			if /**/ (net::iequals(p->cfg.protocol, "http"))
+			p->metrics.emplace(make_node_metrics(p));
+
+			p->cache.emplace(response_cache::options{
+				.max_size = p->cfg.max_cache_size,
+				.max_object_size = p->cfg.max_cache_file_size,
+				.ttl = std::chrono::seconds(p->cfg.cache_ttl),
+			});
+
+			if (!net::iequals(p->cfg.protocol, "http") && !net::iequals(p->cfg.protocol, "https"))
 			{
-				p->server = std::make_shared<net::http_server>(p->ctx.get_executor());
+				app.logger->error("    the protocol config '{}' of '{}' is invalid", p->cfg.protocol, p->cfg.name);
+				continue;
 			}
-			else if (net::iequals(p->cfg.protocol, "https"))
+
+			init_webroot(p);
+
+			std::size_t cpu_count = (std::max)(std::thread::hardware_concurrency(), 1u);
+			std::size_t worker_threads = p->cfg.worker_threads == 0 ? cpu_count : p->cfg.worker_threads;
+
+			bool result = true;
+
+			for (std::size_t i = 0; i < worker_threads; ++i)
 			{
-				auto cert_file_path = to_canonical_path(app.exe_directory, p->cfg.cert_file);
-				auto key_file_path = to_canonical_path(app.exe_directory, p->cfg.key_file);
-
-				// nginx: ssl->ctx = SSL_CTX_new(SSLv23_method());
-				net::error_code ec{};
-				net::ssl::context sslctx(net::ssl::context::sslv23);
-				sslctx.set_options(
-					net::ssl::context::default_workarounds |
-					net::ssl::context::no_sslv2 |
-					net::ssl::context::single_dh_use, ec);
-				if (ec)
-				{
-					app.logger->error("    set ssl options failed: {} {}", p->cfg.name, ec.message());
-					continue;
-				}
-				sslctx.use_certificate_chain_file(cert_file_path.string(), ec);
-				if (ec)
+				std::shared_ptr<shard> s = std::make_shared<shard>();
+
+				s->index = i;
+
+				// the opened files are split into the shards.
+				s->metadata = file_metadata_cache(file_metadata_cache::options{
+					.valid = std::chrono::seconds((std::max)(p->cfg.open_file_cache_ttl, 1u)),
+					.max_count = (std::max)(std::size_t(p->cfg.open_file_cache_size) / worker_threads, std::size_t(16)),
+				});
+
+				if (net::iequals(p->cfg.protocol, "http"))
 				{
-					app.logger->error("    set ssl certificate chain for '{}' failed: {} {}",
-						p->cfg.name, p->cfg.cert_file, ec.message());
-					continue;
+					s->server = std::make_shared<net::http_server>(s->ctx.get_executor());
 				}
-				sslctx.use_private_key_file(key_file_path.string(), net::ssl::context::pem, ec);
-				if (ec)
+				else
 				{
-					app.logger->error("    set ssl private key for '{}' failed: {} {}",
-						p->cfg.name, p->cfg.key_file, ec.message());
-					continue;
+					net::ssl::context sslctx(net::ssl::context::sslv23);
+					if (result = init_ssl_context(p, sslctx); !result)
+						break;
+
+					s->server = std::make_shared<net::https_server>(s->ctx.get_executor(), std::move(sslctx));
 				}
 
-				p->server = std::make_shared<net::https_server>(p->ctx.get_executor(), std::move(sslctx));
-			}
-			else
-			{
-				app.logger->error("    the protocol config '{}' of '{}' is invalid", p->cfg.protocol, p->cfg.name);
-				continue;
+				std::visit([&p](auto& server) mutable
+					{
+						init_server(p, server);
+					}, s->server);
+
+				p->shards.emplace_back(std::move(s));
 			}
 
-			std::visit([&p](auto& server) mutable
-				{
-					init_server(p, server);
-				}, p->server);
+			if (!result)
+				continue;
 
 			nodes.emplace_back(std::move(p));
 		}
@@ -243,10 +406,32 @@ namespace nas
 	{
 		for (auto& p : nodes)
 		{
-			std::visit([&p](auto& server) mutable
-				{
-					net::co_spawn(server->get_executor(), start_server(p, server), net::detached);
-				}, p->server);
+			for (auto& s : p->shards)
+			{
+				std::visit([&p, &s](auto& server) mutable
+					{
+						net::co_spawn(server->get_executor(), start_server(p, s, server), net::detached);
+					}, s->server);
+			}
+
+			if (p->cfg.enable_cache_warmup)
+				start_warmup(p);
+
+			p->watcher = std::make_shared<webroot_watcher>(p->shards.front()->ctx.get_executor());
+
+			if (p->watcher->open(p->webroot))
+			{
+				net::co_spawn(p->shards.front()->ctx.get_executor(), p->watcher->run(
+					[p](const webroot_changes& changes) mutable
+					{
+						invalidate_cache(p, changes);
+					}, std::chrono::milliseconds(300)), net::detached);
+			}
+			else
+			{
+				app.logger->info("    the webroot of '{}' isn't watched, the changed files are cached until the cache is cleared",
+					p->cfg.name);
+			}
 		}
 
 		app.event_dispatcher.append_listener(typeid(*this).name(), typeid(http_clear_cache_all_event),
@@ -254,8 +439,8 @@ namespace nas
 			{
 				for (auto& p : nodes)
 				{
-					// change thread to current io_context
-					net::co_spawn(p->ctx.get_executor(), handle_event(p,
+					// change thread to the first shard
+					net::co_spawn(p->shards.front()->ctx.get_executor(), handle_event(p,
 						std::static_pointer_cast<http_clear_cache_all_event>(e)), net::detached);
 				}
 			});
@@ -269,14 +454,31 @@ namespace nas
 
 		for (auto& p : nodes)
 		{
-			std::visit([&p](auto& server) mutable
+			if (p->warmer)
+				p->warmer->stop();
+
+			if (p->watcher)
+			{
+				net::post(p->shards.front()->ctx.get_executor(), [w = p->watcher]() mutable
 				{
-					server->async_stop([](net::error_code) {});
-				}, p->server);
+					w->close();
+				});
+			}
+
+			for (auto& s : p->shards)
+			{
+				std::visit([](auto& server) mutable
+					{
+						server->async_stop([](net::error_code) {});
+					}, s->server);
+			}
 		}
 		for (auto& p : nodes)
 		{
-			p->ctx.join();
+			for (auto& s : p->shards)
+			{
+				s->ctx.join();
+			}
 		}
 	}
 
@@ -288,23 +490,17 @@ namespace nas
 	net::awaitable<void> static_http_server::handle_event(
 		std::shared_ptr<node> p, std::shared_ptr<http_clear_cache_all_event> e)
 	{
-		// acquire lock
-		if (!p->lock.try_send())
-		{
-			co_await p->lock.async_send(net::deferred);
-		}
-
-		// can't use defer_unlock, beacuse it will be destroyed in the thread which 
-		// is not equal to current thread.
-		//[[maybe_unused]] net::defer_unlock defered_unlock{ p->lock };
+		// the requests which are sending the old responses are not blocked.
+		p->cache->clear();
 
-		std::visit([](auto& server) mutable
+		// the metadata caches are only used in the threads of the shards, each one is cleared
+		// in its own thread, and the response is sent after all of them were cleared.
+		for (auto& s : p->shards)
 		{
-			server->router.get_cache().clear();
-		}, p->server);
+			co_await net::dispatch(net::bind_executor(s->ctx.get_executor(), net::use_nothrow_awaitable));
 
-		// release lock
-		p->lock.try_receive([](auto...) {});
+			s->metadata.clear();
+		}
 
 		// change thread to caller io_context
 		co_await net::dispatch(net::bind_executor(e->ch.get_executor(), net::use_nothrow_awaitable));
@@ -7,6 +7,13 @@
 #include "../../core/iconfig.hpp"
 #include "../../core/utils.hpp"
 #include "../../core/imodular.hpp"
+#include "../../core/metrics.hpp"
+#include "../../core/file_sender.hpp"
+#include "../../core/response_cache.hpp"
+#include "../../core/webroot_watcher.hpp"
+#include "../../core/cache_warmer.hpp"
+#include "../../core/http_compress.hpp"
+#include "../../core/file_responder.hpp"
 
 #include "../frontend_http_server/http_clear_cache_all_event.hpp"
 
@@ -19,15 +26,27 @@ namespace nas
 		, public pfr::base_dynamic_creator<imodular, static_http_server>
 	{
 	public:
-		using lock_type = net::as_tuple_t<net::use_awaitable_t<>>::as_default_on_t<
-			net::experimental::channel<void()>>;
+		using node_metrics = http_server_metrics;
 
-		struct node
+		// every shard is a worker thread with its own io_context and server, only the first
+		// shard listens, the accepted clients are dispatched to all the shards in turn.
+		struct shard
 		{
-			static_http_server_info cfg{};
+			std::size_t index = 0;
 			net::io_context_thread ctx{ 1 };
-			lock_type lock{ ctx.get_executor(), 1 };
 			std::variant<std::shared_ptr<net::http_server>, std::shared_ptr<net::https_server>> server;
+			file_metadata_cache metadata{};
+		};
+
+		struct node
+		{
+			static_http_server_info cfg{};
+			std::filesystem::path webroot;
+			std::vector<std::shared_ptr<shard>> shards;
+			std::optional<response_cache> cache;
+			std::optional<node_metrics> metrics;
+			std::shared_ptr<webroot_watcher> watcher; // runs in the first shard
+			std::unique_ptr<cache_warmer> warmer;
 		};
 
 	public: